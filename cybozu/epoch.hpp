@@ -0,0 +1,82 @@
+// Epoch-based reclamation.
+// (C) 2026 Cybozu.
+
+#ifndef CYBOZU_EPOCH_HPP
+#define CYBOZU_EPOCH_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace cybozu {
+
+// A record of the quiescent states of a thread.
+//
+// A thread that reads shared objects owns a record, and announces
+// a *quiescent state*, a point where it holds no references to them,
+// by <quiescent>.  The record then remembers the global epoch of
+// that moment.  A thread going to sleep for a while goes <offline>
+// so that it does not hold up reclamation.  It must announce a
+// quiescent state again before it reads shared objects.
+//
+// To reclaim an object, unlink it from every shared structure, then
+// <advance> the global epoch to `e`.  The object can be freed once
+// every record has <passed> `e`, as no thread can reach the object
+// after it has announced a quiescent state in epoch `e` or later.
+class epoch_record {
+public:
+    epoch_record() = default;
+    epoch_record(const epoch_record&) = delete;
+    epoch_record& operator=(const epoch_record&) = delete;
+
+    // Return the current global epoch.
+    static std::uint64_t current() noexcept {
+        return global().load(std::memory_order_acquire);
+    }
+
+    // Advance the global epoch.
+    //
+    // @return The new epoch.
+    static std::uint64_t advance() noexcept {
+        return global().fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
+
+    // Announce a quiescent state.
+    //
+    // Only the owner thread can call this.
+    void quiescent() noexcept {
+        // paired with loads in <passed>; this must be visible before
+        // the thread reads shared objects again.
+        m_epoch.store(current(), std::memory_order_seq_cst);
+    }
+
+    // Announce that the thread will not read shared objects until
+    // the next <quiescent>.
+    //
+    // Only the owner thread can call this.
+    void offline() noexcept {
+        m_epoch.store(OFFLINE, std::memory_order_release);
+    }
+
+    // Return `true` if the owner has been offline or has announced
+    // a quiescent state in epoch `e` or later.
+    // @e   An epoch returned by <advance>.
+    bool passed(std::uint64_t e) const noexcept {
+        return m_epoch.load(std::memory_order_seq_cst) >= e;
+    }
+
+private:
+    // offline threads pass every epoch.
+    static const std::uint64_t OFFLINE = UINT64_MAX;
+
+    alignas(CACHELINE_SIZE)
+    std::atomic<std::uint64_t> m_epoch{OFFLINE};
+
+    static std::atomic<std::uint64_t>& global() noexcept {
+        static std::atomic<std::uint64_t> epoch{1};
+        return epoch;
+    }
+};
+
+} // namespace cybozu
+
+#endif // CYBOZU_EPOCH_HPP
@@ -0,0 +1,73 @@
+// (C) 2026 Cybozu.
+
+#include "frequency_sketch.hpp"
+
+namespace {
+
+const std::uint64_t SEEDS[] = {
+    0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+    0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL,
+};
+
+const std::memory_order relaxed = std::memory_order_relaxed;
+
+} // anonymous namespace
+
+namespace cybozu {
+
+frequency_sketch::frequency_sketch(std::size_t capacity) {
+    std::size_t width = 1024;
+    unsigned int bits = 10;
+    while( width < capacity ) {
+        width <<= 1;
+        ++ bits;
+    }
+    m_mask = width - 1;
+    m_shift = 64 - bits;
+    m_sample_size = width * 10;
+    m_table.reset(new std::atomic<std::uint8_t>[width * ROWS]);
+    for( std::size_t i = 0; i < width * ROWS; ++i )
+        m_table[i].store(0, relaxed);
+    m_additions.store(0, relaxed);
+}
+
+std::size_t frequency_sketch::index(std::uint64_t hash,
+                                    unsigned int row) const noexcept {
+    std::uint64_t h = (hash ^ (hash >> 29)) * SEEDS[row];
+    return (row * (m_mask + 1)) + static_cast<std::size_t>(h >> m_shift);
+}
+
+void frequency_sketch::increment(std::uint64_t hash) noexcept {
+    bool added = false;
+    for( unsigned int row = 0; row < ROWS; ++row ) {
+        std::atomic<std::uint8_t>& c = m_table[index(hash, row)];
+        std::uint8_t v = c.load(relaxed);
+        if( v < MAX_FREQUENCY ) {
+            c.store(v + 1, relaxed);
+            added = true;
+        }
+    }
+    if( ! added )
+        return;
+    if( m_additions.fetch_add(1, relaxed) + 1 == m_sample_size )
+        halve();
+}
+
+unsigned int frequency_sketch::estimate(std::uint64_t hash) const noexcept {
+    unsigned int f = MAX_FREQUENCY;
+    for( unsigned int row = 0; row < ROWS; ++row ) {
+        unsigned int v = m_table[index(hash, row)].load(relaxed);
+        if( v < f )
+            f = v;
+    }
+    return f;
+}
+
+void frequency_sketch::halve() noexcept {
+    std::size_t n = (m_mask + 1) * ROWS;
+    for( std::size_t i = 0; i < n; ++i )
+        m_table[i].store(m_table[i].load(relaxed) >> 1, relaxed);
+    m_additions.fetch_sub(m_sample_size / 2, relaxed);
+}
+
+} // namespace cybozu
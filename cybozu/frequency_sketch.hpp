@@ -0,0 +1,62 @@
+// frequency_sketch.hpp
+// (C) 2026 Cybozu.
+
+#ifndef CYBOZU_FREQUENCY_SKETCH_HPP
+#define CYBOZU_FREQUENCY_SKETCH_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace cybozu {
+
+// A count-min sketch to estimate access frequencies.
+//
+// This is the frequency sketch used by
+// [TinyLFU](https://arxiv.org/abs/1512.00727).  Each item is counted
+// in 4 rows of saturating 4-bit counters (stored in bytes) indexed by
+// its hash value, and the minimum of the 4 counters is the estimate.
+//
+// All counters are halved after `10 * capacity` increments so that
+// the sketch forgets old history.
+//
+// Counters are relaxed atomics.  Concurrent increments may be lost,
+// which is fine for an estimate.
+class frequency_sketch {
+public:
+    static const unsigned int MAX_FREQUENCY = 15;
+
+    // @capacity  The expected number of items.
+    explicit frequency_sketch(std::size_t capacity);
+    frequency_sketch(const frequency_sketch&) = delete;
+    frequency_sketch& operator=(const frequency_sketch&) = delete;
+
+    // Count an item.
+    // @hash  The 64bit hash value of the item.
+    void increment(std::uint64_t hash) noexcept;
+
+    // Return the estimated frequency of an item.
+    // @hash  The 64bit hash value of the item.
+    unsigned int estimate(std::uint64_t hash) const noexcept;
+
+    std::size_t width() const noexcept {
+        return m_mask + 1;
+    }
+
+private:
+    static const unsigned int ROWS = 4;
+
+    std::size_t index(std::uint64_t hash, unsigned int row) const noexcept;
+    void halve() noexcept;
+
+    std::size_t m_mask;
+    unsigned int m_shift;
+    std::size_t m_sample_size;
+    std::unique_ptr<std::atomic<std::uint8_t>[]> m_table;
+    std::atomic<std::size_t> m_additions;
+};
+
+} // namespace cybozu
+
+#endif // CYBOZU_FREQUENCY_SKETCH_HPP
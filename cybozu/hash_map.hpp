@@ -7,6 +7,8 @@
 #include "siphash.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstring>
 #include <memory>
 #include <mutex>
@@ -105,6 +107,12 @@ unsigned int nearest_prime(unsigned int n) noexcept;
 // Each bucket in the hash map has its unique mutex to guard itself.
 // This design reduces contensions between threads drastically in exchange
 // for some functions such as dynamic resizing of the number of buckets.
+//
+// Whether each bucket has objects or not is kept in an occupancy map,
+// a dense array of flags separate from buckets.  A flag is written only
+// when its bucket becomes empty or non-empty.  Scanners such as GC can
+// read the map sequentially to skip empty buckets without locking them
+// or touching their cache lines.
 template<typename T>
 class hash_map {
     static_assert( std::is_move_constructible<T>::value ||
@@ -131,7 +139,7 @@ public:
         };
 
     public:
-        bucket(): m_objects(nullptr) {}
+        bucket(): m_objects(nullptr), m_occupied(nullptr) {}
         ~bucket() {
             clear_nolock();
         }
@@ -168,6 +176,8 @@ public:
             }
             if( ! c ) return false;
             m_objects = new item(key, c, m_objects);
+            if( m_objects->next == nullptr )
+                set_occupied(true);
             return true;
         }
 
@@ -201,6 +211,8 @@ public:
                     item* to_delete = *p;
                     *p = to_delete->next;
                     delete to_delete;
+                    if( m_objects == nullptr )
+                        set_occupied(false);
                     if( callback ) callback(key);
                     return true;
                 }
@@ -232,6 +244,8 @@ public:
                     if( pred(key, to_delete->object) ) {
                         *p = to_delete->next;
                         delete to_delete;
+                        if( m_objects == nullptr )
+                            set_occupied(false);
                     }
                     return true;
                 }
@@ -246,15 +260,19 @@ public:
         // Objects for which `pred` returns `true` will be removed.
         void gc(const std::function<bool(const hash_key&, T&)>& pred) {
             lock_guard g(m_lock);
+            bool removed = false;
             for( item** p = &m_objects; *p != nullptr; ) {
                 item* to_delete = *p;
                 if( pred(to_delete->key, to_delete->object) ) {
                     *p = to_delete->next;
                     delete to_delete;
+                    removed = true;
                 } else {
                     p = &(to_delete->next);
                 }
             }
+            if( removed && m_objects == nullptr )
+                set_occupied(false);
         }
 
         // Clear objects in this bucket.
@@ -264,16 +282,33 @@ public:
                 delete m_objects;
                 m_objects = next;
             }
+            if( m_occupied )
+                set_occupied(false);
         }
 
     private:
         using lock_guard = std::lock_guard<std::mutex>;
         mutable std::mutex m_lock;
         item* m_objects;
+        std::atomic<bool>* m_occupied; // the flag in the occupancy map
+
+        // The flag is written only while the bucket is locked.
+        void set_occupied(bool occupied) noexcept {
+            m_occupied->store(occupied, std::memory_order_relaxed);
+        }
+
+        friend class hash_map;
     };
 
     hash_map(unsigned int buckets):
-        m_size(nearest_prime(buckets)), m_buckets(m_size) {}
+        m_size(nearest_prime(buckets)),
+        m_occupied(new std::atomic<bool>[m_size]()),
+        m_buckets(m_size) {
+        for( std::size_t i = 0; i < m_size; ++i )
+            m_buckets[i].m_occupied = &m_occupied[i];
+    }
+    hash_map(const hash_map&) = delete;
+    hash_map& operator=(const hash_map&) = delete;
 
     // Handle or insert an object.
     // @key      The object's key.
@@ -358,6 +393,29 @@ public:
         return m_buckets[key.hash() % m_size];
     }
 
+    // Return `true` if the `index`-th bucket has objects.
+    //
+    // This reads only the occupancy map without locking the bucket.
+    // The result may be stale if other threads are modifying the bucket.
+    bool occupied(std::size_t index) const noexcept {
+        return m_occupied[index].load(std::memory_order_relaxed);
+    }
+
+    // Find a non-empty bucket.
+    // @first  The index of the first bucket to look at.
+    // @last   The index past the last bucket to look at.
+    //
+    // @return  The index of the first non-empty bucket in
+    //          [`first`, `last`), or `last` if there is none.
+    std::size_t next_occupied(std::size_t first,
+                              std::size_t last) const noexcept {
+        for( ; first < last; ++first ) {
+            if( m_occupied[first].load(std::memory_order_relaxed) )
+                break;
+        }
+        return first;
+    }
+
     // <bucket> iterator.
     using iterator = typename std::vector<bucket>::iterator;
 
@@ -371,6 +429,8 @@ public:
 
 private:
     const std::size_t   m_size;
+    // the occupancy map must outlive buckets.
+    std::unique_ptr<std::atomic<bool>[]> m_occupied;
     std::vector<bucket> m_buckets;
 };
 
@@ -0,0 +1,186 @@
+// (C) 2026 Cybozu.
+
+#include "lz4.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+const std::size_t MIN_MATCH = 4;
+// The last match must start at least 12 bytes before the end of block.
+const std::size_t MF_LIMIT = 12;
+// The last 5 bytes are always literals.
+const std::size_t LAST_LITERALS = 5;
+const std::size_t MAX_DISTANCE = 65535;
+const unsigned int HASH_LOG = 12;
+
+inline std::uint32_t read32(const char* p) noexcept {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint32_t hash4(std::uint32_t v) noexcept {
+    return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+// Write a LZ4 length extension.
+// @return  The advanced output pointer, or `nullptr` if it overflows.
+inline char* put_length(char* op, char* oend, std::size_t len) noexcept {
+    for( ; len >= 255; len -= 255 ) {
+        if( op == oend ) return nullptr;
+        *op++ = (char)255;
+    }
+    if( op == oend ) return nullptr;
+    *op++ = (char)len;
+    return op;
+}
+
+// Emit a sequence of literals and an optional match.
+// @return  The advanced output pointer, or `nullptr` if it overflows.
+char* put_sequence(char* op, char* oend,
+                   const char* literals, std::size_t n_literals,
+                   std::size_t offset, std::size_t match_len) noexcept {
+    if( op == oend ) return nullptr;
+    char* token = op++;
+    unsigned char t = (n_literals >= 15) ? 0xf0 :
+        (unsigned char)(n_literals << 4);
+    if( n_literals >= 15 ) {
+        op = put_length(op, oend, n_literals - 15);
+        if( op == nullptr ) return nullptr;
+    }
+    if( (std::size_t)(oend - op) < n_literals ) return nullptr;
+    std::memcpy(op, literals, n_literals);
+    op += n_literals;
+
+    if( match_len != 0 ) {
+        if( (oend - op) < 2 ) return nullptr;
+        *op++ = (char)(offset & 0xff);
+        *op++ = (char)(offset >> 8);
+        std::size_t ml = match_len - MIN_MATCH;
+        if( ml >= 15 ) {
+            t |= 0x0f;
+            op = put_length(op, oend, ml - 15);
+            if( op == nullptr ) return nullptr;
+        } else {
+            t |= (unsigned char)ml;
+        }
+    }
+    *token = (char)t;
+    return op;
+}
+
+// Read a LZ4 length extension.
+// @return  `false` if the input is truncated.
+inline bool get_length(const unsigned char*& ip, const unsigned char* iend,
+                       std::size_t& len) noexcept {
+    unsigned int s;
+    do {
+        if( ip == iend ) return false;
+        s = *ip++;
+        len += s;
+    } while( s == 255 );
+    return true;
+}
+
+} // anonymous namespace
+
+namespace cybozu {
+
+std::size_t lz4_compress(const char* src, std::size_t len,
+                         char* dst, std::size_t capacity) noexcept {
+    char* op = dst;
+    char* const oend = dst + capacity;
+    std::size_t anchor = 0;
+
+    if( len > MF_LIMIT ) {
+        std::uint32_t table[1 << HASH_LOG];
+        std::memset(table, 0, sizeof(table));
+        const std::size_t match_limit = len - LAST_LITERALS;
+        const std::size_t ip_limit = len - MF_LIMIT;
+        std::size_t ip = 0;
+
+        while( ip < ip_limit ) {
+            std::uint32_t seq = read32(src + ip);
+            std::uint32_t h = hash4(seq);
+            std::size_t ref = table[h];
+            table[h] = (std::uint32_t)ip;
+            if( ref >= ip || (ip - ref) > MAX_DISTANCE ||
+                read32(src + ref) != seq ) {
+                // skip faster over incompressible data.
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            // extend the match backwards into pending literals.
+            while( ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1] ) {
+                --ip;
+                --ref;
+            }
+            std::size_t match_len = MIN_MATCH;
+            while( ip + match_len < match_limit &&
+                   src[ref + match_len] == src[ip + match_len] )
+                ++match_len;
+
+            op = put_sequence(op, oend, src + anchor, ip - anchor,
+                              ip - ref, match_len);
+            if( op == nullptr ) return 0;
+            ip += match_len;
+            anchor = ip;
+            if( ip < ip_limit )
+                table[hash4(read32(src + ip - 2))] = (std::uint32_t)(ip - 2);
+        }
+    }
+
+    op = put_sequence(op, oend, src + anchor, len - anchor, 0, 0);
+    if( op == nullptr ) return 0;
+    return (std::size_t)(op - dst);
+}
+
+bool lz4_decompress(const char* src, std::size_t len,
+                    char* dst, std::size_t dst_len) noexcept {
+    const unsigned char* ip = (const unsigned char*)src;
+    const unsigned char* const iend = ip + len;
+    char* op = dst;
+    char* const oend = dst + dst_len;
+
+    while( ip != iend ) {
+        unsigned int token = *ip++;
+        std::size_t n_literals = token >> 4;
+        if( n_literals == 15 && ! get_length(ip, iend, n_literals) )
+            return false;
+        if( (std::size_t)(iend - ip) < n_literals ||
+            (std::size_t)(oend - op) < n_literals )
+            return false;
+        std::memcpy(op, ip, n_literals);
+        ip += n_literals;
+        op += n_literals;
+        if( ip == iend ) break;
+
+        if( (iend - ip) < 2 ) return false;
+        std::size_t offset = ip[0] | ((std::size_t)ip[1] << 8);
+        ip += 2;
+        if( offset == 0 || offset > (std::size_t)(op - dst) )
+            return false;
+        std::size_t match_len = token & 0x0f;
+        if( match_len == 15 && ! get_length(ip, iend, match_len) )
+            return false;
+        match_len += MIN_MATCH;
+        if( (std::size_t)(oend - op) < match_len )
+            return false;
+
+        const char* ref = op - offset;
+        if( offset >= match_len ) {
+            std::memcpy(op, ref, match_len);
+            op += match_len;
+        } else {
+            // overlapping copy repeats the last `offset` bytes.
+            for( std::size_t i = 0; i < match_len; ++i )
+                *op++ = *ref++;
+        }
+    }
+    return op == oend;
+}
+
+} // namespace cybozu
@@ -0,0 +1,47 @@
+// lz4.hpp
+// (C) 2026 Cybozu.
+
+#ifndef CYBOZU_LZ4_HPP
+#define CYBOZU_LZ4_HPP
+
+#include <cstddef>
+
+namespace cybozu {
+
+// Return the maximum size of LZ4-compressed data of `len` bytes.
+constexpr std::size_t lz4_compress_bound(std::size_t len) noexcept {
+    return len + (len / 255) + 16;
+}
+
+// Compress data in LZ4 block format.
+// @src       Pointer to the source data.
+// @len       Length of the source data.
+// @dst       Pointer to the destination buffer.
+// @capacity  Size of the destination buffer.
+//
+// This function compresses `src` into a raw LZ4 block as described in
+// [the block format](https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md).
+// The output can be decompressed by any conforming LZ4 implementation.
+//
+// Compression stops early if the output would not fit in `capacity`
+// bytes, so callers can pass a capacity smaller than the source to
+// give up on incompressible data quickly.
+//
+// @return  The compressed size, or 0 if it did not fit in `capacity`.
+std::size_t lz4_compress(const char* src, std::size_t len,
+                         char* dst, std::size_t capacity) noexcept;
+
+// Decompress a LZ4 block.
+// @src      Pointer to the compressed data.
+// @len      Length of the compressed data.
+// @dst      Pointer to the destination buffer.
+// @dst_len  Exact length of the original data.
+//
+// @return  `true` if the block is valid and decompressed to exactly
+//          `dst_len` bytes, `false` otherwise.
+bool lz4_decompress(const char* src, std::size_t len,
+                    char* dst, std::size_t dst_len) noexcept;
+
+} // namespace cybozu
+
+#endif // CYBOZU_LZ4_HPP
@@ -0,0 +1,91 @@
+// Lock-free multi-producer single-consumer queue.
+// (C) 2026 Cybozu.
+
+#ifndef CYBOZU_MPSC_QUEUE_HPP
+#define CYBOZU_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <new>
+#include <utility>
+
+namespace cybozu {
+
+// An unbounded lock-free queue for many producers and one consumer.
+//
+// Any thread may <push> elements.  A push costs one atomic exchange,
+// and never waits for other producers or the consumer.  Only one
+// thread at a time may call <front> and <pop>; switching the consumer
+// thread needs external synchronization.
+//
+// An element whose <push> has not returned may not be visible yet to
+// the consumer even if elements pushed later are.  Producers should
+// notify the consumer after <push> returns.
+template<typename T>
+class mpsc_queue {
+public:
+    mpsc_queue(): m_head(&m_stub), m_tail(&m_stub) {}
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    ~mpsc_queue() {
+        while( front() != nullptr )
+            pop();
+        if( m_tail != &m_stub )
+            delete static_cast<node*>(m_tail);
+    }
+
+    // Append an element.
+    // @value  The element.
+    //
+    // This can be called by any thread.
+    void push(T&& value) {
+        node* n = new node(std::move(value));
+        link* prev = m_head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // Return the first element, or `nullptr` if none is visible.
+    //
+    // This is for the consumer thread only.
+    T* front() noexcept {
+        link* next = m_tail->next.load(std::memory_order_acquire);
+        if( next == nullptr ) return nullptr;
+        return static_cast<node*>(next)->value();
+    }
+
+    // Remove the first element.
+    //
+    // This is for the consumer thread only, and <front> must
+    // have returned an element.
+    void pop() noexcept {
+        link* next = m_tail->next.load(std::memory_order_acquire);
+        // `next` becomes the new stub whose element is destructed.
+        static_cast<node*>(next)->value()->~T();
+        if( m_tail != &m_stub )
+            delete static_cast<node*>(m_tail);
+        m_tail = next;
+    }
+
+private:
+    struct link {
+        std::atomic<link*> next{nullptr};
+    };
+
+    struct node: public link {
+        explicit node(T&& v) {
+            new(m_storage) T(std::move(v));
+        }
+        T* value() noexcept {
+            return std::launder(reinterpret_cast<T*>(m_storage));
+        }
+        alignas(T) unsigned char m_storage[sizeof(T)];
+    };
+
+    link m_stub;
+    std::atomic<link*> m_head;  // the last pushed element
+    link* m_tail;               // the stub or the last popped element
+};
+
+} // namespace cybozu
+
+#endif // CYBOZU_MPSC_QUEUE_HPP
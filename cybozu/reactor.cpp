@@ -1,17 +1,52 @@
 // (C) 2013 Cybozu.
 
 #include "reactor.hpp"
+#include "uring.hpp"
 #include "util.hpp"
 
 #include <algorithm>
+#include <cerrno>
 #include <chrono>
 #include <iterator>
+#include <system_error>
 
 namespace {
 
 const int EPOLL_SIZE = 128;
 const int POLLING_TIMEOUT = 100; // milli seconds
 
+const unsigned int URING_ENTRIES = 1024;
+const unsigned int RECV_BUFFERS = 256;
+const std::size_t RECV_BUFFER_SIZE = 16 << 10;
+
+// io_uring requests are identified by user data made of
+// the tag of the resource, the operation, and the file descriptor.
+enum uring_op: std::uint64_t {
+    OP_POLL    = 0,
+    OP_ACCEPT  = 1,
+    OP_RECV    = 2,
+    OP_CONTROL = 3,  // cancel or update requests; results are ignored.
+};
+const std::uint32_t TAG_MASK = (1U << 30) - 1;
+
+inline std::uint64_t user_data(std::uint32_t tag, uring_op op, int fd) {
+    return (static_cast<std::uint64_t>(tag) << 34) | (op << 32) |
+        static_cast<std::uint32_t>(fd);
+}
+
+std::unique_ptr<cybozu::uring> make_uring(cybozu::reactor::backend b) {
+    if( b != cybozu::reactor::backend::IO_URING )
+        return nullptr;
+    try {
+        return std::unique_ptr<cybozu::uring>(
+            new cybozu::uring(URING_ENTRIES, RECV_BUFFERS, RECV_BUFFER_SIZE));
+    } catch( const std::system_error& e ) {
+        cybozu::logger::info() << "io_uring is not available ("
+                               << e.what() << "), falling back to epoll.";
+        return nullptr;
+    }
+}
+
 }
 
 namespace cybozu {
@@ -21,16 +56,15 @@ void resource::invalidate_and_close_() {
     if( ! m_valid.compare_exchange_strong(expected, false) )
         return;
 
-    // no need to read-lock `m_lock` here because `m_fd` will not be
-    // closed before this function calls `reactor::request_removal`.
     on_invalidate(m_fd);
     m_reactor->request_removal(*this);
 }
 
-reactor::reactor():
-    m_fd( epoll_create1(EPOLL_CLOEXEC) ), m_running(true)
+reactor::reactor(backend b):
+    m_uring( make_uring(b) ),
+    m_fd( m_uring ? -1 : epoll_create1(EPOLL_CLOEXEC) ), m_running(true)
 {
-    if( m_fd == -1 )
+    if( ! m_uring && m_fd == -1 )
         throw_unix_error(errno, "epoll_create1");
     m_resources.max_load_factor(1.0);
     m_resources.reserve(100000);
@@ -38,10 +72,12 @@ reactor::reactor():
     m_readables_copy.reserve(256);
     m_drop_req.reserve(256);
     m_drop_req_copy.reserve(256);
+    m_received.reserve(256);
 }
 
 reactor::~reactor() {
-    ::close(m_fd);
+    if( m_fd != -1 )
+        ::close(m_fd);
 }
 
 void reactor::add_resource(std::unique_ptr<resource> res, int events) {
@@ -49,6 +85,15 @@ void reactor::add_resource(std::unique_ptr<resource> res, int events) {
         throw std::logic_error("<reactor::add_resource> already added!");
     res->m_reactor = this;
     const int fd = res->m_fd;
+    if( m_uring ) {
+        m_last_tag = (m_last_tag + 1) & TAG_MASK;
+        res->m_tag = m_last_tag;
+        res->m_mode = res->preferred_mode();
+        res->m_events = static_cast<std::uint32_t>(events);
+        arm(*res);
+        m_resources.emplace(fd, std::move(res));
+        return;
+    }
     struct epoll_event ev;
     ev.events = events | EPOLLET;
     ev.data.fd = fd;
@@ -59,6 +104,14 @@ void reactor::add_resource(std::unique_ptr<resource> res, int events) {
 
 void reactor::modify_events(const resource& res, int events) {
     const int fd = res.m_fd;
+    if( m_uring ) {
+        if( res.m_mode != resource::io_mode::POLL )
+            throw std::logic_error("<reactor::modify_events> not polled");
+        m_resources[fd]->m_events = static_cast<std::uint32_t>(events);
+        m_uring->update_poll(user_data(res.m_tag, OP_POLL, fd), events,
+                             user_data(0, OP_CONTROL, fd));
+        return;
+    }
     struct epoll_event ev;
     ev.events = events | EPOLLET;
     ev.data.fd = fd;
@@ -89,17 +142,18 @@ void reactor::remove_resource(int fd) {
         dump_stack();
         throw std::logic_error("bug in remove_resource");
     }
-    auto res = it->second.get();
     m_garbage.emplace_back( std::move(it->second) );
     m_resources.erase(it);
-    if( epoll_ctl(m_fd, EPOLL_CTL_DEL, fd, NULL) == -1 )
+    if( m_uring ) {
+        // requests hold a reference to the file; cancel them
+        // so that the file is released when the resource is destructed.
+        m_uring->cancel_fd(fd, user_data(0, OP_CONTROL, fd));
+        m_uring->submit();
+    } else if( epoll_ctl(m_fd, EPOLL_CTL_DEL, fd, NULL) == -1 ) {
         throw_unix_error(errno, "epoll_ctl(EPOLL_CTL_DEL)");
+    }
     m_readables.erase(std::remove(m_readables.begin(), m_readables.end(), fd),
                       m_readables.end());
-
-    if( ! res->try_close() ) {
-        logger::debug() << "failed to close fd (will be closed later): " << fd;
-    }
 }
 
 void reactor::poll() {
@@ -123,8 +177,16 @@ void reactor::poll() {
         remove_resource(fd);
     m_drop_req_copy.clear();
 
-    struct epoll_event events[EPOLL_SIZE];
     int timeout = m_readables.empty() ? POLLING_TIMEOUT : 0;
+    if( m_uring ) {
+        poll_uring(timeout);
+    } else {
+        poll_epoll(timeout);
+    }
+}
+
+void reactor::poll_epoll(int timeout) {
+    struct epoll_event events[EPOLL_SIZE];
     int n = epoll_wait(m_fd, events, EPOLL_SIZE, timeout);
     if( n == -1 ) {
         if( errno == EINTR ) return;
@@ -136,9 +198,12 @@ void reactor::poll() {
         const int fd = ev.data.fd;
         resource& r = *(m_resources[fd]);
         if( ev.events & EPOLLERR ) {
-            if( ! r.on_error(fd) )
+            if( ! r.on_error(fd) ) {
                 remove_resource(fd);
-            continue;
+                continue;
+            }
+            // the resource may have consumed the error by itself.
+            if( ! r.valid() ) continue;
         }
         if( ev.events & EPOLLHUP ) {
             if( ! r.on_hangup(fd) ) {
@@ -159,4 +224,195 @@ void reactor::poll() {
     }
 }
 
+void reactor::arm(resource& res) {
+    const int fd = res.m_fd;
+    switch( res.m_mode ) {
+    case resource::io_mode::POLL:
+        m_uring->poll(fd, res.m_events, user_data(res.m_tag, OP_POLL, fd));
+        break;
+    case resource::io_mode::ACCEPT:
+        m_uring->accept(fd, user_data(res.m_tag, OP_ACCEPT, fd));
+        break;
+    case resource::io_mode::RECV:
+        // data are received by <uring::recv>; poll only for the rest.
+        if( res.m_events & EVENT_OUT )
+            m_uring->poll(fd, EPOLLOUT, user_data(res.m_tag, OP_POLL, fd));
+        if( res.m_events & EVENT_IN ) {
+            m_uring->recv(fd, user_data(res.m_tag, OP_RECV, fd));
+            res.m_recv_armed = true;
+        }
+        break;
+    }
+}
+
+void reactor::poll_uring(int timeout) {
+    {
+        lock_guard g(m_lock);
+        m_resume_req_copy.swap(m_resume_req);
+    }
+    for( int fd: m_resume_req_copy ) {
+        auto it = m_resources.find(fd);
+        if( it == m_resources.end() ) continue;
+        resource& r = *(it->second);
+        if( ! r.m_recv_paused ) continue;
+        if( r.m_recv_armed ) {
+            // wait for the cancellation to complete.
+            r.m_resume = true;
+            continue;
+        }
+        r.m_recv_paused = false;
+        m_uring->recv(fd, user_data(r.m_tag, OP_RECV, fd));
+        r.m_recv_armed = true;
+    }
+    m_resume_req_copy.clear();
+
+    m_uring->submit(timeout);
+    m_uring->for_each_completion([this](const io_uring_cqe& cqe) {
+        complete(cqe);
+    });
+
+    // dispatch resources that received data.
+    std::sort(m_received.begin(), m_received.end());
+    m_received.erase(std::unique(m_received.begin(), m_received.end()),
+                     m_received.end());
+    for( int fd: m_received ) {
+        auto it = m_resources.find(fd);
+        if( it == m_resources.end() ) continue;
+        if( ! it->second->on_readable(fd) )
+            remove_resource(fd);
+    }
+    m_received.clear();
+}
+
+void reactor::complete(const io_uring_cqe& cqe) {
+    const int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+    const auto op = static_cast<uring_op>((cqe.user_data >> 32) & 3);
+    const std::uint32_t tag = static_cast<std::uint32_t>(cqe.user_data >> 34);
+    if( op == OP_CONTROL ) return;
+
+    resource* r = nullptr;
+    auto it = m_resources.find(fd);
+    if( it != m_resources.end() && it->second->m_tag == tag )
+        r = it->second.get();
+
+    if( op == OP_RECV ) {
+        complete_recv(r, cqe);
+        return;
+    }
+
+    const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    if( op == OP_ACCEPT ) {
+        if( cqe.res >= 0 ) {
+            if( r == nullptr ) {
+                ::close(cqe.res);
+                return;
+            }
+            if( ! r->on_accept(cqe.res) ) {
+                remove_resource(fd);
+                return;
+            }
+        } else if( cqe.res == -EMFILE || cqe.res == -ENFILE ) {
+            logger::error() << "accept: Too many open files.";
+        }
+        if( r != nullptr && ! more && cqe.res != -ECANCELED )
+            m_uring->accept(fd, cqe.user_data);
+        return;
+    }
+
+    // OP_POLL
+    if( r == nullptr ) return;
+    if( cqe.res < 0 ) {
+        if( cqe.res != -ECANCELED )
+            m_uring->poll(fd, r->m_events, cqe.user_data);
+        return;
+    }
+    const std::uint32_t events = static_cast<std::uint32_t>(cqe.res);
+    if( events & EPOLLERR ) {
+        if( ! r->on_error(fd) ) {
+            remove_resource(fd);
+            return;
+        }
+        // the resource may have consumed the error by itself.
+        if( ! r->valid() ) return;
+    }
+    if( events & EPOLLHUP ) {
+        if( ! r->on_hangup(fd) ) {
+            remove_resource(fd);
+            return;
+        }
+    }
+    if( events & EPOLLIN ) {
+        if( ! r->on_readable(fd) ) {
+            remove_resource(fd);
+            return;
+        }
+    }
+    if( events & EPOLLOUT ) {
+        if( ! r->on_writable(fd) ) {
+            remove_resource(fd);
+            return;
+        }
+    }
+    if( ! more ) {
+        const std::uint32_t mask = (r->m_mode == resource::io_mode::POLL) ?
+            r->m_events : EPOLLOUT;
+        m_uring->poll(fd, mask, cqe.user_data);
+    }
+}
+
+void reactor::complete_recv(resource* r, const io_uring_cqe& cqe) {
+    const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    const char* p = nullptr;
+    std::uint16_t bid = 0;
+    if( cqe.flags & IORING_CQE_F_BUFFER ) {
+        bid = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        p = m_uring->buffer(bid);
+    }
+
+    if( r == nullptr ) {
+        if( p != nullptr )
+            m_uring->recycle(bid);
+        return;
+    }
+
+    if( ! more )
+        r->m_recv_armed = false;
+
+    const int fd = r->m_fd;
+    bool again = false;
+    bool closed = false;
+    if( cqe.res > 0 ) {
+        bool keep = r->on_received(p, cqe.res);
+        m_received.push_back(fd);
+        if( ! keep && ! r->m_recv_paused ) {
+            r->m_recv_paused = true;
+            if( more )
+                m_uring->cancel(cqe.user_data, user_data(0, OP_CONTROL, fd));
+        }
+        again = ! more && ! r->m_recv_paused;
+    } else if( cqe.res == -ENOBUFS ) {
+        // provided buffers ran out; they have been recycled since.
+        again = ! r->m_recv_paused;
+    } else if( cqe.res != -ECANCELED ) {
+        // the end of stream, or an error.
+        r->on_received(nullptr, cqe.res);
+        m_received.push_back(fd);
+        closed = true;
+    }
+    if( ! more && ! closed && r->m_recv_paused && r->m_resume ) {
+        // the request has ended, by the cancellation or by itself
+        // before the cancellation took effect.
+        r->m_recv_paused = false;
+        r->m_resume = false;
+        again = true;
+    }
+    if( p != nullptr )
+        m_uring->recycle(bid);
+
+    if( again ) {
+        m_uring->recv(fd, cqe.user_data);
+        r->m_recv_armed = true;
+    }
+}
+
 } // namespace cybozu
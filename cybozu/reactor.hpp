@@ -1,4 +1,4 @@
-// A reactor implementation using epoll(2).
+// A reactor implementation using epoll(2) or io_uring.
 // (C) 2013 Cybozu.
 
 #ifndef CYBOZU_REACTOR_HPP
@@ -9,10 +9,12 @@
 #include "util.hpp"
 
 #include <atomic>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <stdexcept>
 #include <sys/epoll.h>
+#include <sys/types.h>
 #include <unistd.h>
 #include <unordered_map>
 #include <vector>
@@ -23,11 +25,13 @@
 #undef PTHREAD_RWLOCK_INITIALIZER
 #define PTHREAD_RWLOCK_INITIALIZER PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
 #endif
-#include <shared_mutex>
+
+struct io_uring_cqe;
 
 namespace cybozu {
 
 class reactor;
+class uring;
 
 // An abstraction of a file descriptor.
 //
@@ -50,12 +54,11 @@ public:
     // when being destructed. See the design doc for details.
     // https://github.com/cybozu/yrmcds/blob/master/docs/design.md#strategy-to-reclaim-shared-sockets
     //
-    // `m_closed` is edited and checked only by the reactor thread, so no memory synchronization
-    // is necessary here. `m_fd` is a constant, so no synchronization is necessary either.
+    // This is the only place where `m_fd` is closed.  Closing it any
+    // earlier would allow the kernel to reuse the number while another
+    // thread is still in <with_fd>.
     virtual ~resource() {
-        if( ! m_closed ) {
-            ::close(m_fd);
-        }
+        ::close(m_fd);
     }
 
     // `true` if this resource is still valid.
@@ -75,7 +78,6 @@ public:
             return true;
         }
 
-        // no need to read-lock `m_lock` because this is on the reactor thread.
         on_invalidate(m_fd);
         return false;
     }
@@ -125,13 +127,62 @@ public:
     // Called when the reactor finds an error on this resource.
     //
     // This method is called when the reactor detects some error.
+    // If this returns `true` and the resource is still valid, other
+    // events are processed as usual.
     virtual bool on_error(int fd) {
         return invalidate();
     }
 
+    // How the reactor drives a resource.
+    enum class io_mode {
+        POLL,    // notify readiness by <on_readable> and <on_writable>.
+        ACCEPT,  // accept connections and pass them to <on_accept>.
+        RECV,    // receive data and pass them to <on_received>.
+    };
+
+    // Return how this resource prefers to be driven.
+    //
+    // The epoll backend of <reactor> always uses `io_mode::POLL`.
+    // The io_uring backend can accept connections or receive data
+    // on behalf of the resource to save system calls.
+    virtual io_mode preferred_mode() const {
+        return io_mode::POLL;
+    }
+
+    // Called when the reactor has accepted a new connection.
+    // @s  A non-blocking socket for the new connection.
+    //
+    // This is used only in `io_mode::ACCEPT`.  The ownership of `s`
+    // is moved to this resource.
+    //
+    // @return `true` or return value of <invalidate>.
+    virtual bool on_accept(int s) {
+        ::close(s);
+        return true;
+    }
+
+    // Called when the reactor has received data.
+    // @p    Received data.
+    // @len  Length of the data, 0 at the end of stream, or
+    //       a negated `errno` value.
+    //
+    // This is used only in `io_mode::RECV`.  `p` is valid only during
+    // the call.  <on_readable> is called after this to process data.
+    //
+    // @return `false` to stop receiving until <reactor::request_resume>
+    //         is called, `true` otherwise.
+    virtual bool on_received(const char* p, ::ssize_t len) {
+        return true;
+    }
+
 protected:
     reactor* m_reactor = nullptr;
 
+    // Return the <io_mode> chosen by the reactor.
+    io_mode mode() const noexcept {
+        return m_mode;
+    }
+
     friend class reactor;
 
     // Call `f` with the file descriptor of this resource.
@@ -145,11 +196,13 @@ protected:
     // The template function `f` should return `true` if it wants to keep
     // the resource valid.  If it should returns `false`, then <with_fd>
     // invalidates the resource.
+    //
+    // This takes no lock.  The file descriptor stays open until the
+    // resource is destructed, which happens only after every worker
+    // thread has been idle since the resource was removed.
     template<typename Func>
     bool with_fd(Func&& f) {
-        read_lock g(m_lock);
-        if( ! valid() ) return false;
-        // no need to check m_closed because it becomes true only after m_valid is set to false.
+        if( ! m_valid.load(std::memory_order_acquire) ) return false;
 
         if( f(m_fd) ) {
             return true;
@@ -170,52 +223,25 @@ protected:
 
 private:
 
-    // The resource status is represented with the following two flags.
-    // `m_valid`: New operations (such as read, write) on this resource can be initiated only when `m_valid` is true.
-    //            Note that even if `m_valid` is false, there may still be outstanding operations.
-    // `m_closed`: This flag represents the open/close status of the file descriptor.
-    //             The file descriptor is closed only after `m_valid` is set to false.
-    //
-    // We have to have `m_closed` separately from `m_valid` because we want to
-    // close the file descriptor as early as possible, but it cannot always be
-    // done immediately.  See `try_close` for details.
-    //
-    // Since `m_closed` is used only by the reactor thread, we do not need to
-    // protect it with a guarding lock.
+    // New operations (such as read, write) on this resource can be
+    // initiated only when `m_valid` is true.  Note that even if `m_valid`
+    // is false, there may still be outstanding operations.
     std::atomic_bool m_valid = true;
-    bool m_closed = false;
 
     // `m_fd` is the file descriptor of this resource.
     //
-    // The file descriptor may be closed by the reactor thread earlier than the resource is destructed.
-    // To avoid closing the file descriptor while other threads are using it, we use a shared mutex `m_lock`.
-    //
-    // The reactor thread tries to acquire a write lock when it closes the file descriptor.
-    // Other threads must acquire a read lock while it uses the file descriptor through <with_fd>.
-    //
-    // Since the reactor thread is the only thread that can close `m_fd`, the reactor thread does
-    // not need to acquire a read lock when it uses `m_fd`.
-    mutable std::shared_mutex m_lock;
-    typedef std::shared_lock<std::shared_mutex> read_lock;
-    typedef std::unique_lock<std::shared_mutex> write_lock;
+    // It is closed only by the destructor.  Since resources are destructed
+    // only after the reactor confirms that no other threads are in the
+    // middle of using them, other threads need no lock to use `m_fd`.
     const int m_fd;
 
-    // This tries to close the file descriptor if no other threads are using it.
-    // Called only from the friend class <reactor> to early close the file descriptor.
-    // That means that only the reactor thread can use this.
-    //
-    // If another thread is using the file descriptor, this does nothing and returns `false`.
-    // In that case, the file descriptor will be closed when this resource is destructed.
-    bool try_close() {
-        write_lock g(m_lock, std::try_to_lock);
-        if( ! g ) return false;
-
-        if( ! m_closed ) {
-            ::close(m_fd);
-            m_closed = true;
-        }
-        return true;
-    }
+    // The following members are used only by the reactor thread.
+    io_mode m_mode = io_mode::POLL;
+    std::uint32_t m_events = 0;
+    std::uint32_t m_tag = 0;      // distinguishes reused file descriptors
+    bool m_recv_armed = false;    // a receive request is in flight
+    bool m_recv_paused = false;   // stopped by <on_received>
+    bool m_resume = false;        // resume after the request ends
 
     // A supplementary method for <with_fd>.
     void invalidate_and_close_();
@@ -224,12 +250,32 @@ private:
 
 // The reactor.
 //
-// This reactor internally uses epoll with edge-triggered mode.
+// This reactor internally uses epoll with edge-triggered mode, or
+// io_uring with multishot requests.  With io_uring, all requests are
+// submitted and all completions are reaped by a single system call
+// per loop, and resources may let the reactor accept connections or
+// receive data for them (see <resource::preferred_mode>).
 class reactor {
 public:
-    reactor();
+    // I/O backends.
+    enum class backend {
+        EPOLL,
+        IO_URING,
+    };
+
+    // Constructor.
+    // @b  The preferred backend.
+    //
+    // If the kernel does not support io_uring features required by
+    // the reactor, epoll is used instead.
+    explicit reactor(backend b = backend::EPOLL);
     ~reactor();
 
+    // Return the backend in use.
+    backend get_backend() const noexcept {
+        return m_uring ? backend::IO_URING : backend::EPOLL;
+    }
+
     // Events to poll.
     enum reactor_event {
         EVENT_IN = EPOLLIN,
@@ -297,6 +343,15 @@ public:
         m_drop_req.push_back(res.m_fd);
     }
 
+    // Request to resume receiving data for a resource.
+    //
+    // A resource whose <resource::on_received> returned `false` need
+    // to call this from any thread to receive data again.
+    void request_resume(const resource& res) {
+        lock_guard g(m_lock);
+        m_resume_req.push_back(res.m_fd);
+    }
+
     bool has_garbage() const noexcept {
         return ! m_garbage.empty();
     }
@@ -315,11 +370,6 @@ public:
 
         logger::debug() << "reactor: collecting " << n << " resources.";
         m_garbage_copy.swap(m_garbage);
-
-        // eagerly close the file descriptors before gc() is called.
-        for( auto& res: m_garbage_copy )
-            res->try_close();
-
         return true;
     }
 
@@ -339,8 +389,10 @@ public:
     }
 
 private:
-    const int m_fd;
+    std::unique_ptr<uring> m_uring;
+    const int m_fd;  // epoll, or -1 with io_uring
     bool m_running;
+    std::uint32_t m_last_tag = 0;
     typedef std::unordered_map<int, std::unique_ptr<resource>> resource_map;
     resource_map m_resources;
     std::vector<int> m_readables;
@@ -351,6 +403,11 @@ private:
     typedef std::lock_guard<spinlock> lock_guard;
     std::vector<int> m_drop_req;
     std::vector<int> m_drop_req_copy;
+    std::vector<int> m_resume_req;
+    std::vector<int> m_resume_req_copy;
+
+    // resources that received data in the current loop (io_uring).
+    std::vector<int> m_received;
 
     // pending destruction lists
     std::vector<std::unique_ptr<resource>> m_garbage;
@@ -358,6 +415,11 @@ private:
 
     void remove_resource(int fd);
     void poll();
+    void poll_epoll(int timeout);
+    void poll_uring(int timeout);
+    void arm(resource& res);
+    void complete(const io_uring_cqe& cqe);
+    void complete_recv(resource* r, const io_uring_cqe& cqe);
 };
 
 } // namespace cybozu
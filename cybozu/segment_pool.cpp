@@ -0,0 +1,134 @@
+// (C) 2026 Cybozu.
+
+#include "segment_pool.hpp"
+#include "spinlock.hpp"
+
+#ifdef USE_TCMALLOC
+#  ifdef TCMALLOC_IN_GOOGLE
+#    include <google/tcmalloc.h>
+#  else
+#    include <gperftools/tcmalloc.h>
+#  endif
+#  define MALLOC tc_malloc
+#  define FREE tc_free
+#else
+#  include <cstdlib>
+#  define MALLOC std::malloc
+#  define FREE std::free
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace {
+
+const std::size_t CACHE_SIZE = 16;   // segments cached per thread
+const std::size_t FREE_LIMIT = 1024; // segments in the shared free list
+
+std::atomic<std::size_t> g_used(0);
+std::atomic<std::size_t> g_limit(cybozu::segment_pool::DEFAULT_LIMIT);
+std::atomic<std::uint64_t> g_exhausted(0);
+
+cybozu::spinlock g_free_lock;
+std::vector<char*> g_free;
+
+void put_free(char* p) noexcept {
+    {
+        std::lock_guard<cybozu::spinlock> g(g_free_lock);
+        if( g_free.size() < FREE_LIMIT ) {
+            try {
+                g_free.push_back(p);
+                return;
+            } catch( ... ) {
+                // fall through
+            }
+        }
+    }
+    FREE(p);
+}
+
+char* get_free() noexcept {
+    std::lock_guard<cybozu::spinlock> g(g_free_lock);
+    if( g_free.empty() )
+        return nullptr;
+    char* p = g_free.back();
+    g_free.pop_back();
+    return p;
+}
+
+struct segment_cache {
+    char* segments[CACHE_SIZE];
+    std::size_t count = 0;
+
+    ~segment_cache() {
+        for( std::size_t i = 0; i < count; ++i )
+            put_free(segments[i]);
+    }
+};
+
+thread_local segment_cache t_cache;
+
+} // anonymous namespace
+
+namespace cybozu {
+
+const std::size_t segment_pool::SEGMENT_SIZE;
+const std::size_t segment_pool::DEFAULT_LIMIT;
+
+void segment_pool::set_limit(std::size_t n) noexcept {
+    g_limit.store(n, std::memory_order_relaxed);
+}
+
+bool segment_pool::reserve(std::size_t n) noexcept {
+    if( n == 0 )
+        return true;
+    std::size_t limit = g_limit.load(std::memory_order_relaxed);
+    std::size_t used = g_used.load(std::memory_order_relaxed);
+    do {
+        if( used + n > limit ) {
+            g_exhausted.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    } while( ! g_used.compare_exchange_weak(used, used + n,
+                                            std::memory_order_relaxed) );
+    return true;
+}
+
+char* segment_pool::allocate() {
+    segment_cache& c = t_cache;
+    if( c.count > 0 )
+        return c.segments[--c.count];
+    char* p = get_free();
+    if( p != nullptr )
+        return p;
+    p = static_cast<char*>(MALLOC(SEGMENT_SIZE));
+    if( p == nullptr )
+        throw std::bad_alloc();
+    return p;
+}
+
+void segment_pool::release(char* p) noexcept {
+    g_used.fetch_sub(1, std::memory_order_relaxed);
+    segment_cache& c = t_cache;
+    if( c.count < CACHE_SIZE ) {
+        c.segments[c.count++] = p;
+        return;
+    }
+    put_free(p);
+}
+
+std::size_t segment_pool::used() noexcept {
+    return g_used.load(std::memory_order_relaxed);
+}
+
+std::size_t segment_pool::limit() noexcept {
+    return g_limit.load(std::memory_order_relaxed);
+}
+
+std::uint64_t segment_pool::exhausted() noexcept {
+    return g_exhausted.load(std::memory_order_relaxed);
+}
+
+} // namespace cybozu
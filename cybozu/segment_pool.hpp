@@ -0,0 +1,63 @@
+// A global pool of small memory segments.
+// (C) 2026 Cybozu.
+
+#ifndef CYBOZU_SEGMENT_POOL_HPP
+#define CYBOZU_SEGMENT_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cybozu {
+
+// A process-wide pool of fixed size memory segments.
+//
+// <tcp_socket> keeps data that cannot be sent immediately in chains
+// of these segments.  The number of segments in use is capped by
+// <set_limit>.  Callers first <reserve> the segments they need, which
+// fails rather than exceeding the cap, and then <allocate> them.
+//
+// Each thread caches a few released segments so that most allocations
+// do not touch the shared free list.  Free segments beyond the cache
+// and the shared list are returned to the system.
+class segment_pool {
+public:
+    // The size of a segment.
+    static const std::size_t SEGMENT_SIZE = 16 << 10;
+
+    // The default cap of segments in use (256 MiB).
+    static const std::size_t DEFAULT_LIMIT = 16384;
+
+    // Set the cap of segments in use.
+    // @n  The number of segments.
+    //
+    // Lowering the cap does not affect segments already in use.
+    static void set_limit(std::size_t n) noexcept;
+
+    // Reserve segments.
+    // @n  The number of segments.
+    //
+    // @return `true` if reserved, or `false` if the cap would be exceeded.
+    static bool reserve(std::size_t n) noexcept;
+
+    // Allocate one of the reserved segments.
+    //
+    // @return A segment of <SEGMENT_SIZE> bytes.
+    static char* allocate();
+
+    // Release a segment and its reservation.
+    // @p  A segment returned by <allocate>.
+    static void release(char* p) noexcept;
+
+    // Return the number of segments reserved or in use.
+    static std::size_t used() noexcept;
+
+    // Return the cap of segments in use.
+    static std::size_t limit() noexcept;
+
+    // Return the number of times <reserve> has failed.
+    static std::uint64_t exhausted() noexcept;
+};
+
+} // namespace cybozu
+
+#endif // CYBOZU_SEGMENT_POOL_HPP
@@ -0,0 +1,77 @@
+// A counter sharded over threads.
+// (C) 2026 Cybozu.
+
+#ifndef CYBOZU_SHARDED_COUNTER_HPP
+#define CYBOZU_SHARDED_COUNTER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace cybozu {
+
+// A counter sharded over threads.
+//
+// Frequent updates from many threads to a single atomic variable make
+// its cache line bounce between CPUs.  This counter gives each thread
+// its own shard, and folds a shard into the global total only when
+// the shard accumulates more than `batch` in either direction.
+//
+// <load> returns the global total, which may differ from the exact
+// value by up to `SHARDS * batch`.  <sum> adds up all shards.
+class sharded_counter {
+public:
+    static const std::size_t SHARDS = 64;
+
+    explicit sharded_counter(std::int64_t batch = 65536) noexcept:
+        m_batch(batch) {}
+    sharded_counter(const sharded_counter&) = delete;
+    sharded_counter& operator=(const sharded_counter&) = delete;
+
+    void add(std::int64_t n) noexcept {
+        std::atomic<std::int64_t>& s = m_shards[shard_index()].value;
+        std::int64_t v = s.fetch_add(n, std::memory_order_relaxed) + n;
+        if( v >= m_batch || v <= -m_batch ) {
+            s.fetch_sub(v, std::memory_order_relaxed);
+            m_total.fetch_add(v, std::memory_order_relaxed);
+        }
+    }
+
+    void sub(std::int64_t n) noexcept {
+        add(-n);
+    }
+
+    // Return the approximate value.
+    std::int64_t load() const noexcept {
+        return m_total.load(std::memory_order_relaxed);
+    }
+
+    // Return the value including not yet folded shards.
+    std::int64_t sum() const noexcept {
+        std::int64_t v = m_total.load(std::memory_order_relaxed);
+        for( auto& s: m_shards )
+            v += s.value.load(std::memory_order_relaxed);
+        return v;
+    }
+
+private:
+    struct alignas(CACHELINE_SIZE) shard {
+        std::atomic<std::int64_t> value{0};
+    };
+
+    static std::size_t shard_index() noexcept {
+        static std::atomic<std::size_t> next{0};
+        thread_local std::size_t index =
+            next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+        return index;
+    }
+
+    const std::int64_t m_batch;
+    alignas(CACHELINE_SIZE)
+    std::atomic<std::int64_t> m_total{0};
+    shard m_shards[SHARDS];
+};
+
+} // namespace cybozu
+
+#endif // CYBOZU_SHARDED_COUNTER_HPP
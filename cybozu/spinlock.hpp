@@ -11,13 +11,24 @@
 
 namespace cybozu {
 
+// Hint the CPU that the caller is spinning.
+inline void cpu_relax() noexcept {
+#if defined(__i386__) || defined(__x86_64__)
+# if defined(__SSE__)
+    _mm_pause();
+# else
+    __asm__ __volatile__ ("rep; nop");
+# endif
+#endif
+}
+
 // A simple spinlock.
 class spinlock {
 public:
     spinlock() {}
     void lock() {
         while( m_flag.test_and_set(std::memory_order_acquire) )
-            pause();
+            cpu_relax();
     }
     void unlock() {
         m_flag.clear(std::memory_order_release);
@@ -25,15 +36,6 @@ public:
 
 private:
     std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
-    void pause() {
-#if defined(__i386__) || defined(__x86_64__)
-# if defined(__SSE__)
-        _mm_pause();
-# else
-        __asm__ __volatile__ ("rep; nop");
-# endif
-#endif
-    }
 };
 
 } // namespace cybozu
@@ -18,8 +18,10 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <fcntl.h>
+#include <linux/errqueue.h>
 #include <netdb.h>
 #include <poll.h>
 #include <system_error>
@@ -31,6 +33,9 @@ const unsigned int MAX_BUFCNT = 65536;
 const int KEEPALIVE_IDLE = 300;   // 5 min before keep alive probe
 const int KEEPALIVE_INTERVAL = 5; // 5 seconds between keep alive probes
 
+std::atomic<std::uint64_t> g_zerocopy_sends(0);
+std::atomic<std::uint64_t> g_zerocopy_copied(0);
+
 } // anonymous namespace
 
 namespace cybozu {
@@ -105,9 +110,14 @@ int tcp_connect(const char* node, std::uint16_t port, unsigned int timeout) {
 }
 
 const std::size_t tcp_socket::SENDBUF_SIZE;
+const std::size_t tcp_socket::RECV_LIMIT;
+const std::size_t tcp_socket::BATCH_SIZE;
+const std::size_t tcp_socket::BATCH_COPY_LIMIT;
+const std::size_t tcp_socket::PENDING_SEGMENTS;
+const int tcp_socket::DRAIN_IOVCNT;
 
 tcp_socket::tcp_socket(int fd, unsigned int bufcnt):
-    resource(fd) {
+    resource(fd), m_pooled(bufcnt == 0), m_received(0) {
     if( bufcnt > MAX_BUFCNT )
         throw std::logic_error("tcp_socket: Too many buffers");
     m_free_buffers.reserve(bufcnt);
@@ -147,7 +157,11 @@ void tcp_socket::free_buffers() {
     for( auto& t: m_pending ) {
         char* p;
         std::tie(p, std::ignore, std::ignore) = t;
-        FREE(p);
+        if( m_pooled ) {
+            segment_pool::release(p);
+        } else {
+            FREE(p);
+        }
     }
     m_pending.clear();
     for( char* p: m_free_buffers ) {
@@ -159,11 +173,477 @@ void tcp_socket::free_buffers() {
     m_shutdown = true;
 }
 
-bool tcp_socket::_send(int fd, const char* p, std::size_t len, lock_guard& g) {
-    while( ! can_send(len) ) {
+void tcp_socket::enable_zerocopy(std::size_t threshold) {
+    if( threshold == 0 )
+        return;
+    with_fd([this, threshold](int fd) -> bool {
+        int v = 1;
+        if( setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v)) == -1 ) {
+            logger::debug() << "<tcp_socket::enable_zerocopy>: "
+                            << "SO_ZEROCOPY is not supported.";
+            return true;
+        }
+        m_zerocopy_threshold = threshold;
+        return true;
+    });
+}
+
+void tcp_socket::enable_send_queue(std::size_t limit) {
+    m_queue.reset(new mpsc_queue<queued_data>);
+    m_queue_limit = limit;
+}
+
+std::uint64_t tcp_socket::zerocopy_sends() noexcept {
+    return g_zerocopy_sends.load(std::memory_order_relaxed);
+}
+
+std::uint64_t tcp_socket::zerocopy_copied() noexcept {
+    return g_zerocopy_copied.load(std::memory_order_relaxed);
+}
+
+bool tcp_socket::sendv_(const iovec* iov, int iovcnt, dynbuf* owned,
+                        bool flush) {
+    if( iovcnt >= MAX_IOVCNT )
+        throw std::logic_error("<tcp_socket::sendv> too many iovec.");
+    if( m_queue )
+        return queue_sendv(iov, iovcnt, owned, flush, false);
+    if( m_batch != nullptr )
+        return batch_sendv(iov, iovcnt, flush, owned);
+    return with_fd([=](int fd) -> bool {
+        lock_guard g(m_lock);
+        if( ! _sendv(fd, iov, iovcnt, g, owned) )
+            return false;
+        if( flush && empty() )
+            _flush(fd);
+        return true;
+    });
+}
+
+void tcp_socket::begin_batch() {
+    // one buffer per thread is enough as a thread batches one socket
+    // at a time.
+    thread_local dynbuf batch(BATCH_SIZE);
+    batch.reset(); // may be left by an exception
+    m_batch = &batch;
+    m_batch_flush = false;
+}
+
+bool tcp_socket::end_batch() {
+    if( m_batch == nullptr )
+        return true;
+    dynbuf& batch = *m_batch;
+    m_batch = nullptr;
+    if( batch.empty() && ! m_batch_flush )
+        return true;
+
+    bool flush = m_batch_flush;
+    bool ret = with_fd([&batch, flush, this](int fd) -> bool {
+        lock_guard g(m_lock);
+        if( ! batch.empty() && ! _send(fd, batch.data(), batch.size(), g) )
+            return false;
+        if( flush && empty() )
+            _flush(fd);
+        return true;
+    });
+    batch.reset();
+    return ret;
+}
+
+bool tcp_socket::batch_sendv(const iovec* iov, int iovcnt, bool flush,
+                             dynbuf* owned) {
+    dynbuf& batch = *m_batch;
+    m_batch_flush = m_batch_flush || flush;
+
+    std::size_t total = 0;
+    for( int i = 0; i < iovcnt; ++i )
+        total += iov[i].len;
+    if( total <= BATCH_COPY_LIMIT && batch.size() + total <= BATCH_SIZE ) {
+        for( int i = 0; i < iovcnt; ++i )
+            batch.append(iov[i].p, iov[i].len);
+        return true;
+    }
+
+    // send the collected data and the new data at once.
+    bool ret = with_fd([&batch, iov, iovcnt, owned, this](int fd) -> bool {
+        lock_guard g(m_lock);
+        if( iovcnt + 1 < MAX_IOVCNT ) {
+            iovec v[MAX_IOVCNT];
+            v[0] = {batch.data(), batch.size()};
+            std::copy(iov, iov + iovcnt, v + 1);
+            if( ! _sendv(fd, v, iovcnt + 1, g, owned) )
+                return false;
+        } else {
+            if( ! _send(fd, batch.data(), batch.size(), g) )
+                return false;
+            if( ! _sendv(fd, iov, iovcnt, g, owned) )
+                return false;
+        }
+        if( m_batch_flush && empty() ) {
+            _flush(fd);
+            m_batch_flush = false;
+        }
+        return true;
+    });
+    batch.reset();
+    return ret;
+}
+
+bool tcp_socket::queue_sendv(const iovec* iov, int iovcnt, dynbuf* owned,
+                             bool flush, bool close) {
+    if( iovcnt >= MAX_IOVCNT )
+        throw std::logic_error("<tcp_socket::sendv> too many iovec.");
+    return with_fd([=](int fd) -> bool {
+        unsigned int expected = 0;
+        if( ! m_drain_requests.compare_exchange_strong(
+                expected, 1, std::memory_order_acquire) ) {
+            // another thread is writing out the queue.
+            queue_push(iov, iovcnt, owned, flush, close);
+            if( m_drain_requests.fetch_add(1, std::memory_order_acq_rel) != 0 )
+                return true;
+            return drain_queue(fd);
+        }
+
+        bool zerocopy = owned != nullptr && m_zerocopy_threshold != 0 &&
+            owned->size() >= m_zerocopy_threshold;
+        if( zerocopy || ! m_sending.empty() ||
+            m_spill_read != m_spill_write || m_queue->front() != nullptr ) {
+            queue_push(iov, iovcnt, owned, flush, close);
+            return drain_queue(fd);
+        }
+
+        // nothing is queued; send data directly.
+        ::iovec v[MAX_IOVCNT];
+        int v_size = 0;
+        for( int i = 0; i < iovcnt; ++i ) {
+            if( iov[i].len == 0 )
+                continue;
+            v[v_size].iov_base = const_cast<char*>(iov[i].p);
+            v[v_size].iov_len = iov[i].len;
+            ++v_size;
+        }
+        int ind = 0;
+        while( ind < v_size ) {
+            ssize_t n = ::writev(fd, &(v[ind]), v_size - ind);
+            if( n == -1 ) {
+                if( errno == EAGAIN || errno == EWOULDBLOCK ) break;
+                if( errno == EINTR ) continue;
+                auto ecnd = std::system_category().default_error_condition(errno);
+                if( ecnd.value() != EPIPE )
+                    logger::error() << "<tcp_socket::queue_sendv>: ("
+                                    << ecnd.value() << ") "
+                                    << ecnd.message();
+                return false;
+            }
+            while( n > 0 ) {
+                if( static_cast<std::size_t>(n) < v[ind].iov_len ) {
+                    v[ind].iov_base = ((char*)v[ind].iov_base) + n;
+                    v[ind].iov_len = v[ind].iov_len - n;
+                    break;
+                }
+                n -= v[ind].iov_len;
+                ++ind;
+            }
+        }
+
+        // keep the rest ahead of data queued meanwhile.
+        queued_data d;
+        for( int i = ind; i < v_size; ++i )
+            d.data.append(static_cast<const char*>(v[i].iov_base),
+                          v[i].iov_len);
+        d.flush = flush;
+        d.close = close;
+        m_queued_bytes.fetch_add(d.size(), std::memory_order_relaxed);
+        m_sending.push_back(std::move(d));
+        return drain_queue(fd);
+    });
+}
+
+void tcp_socket::queue_push(const iovec* iov, int iovcnt, dynbuf* owned,
+                            bool flush, bool close) {
+    queued_data d;
+    for( int i = 0; i < iovcnt; ++i ) {
+        if( owned != nullptr && iov[i].len > 0 &&
+            iov[i].p == owned->data() && iov[i].len == owned->size() ) {
+            d.owned_pos = d.data.size();
+            d.owned.swap(*owned);
+            owned = nullptr;
+            continue;
+        }
+        d.data.append(iov[i].p, iov[i].len);
+    }
+    d.flush = flush;
+    d.close = close;
+
+    // count before the data can be sent and subtracted.
+    std::size_t len = d.size();
+    std::size_t total =
+        m_queued_bytes.fetch_add(len, std::memory_order_relaxed) + len;
+    m_queue->push(std::move(d));
+    if( total > m_queue_limit &&
+        ! m_queue_full.exchange(true, std::memory_order_relaxed) )
+        on_buffer_full();
+}
+
+bool tcp_socket::drain_queue(int fd) {
+    while( true ) {
+        unsigned int n = m_drain_requests.load(std::memory_order_acquire);
+        // on errors, this thread keeps the right to write the queue
+        // as the socket is going to be invalidated.
+        if( ! write_queue(fd) )
+            return false;
+        if( m_drain_requests.compare_exchange_strong(
+                n, 0, std::memory_order_acq_rel) )
+            return true;
+    }
+}
+
+bool tcp_socket::write_queue(int fd) {
+    while( true ) {
+        if( m_sending.empty() && m_spill_read != m_spill_write ) {
+            if( ! load_spill() )
+                return false;
+        }
+        // queued data follow the data in the spill file.
+        if( m_spill_read == m_spill_write ) {
+            for( queued_data* d = m_queue->front();
+                 d != nullptr &&
+                     m_sending.size() < static_cast<std::size_t>(DRAIN_IOVCNT);
+                 d = m_queue->front() ) {
+                m_sending.push_back(std::move(*d));
+                m_queue->pop();
+            }
+        }
+        if( m_sending.empty() )
+            break;
+
+        // gather data up to a buffer to be sent with MSG_ZEROCOPY,
+        // which is sent alone.
+        ::iovec v[DRAIN_IOVCNT];
+        int v_size = 0;
+        bool zc = false;  // v[0] is to be sent with MSG_ZEROCOPY
+        bool stop = false;
+        for( auto& d: m_sending ) {
+            if( stop || v_size + 3 > DRAIN_IOVCNT )
+                break;
+            const char* p = d.data.data();
+            std::size_t pos = d.owned_pos;
+            ::iovec parts[3] = {
+                {const_cast<char*>(p), pos},
+                {const_cast<char*>(d.owned.data()), d.owned.size()},
+                {const_cast<char*>(p + pos), d.data.size() - pos},
+            };
+            bool d_zc = m_zerocopy_threshold != 0 &&
+                d.owned.size() >= m_zerocopy_threshold;
+            std::size_t skip = d.sent;
+            for( int i = 0; i < 3; ++i ) {
+                if( skip >= parts[i].iov_len ) {
+                    skip -= parts[i].iov_len;
+                    continue;
+                }
+                bool to_zc = (i == 1) && d_zc;
+                if( to_zc && v_size > 0 ) {
+                    stop = true;
+                    break;
+                }
+                v[v_size].iov_base = ((char*)parts[i].iov_base) + skip;
+                v[v_size].iov_len = parts[i].iov_len - skip;
+                ++v_size;
+                skip = 0;
+                if( to_zc ) {
+                    zc = true;
+                    stop = true;
+                    break;
+                }
+            }
+        }
+
+        ssize_t n;
+        bool zc_sent = false;
+        if( zc ) {
+            n = send_zerocopy(fd, v[0], zc_sent);
+        } else {
+            n = ::writev(fd, v, v_size);
+        }
+        if( n == -1 ) {
+            if( errno == EINTR ) continue;
+            if( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                // flush when the rest has been sent.
+                m_queue_flush = true;
+                return spill_queue();
+            }
+            auto ecnd = std::system_category().default_error_condition(errno);
+            if( ecnd.value() != EPIPE )
+                logger::error() << "<tcp_socket::write_queue>: ("
+                                << ecnd.value() << ") "
+                                << ecnd.message();
+            return false;
+        }
+        if( zc_sent )
+            m_sending.front().zerocopy = true;
+
+        std::size_t left = n;
+        while( ! m_sending.empty() ) {
+            queued_data& d = m_sending.front();
+            std::size_t size = d.size();
+            if( left < size - d.sent ) {
+                d.sent += left;
+                break;
+            }
+            left -= size - d.sent;
+            if( d.zerocopy ) {
+                // keep the buffer until the kernel is done with it.
+                lock_guard g(m_lock);
+                m_zerocopy_buffers.emplace_back(m_zerocopy_id - 1, dynbuf(0));
+                m_zerocopy_buffers.back().second.swap(d.owned);
+            }
+            m_queued_bytes.fetch_sub(size, std::memory_order_relaxed);
+            m_queue_flush = m_queue_flush || d.flush;
+            bool close = d.close;
+            m_sending.pop_front();
+            if( close ) {
+                _flush(fd);
+                return false;
+            }
+        }
+    }
+
+    if( m_queue_flush ) {
+        _flush(fd);
+        m_queue_flush = false;
+    }
+    m_queue_full.store(false, std::memory_order_relaxed);
+    return true;
+}
+
+bool tcp_socket::spill_queue() {
+    if( m_queued_bytes.load(std::memory_order_relaxed) <= m_queue_limit )
+        return true;
+    if( m_spill_fd == -1 ) {
+        m_spill_fd = create_spill_file();
+        if( m_spill_fd == -1 )
+            return true;
+    }
+
+    // data to close the socket are left in the queue.
+    for( queued_data* d = m_queue->front(); d != nullptr && ! d->close;
+         d = m_queue->front() ) {
+        const char* p = d->data.data();
+        std::size_t pos = d->owned_pos;
+        const ::iovec parts[3] = {
+            {const_cast<char*>(p), pos},
+            {const_cast<char*>(d->owned.data()), d->owned.size()},
+            {const_cast<char*>(p + pos), d->data.size() - pos},
+        };
+        std::size_t len = d->size();
+        std::size_t written = 0;
+        while( written < len ) {
+            ::iovec v[3];
+            int v_size = 0;
+            std::size_t skip = written;
+            for( const ::iovec& part: parts ) {
+                if( skip >= part.iov_len ) {
+                    skip -= part.iov_len;
+                    continue;
+                }
+                v[v_size].iov_base = ((char*)part.iov_base) + skip;
+                v[v_size].iov_len = part.iov_len - skip;
+                ++v_size;
+                skip = 0;
+            }
+            ssize_t n = ::pwritev(m_spill_fd, v, v_size,
+                                  m_spill_write + written);
+            if( n == -1 ) {
+                if( errno == EINTR ) continue;
+                auto ecnd = std::system_category().default_error_condition(errno);
+                logger::error() << "<tcp_socket::spill_queue>: ("
+                                << ecnd.value() << ") "
+                                << ecnd.message();
+                return false;
+            }
+            written += n;
+        }
+        m_spill_write += len;
+        m_spilled_bytes.fetch_add(len, std::memory_order_relaxed);
+        m_queued_bytes.fetch_sub(len, std::memory_order_relaxed);
+        m_queue_flush = m_queue_flush || d->flush;
+        m_queue->pop();
+    }
+    return true;
+}
+
+bool tcp_socket::load_spill() {
+    std::size_t len = static_cast<std::size_t>(
+        std::min<std::uint64_t>(m_spill_write - m_spill_read, SENDBUF_SIZE));
+    queued_data d;
+    char* p = d.data.prepare(len);
+    std::size_t done = 0;
+    while( done < len ) {
+        ssize_t n = ::pread(m_spill_fd, p + done, len - done,
+                            m_spill_read + done);
+        if( n == -1 ) {
+            if( errno == EINTR ) continue;
+            auto ecnd = std::system_category().default_error_condition(errno);
+            logger::error() << "<tcp_socket::load_spill>: ("
+                            << ecnd.value() << ") "
+                            << ecnd.message();
+            return false;
+        }
+        if( n == 0 ) {
+            logger::error() << "<tcp_socket::load_spill>: unexpected EOF.";
+            return false;
+        }
+        done += n;
+    }
+    d.data.consume(len);
+    m_spill_read += len;
+    m_queued_bytes.fetch_add(len, std::memory_order_relaxed);
+    m_spilled_bytes.fetch_sub(len, std::memory_order_relaxed);
+
+    if( m_spill_read == m_spill_write ) {
+        // reuse the file from the beginning.
+        m_spill_read = 0;
+        m_spill_write = 0;
+        if( ::ftruncate(m_spill_fd, 0) == -1 ) {
+            auto ecnd = std::system_category().default_error_condition(errno);
+            logger::error() << "<tcp_socket::load_spill>: ("
+                            << ecnd.value() << ") "
+                            << ecnd.message();
+            return false;
+        }
+    }
+    m_sending.push_back(std::move(d));
+    return true;
+}
+
+bool tcp_socket::reserve(std::size_t len) {
+    if( ! m_pooled )
+        return capacity() >= len;
+    std::size_t r = room();
+    if( len <= r )
+        return true;
+    const std::size_t size = segment_pool::SEGMENT_SIZE;
+    return segment_pool::reserve((len - r + size - 1) / size);
+}
+
+bool tcp_socket::wait_room(std::size_t len, lock_guard& g) {
+    while( true ) {
+        while( ! can_send(len) ) {
+            on_buffer_full();
+            m_cond_write.wait(g);
+        }
+        if( m_shutdown || m_pending.empty() )
+            return false;
+        if( reserve(len) )
+            return true;
+
+        // the pool is exhausted; wait for pending data to be sent.
         on_buffer_full();
         m_cond_write.wait(g);
     }
+}
+
+bool tcp_socket::_send(int fd, const char* p, std::size_t len, lock_guard& g) {
+    bool reserved = wait_room(len, g);
     if( m_shutdown ) return false;
 
     if( m_pending.empty() ) {
@@ -186,7 +666,7 @@ bool tcp_socket::_send(int fd, const char* p, std::size_t len, lock_guard& g) {
     }
 
     // put data in the pending request queue.
-    if( capacity() < len ) {
+    if( ! reserved && ! reserve(len) ) {
         // here, m_pending.empty() and m_tmpbuf.empty() holds true.
         logger::debug() << "<tcp_socket::_send> buffering "
                         << len << " bytes data.";
@@ -200,7 +680,7 @@ bool tcp_socket::_send(int fd, const char* p, std::size_t len, lock_guard& g) {
         char* t_p;
         std::size_t t_len;
         std::tie(t_p, t_len, std::ignore) = t;
-        std::size_t room = SENDBUF_SIZE - t_len;
+        std::size_t room = buffer_size() - t_len;
         if( room > 0 ) {
             std::size_t to_write = std::min(room, len);
             std::memcpy(t_p + t_len, p, to_write);
@@ -212,9 +692,8 @@ bool tcp_socket::_send(int fd, const char* p, std::size_t len, lock_guard& g) {
     }
 
     while( len > 0 ) {
-        char* t_p = m_free_buffers.back();
-        m_free_buffers.pop_back();
-        std::size_t to_write = std::min(len, SENDBUF_SIZE);
+        char* t_p = take_buffer();
+        std::size_t to_write = std::min(len, buffer_size());
         std::memcpy(t_p, p, to_write);
         p += to_write;
         len -= to_write;
@@ -223,16 +702,28 @@ bool tcp_socket::_send(int fd, const char* p, std::size_t len, lock_guard& g) {
     return true;
 }
 
-bool tcp_socket::_sendv(int fd, const iovec* iov, const int iovcnt, lock_guard& g) {
+ssize_t tcp_socket::send_zerocopy(int fd, const ::iovec& v, bool& sent) {
+    ssize_t n = ::send(fd, v.iov_base, v.iov_len, MSG_ZEROCOPY);
+    if( n == -1 && errno == ENOBUFS ) {
+        // too many sends are waiting for completion.
+        return ::send(fd, v.iov_base, v.iov_len, 0);
+    }
+    if( n > 0 ) {
+        ++m_zerocopy_id;
+        sent = true;
+        g_zerocopy_sends.fetch_add(1, std::memory_order_relaxed);
+    }
+    return n;
+}
+
+bool tcp_socket::_sendv(int fd, const iovec* iov, const int iovcnt,
+                        lock_guard& g, dynbuf* owned) {
     std::size_t total = 0;
     for( int i = 0; i < iovcnt; ++i ) {
         total += iov[i].len;
     }
 
-    while( ! can_send(total) ) {
-        on_buffer_full();
-        m_cond_write.wait(g);
-    }
+    bool reserved = wait_room(total, g);
     if( m_shutdown ) return false;
 
     ::iovec v[MAX_IOVCNT];
@@ -246,9 +737,26 @@ bool tcp_socket::_sendv(int fd, const iovec* iov, const int iovcnt, lock_guard&
     }
     int ind = 0;
 
+    // v[zc_ind] is sent separately with MSG_ZEROCOPY.
+    int zc_ind = -1;
+    bool zc_sent = false;
+    if( owned != nullptr && m_zerocopy_threshold != 0 &&
+        owned->size() >= m_zerocopy_threshold ) {
+        for( int i = 0; i < v_size; ++i ) {
+            if( v[i].iov_base == owned->data() )
+                zc_ind = i;
+        }
+    }
+
     if( m_pending.empty() ) {
         while( ind < v_size ) {
-            ssize_t n = ::writev(fd, &(v[ind]), v_size - ind);
+            ssize_t n;
+            if( ind == zc_ind ) {
+                n = send_zerocopy(fd, v[ind], zc_sent);
+            } else {
+                int end = (ind < zc_ind) ? zc_ind : v_size;
+                n = ::writev(fd, &(v[ind]), end - ind);
+            }
             if( n == -1 ) {
                 if( errno == EAGAIN || errno == EWOULDBLOCK ) break;
                 if( errno == EINTR ) continue;
@@ -269,6 +777,11 @@ bool tcp_socket::_sendv(int fd, const iovec* iov, const int iovcnt, lock_guard&
                 ++ind;
             }
         }
+        if( zc_sent ) {
+            // keep the buffer until the kernel is done with it.
+            m_zerocopy_buffers.emplace_back(m_zerocopy_id - 1, dynbuf(0));
+            m_zerocopy_buffers.back().second.swap(*owned);
+        }
         if( ind == v_size ) return true;
     }
 
@@ -279,7 +792,7 @@ bool tcp_socket::_sendv(int fd, const iovec* iov, const int iovcnt, lock_guard&
     }
 
     // put data in the pending request queue.
-    if( capacity() < total ) {
+    if( ! reserved && ! reserve(total) ) {
         // here, m_pending.empty() and m_tmpbuf.empty() holds true.
         logger::debug() << "<tcp_socket::_sendv> buffering "
                         << total << " bytes data.";
@@ -295,15 +808,14 @@ bool tcp_socket::_sendv(int fd, const iovec* iov, const int iovcnt, lock_guard&
     while( ind < v_size ) {
         char* t_p;
         std::size_t t_len;
-        if(m_pending.empty() || std::get<1>(m_pending.back()) == SENDBUF_SIZE) {
-            t_p = m_free_buffers.back();
+        if( m_pending.empty() || room() == 0 ) {
+            t_p = take_buffer();
             t_len = 0;
-            m_free_buffers.pop_back();
             m_pending.emplace_back(t_p, t_len, 0);
         } else {
             std::tie(t_p, t_len, std::ignore) = m_pending.back();
         }
-        std::size_t room = SENDBUF_SIZE - t_len;
+        std::size_t room = buffer_size() - t_len;
         while( room > 0 ) {
             std::size_t to_write = std::min(room, v[ind].iov_len);
             std::memcpy(t_p + t_len, v[ind].iov_base, to_write);
@@ -323,6 +835,13 @@ bool tcp_socket::_sendv(int fd, const iovec* iov, const int iovcnt, lock_guard&
 }
 
 bool tcp_socket::write_pending_data(int fd) {
+    if( m_queue ) {
+        // the thread writing out the queue will see this request.
+        if( m_drain_requests.fetch_add(1, std::memory_order_acq_rel) != 0 )
+            return true;
+        return drain_queue(fd);
+    }
+
     lock_guard g(m_lock);
 
     while( ! m_tmpbuf.empty() ) {
@@ -363,7 +882,7 @@ bool tcp_socket::write_pending_data(int fd) {
         }
         if( len == sent ) {
             m_pending.erase(m_pending.begin());
-            m_free_buffers.push_back(p);
+            put_buffer(p);
         } else {
             std::get<2>(t) = sent;
             g.unlock();
@@ -386,8 +905,108 @@ bool tcp_socket::write_pending_data(int fd) {
     return false;
 }
 
+bool tcp_socket::on_error(int fd) {
+    if( m_zerocopy_threshold == 0 || ! reap_zerocopy(fd) )
+        return invalidate();
+    return true;
+}
+
+bool tcp_socket::reap_zerocopy(int fd) {
+    while( true ) {
+        char control[128];
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = ::recvmsg(fd, &msg, MSG_ERRQUEUE);
+        if( n == -1 ) {
+            if( errno == EINTR ) continue;
+            if( errno == EAGAIN || errno == EWOULDBLOCK ) break;
+            return false;
+        }
+
+        for( struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr;
+             cm = CMSG_NXTHDR(&msg, cm) ) {
+            if( ! (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                ! (cm->cmsg_level == SOL_IPV6 &&
+                   cm->cmsg_type == IPV6_RECVERR) )
+                continue;
+            struct sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if( err.ee_origin != SO_EE_ORIGIN_ZEROCOPY )
+                return false;
+
+            // IDs from ee_info to ee_data have been completed.
+            if( err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED )
+                g_zerocopy_copied.fetch_add(err.ee_data - err.ee_info + 1,
+                                            std::memory_order_relaxed);
+            lock_guard g(m_lock);
+            while( ! m_zerocopy_buffers.empty() &&
+                   static_cast<std::int32_t>(
+                       m_zerocopy_buffers.front().first - err.ee_data) <= 0 )
+                m_zerocopy_buffers.pop_front();
+        }
+    }
+
+    // other errors are reported by SO_ERROR.
+    int e = 0;
+    socklen_t l = sizeof(e);
+    if( getsockopt(fd, SOL_SOCKET, SO_ERROR, &e, &l) == -1 )
+        return false;
+    return e == 0;
+}
+
+bool tcp_socket::on_received(const char* p, ::ssize_t len) {
+    std::lock_guard<spinlock> g(m_recv_lock);
+    if( len <= 0 ) {
+        m_recv_status = static_cast<int>(len);
+        return true;
+    }
+    m_received.append(p, static_cast<std::size_t>(len));
+    if( m_received.size() < RECV_LIMIT )
+        return true;
+    // stop receiving until <take_received> drains the data.
+    m_recv_paused = true;
+    return false;
+}
+
+tcp_socket::recv_result tcp_socket::take_received(dynbuf& buf) {
+    if( ! valid() )
+        return recv_result::RESET;
+
+    std::size_t n;
+    int status;
+    bool resume = false;
+    {
+        std::lock_guard<spinlock> g(m_recv_lock);
+        n = m_received.size();
+        status = m_recv_status;
+        if( n > 0 ) {
+            buf.append(m_received.data(), n);
+            m_received.reset();
+            resume = m_recv_paused;
+            m_recv_paused = false;
+        }
+    }
+    if( resume )
+        m_reactor->request_resume(*this);
+
+    if( n > 0 )
+        return recv_result::OK;
+    if( status > 0 )
+        return recv_result::AGAIN;
+    if( status == 0 )
+        return recv_result::NONE;
+    if( status == -ECONNRESET ) {
+        invalidate_and_close();
+        return recv_result::RESET;
+    }
+    throw_unix_error(-status, "recv");
+}
+
 int
-setup_server_socket(const char* bind_addr, std::uint16_t port, bool freebind) {
+setup_server_socket(const char* bind_addr, std::uint16_t port,
+                    bool freebind, bool reuseport) {
     struct addrinfo hint, *res;
     std::string s_port = std::to_string(port);
     std::memset(&hint, 0, sizeof(hint));
@@ -434,6 +1053,14 @@ setup_server_socket(const char* bind_addr, std::uint16_t port, bool freebind) {
         }
     }
 
+    if( reuseport ) {
+        if( setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &ok, sizeof(ok)) == -1 ) {
+            ::close(s);
+            freeaddrinfo(res);
+            throw_unix_error(errno, "setsockopt(SO_REUSEPORT)");
+        }
+    }
+
     if( bind(s, res->ai_addr, res->ai_addrlen) == -1 ) {
         ::close(s);
         freeaddrinfo(res);
@@ -488,21 +1115,40 @@ bool tcp_server_socket::on_readable(int fd) {
             throw_unix_error(errno, "accept");
         }
 
-        try {
-            std::unique_ptr<tcp_socket> t = m_wrapper(s, ip_address(&(addr.sa)));
-            if( t.get() == nullptr ) {
-                ::close(s);
-            } else {
-                m_reactor->add_resource( std::move(t),
-                                         reactor::EVENT_IN|reactor::EVENT_OUT );
-            }
+        add_connection(s, &(addr.sa));
+    }
+    return true;
+}
 
-        } catch( ... ) {
+bool tcp_server_socket::on_accept(int s) {
+    union {
+        struct sockaddr sa;
+        struct sockaddr_storage ss;
+    } addr;
+    socklen_t addrlen = sizeof(addr);
+    if( ::getpeername(s, &(addr.sa), &addrlen) == -1 ) {
+        // the peer has already gone.
+        ::close(s);
+        return true;
+    }
+    add_connection(s, &(addr.sa));
+    return true;
+}
+
+void tcp_server_socket::add_connection(int s, const struct sockaddr* addr) {
+    try {
+        std::unique_ptr<tcp_socket> t = m_wrapper(s, ip_address(addr));
+        if( t.get() == nullptr ) {
             ::close(s);
-            throw;
+        } else {
+            m_reactor->add_resource( std::move(t),
+                                     reactor::EVENT_IN|reactor::EVENT_OUT );
         }
+
+    } catch( ... ) {
+        ::close(s);
+        throw;
     }
-    return true;
 }
 
 } // namespace cybozu
@@ -6,13 +6,18 @@
 
 #include "dynbuf.hpp"
 #include "ip_address.hpp"
+#include "mpsc_queue.hpp"
 #include "reactor.hpp"
+#include "segment_pool.hpp"
+#include "spinlock.hpp"
 #include "util.hpp"
 
+#include <atomic>
 #include <cerrno>
 #include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -24,6 +29,7 @@
 #include <sys/types.h>
 #include <tuple>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
 namespace cybozu {
@@ -55,6 +61,11 @@ int tcp_connect(const char* node, std::uint16_t port, unsigned int timeout=10);
 // Derived classes still need to implement <resource::on_readable>.
 class tcp_socket: public resource {
     static const std::size_t  SENDBUF_SIZE = 1 << 20;
+    static const std::size_t  RECV_LIMIT = 1 << 20;
+    static const std::size_t  BATCH_SIZE = 64 << 10;
+    static const std::size_t  BATCH_COPY_LIMIT = 4 << 10;
+    static const std::size_t  PENDING_SEGMENTS = 16;
+    static const int          DRAIN_IOVCNT = 64;
 
 public:
     // Construct an already connected socket.
@@ -63,9 +74,17 @@ public:
     //
     // Construct a socket resource with a connected socket file descriptor.
     // The socket should already be set non-blocking.
+    //
+    // If `bufcnt` is 0, pending send data are kept in segments taken
+    // from <segment_pool>.  Senders are blocked while the socket has
+    // <PENDING_SEGMENTS> or more segments pending.  If the pool is
+    // exhausted, data are kept in a private buffer and senders are
+    // blocked until it is sent.
     explicit tcp_socket(int fd, unsigned int bufcnt = 0);
     virtual ~tcp_socket() {
         free_buffers();
+        if( m_spill_fd != -1 )
+            ::close(m_spill_fd);
     }
 
     // The maximum size of <iovec> array for <sendv>.
@@ -87,6 +106,14 @@ public:
     //
     // @return `true` if this socket is valid, `false` otherwise.
     bool send(const char* p, std::size_t len, bool flush=false) {
+        if( m_queue ) {
+            iovec iov = {p, len};
+            return queue_sendv(&iov, 1, nullptr, flush, false);
+        }
+        if( m_batch != nullptr ) {
+            iovec iov = {p, len};
+            return batch_sendv(&iov, 1, flush, nullptr);
+        }
         return with_fd([=](int fd) -> bool {
             lock_guard g(m_lock);
             if( ! _send(fd, p, len, g) )
@@ -107,16 +134,25 @@ public:
     //
     // @return `true` if this socket is valid, `false` otherwise.
     bool sendv(const iovec* iov, int iovcnt, bool flush=false) {
-        return with_fd([=](int fd) -> bool {
-            if( iovcnt >= MAX_IOVCNT )
-                throw std::logic_error("<tcp_socket::sendv> too many iovec.");
-            lock_guard g(m_lock);
-            if( ! _sendv(fd, iov, iovcnt, g) )
-                return false;
-            if( flush && empty() )
-                _flush(fd);
-            return true;
-        });
+        return sendv_(iov, iovcnt, nullptr, flush);
+    }
+
+    // Atomically send multiple data, one of which may be taken over.
+    // @iov     Array of <iovec>.
+    // @iovcnt  Number of elements in `iov`.
+    // @data    A buffer whose contents are one of `iov`.
+    // @flush   If `true`, the kernel send buffer will be flushed.
+    //
+    // This works as <sendv>.  In addition, if <enable_zerocopy> has
+    // been called and `data` is large enough, the contents of `data`
+    // are sent without being copied by the kernel.  In that case, the
+    // socket takes over the internal buffer of `data`, and `data`
+    // becomes empty.  With <enable_send_queue>, the buffer is also
+    // taken over when data are queued.
+    //
+    // @return `true` if this socket is valid, `false` otherwise.
+    bool sendv(const iovec* iov, int iovcnt, dynbuf& data, bool flush=false) {
+        return sendv_(iov, iovcnt, &data, flush);
     }
 
     // Atomically send data, then close the socket.
@@ -129,6 +165,11 @@ public:
     //
     // @return `true` if this socket is valid, `false` otherwise.
     bool send_close(const char* p, std::size_t len) {
+        end_batch();
+        if( m_queue ) {
+            iovec iov = {p, len};
+            return queue_sendv(&iov, 1, nullptr, false, true);
+        }
         return with_fd([=](int fd) -> bool {
             lock_guard g(m_lock);
             if( ! _send(fd, p, len, g) )
@@ -154,6 +195,9 @@ public:
     //
     // @return `true` if this socket is valid, `false` otherwise.
     bool sendv_close(const iovec* iov, int iovcnt) {
+        end_batch();
+        if( m_queue )
+            return queue_sendv(iov, iovcnt, nullptr, false, true);
         return with_fd([=](int fd) -> bool {
             if( iovcnt >= MAX_IOVCNT )
                 throw std::logic_error("<tcp_socket::sendv> too many iov.");
@@ -171,6 +215,68 @@ public:
         });
     }
 
+    // Enable zero-copy sends of large data.
+    // @threshold  The minimum size of data to be sent without copying.
+    //
+    // Data passed to <sendv> with a buffer to be taken over are sent
+    // with `MSG_ZEROCOPY` if the buffer is at least `threshold` bytes.
+    // Such buffers are kept until the kernel reports completion through
+    // the error queue of the socket, which is read by <on_error>.
+    // This does nothing if the kernel does not support `SO_ZEROCOPY`.
+    //
+    // Call this before adding the socket to a reactor.
+    void enable_zerocopy(std::size_t threshold);
+
+    // Let multiple threads send data without locking.
+    // @limit  Bytes of queued data to be kept in memory.
+    //
+    // Data sent to this socket are put in a lock-free queue unless
+    // they can be sent immediately.  Only one thread at a time, either
+    // a sender or the thread running <write_pending_data>, writes out
+    // the queue while the others return at once.  Senders are never
+    // blocked; <on_buffer_full> is called instead when more than
+    // `limit` bytes are queued.  Pending data are not kept in the
+    // buffers given to the constructor.
+    //
+    // When the socket would block with more than `limit` bytes queued,
+    // the queued data are moved to the file returned by
+    // <create_spill_file>, and are sent from there in order.
+    //
+    // Call this before adding the socket to a reactor.
+    void enable_send_queue(std::size_t limit);
+
+    // Return the number of bytes waiting in the queue of
+    // <enable_send_queue>, including those moved to the file.
+    std::size_t queued_bytes() const noexcept {
+        return m_queued_bytes.load(std::memory_order_relaxed) +
+            m_spilled_bytes.load(std::memory_order_relaxed);
+    }
+
+    // Return the number of sends with `MSG_ZEROCOPY`.
+    static std::uint64_t zerocopy_sends() noexcept;
+
+    // Return the number of sends with `MSG_ZEROCOPY` for which
+    // the kernel has copied data after all.
+    static std::uint64_t zerocopy_copied() noexcept;
+
+    // Start batching data sent by the calling thread.
+    //
+    // Until <end_batch> is called, small data passed to <send> and
+    // <sendv> are collected in a buffer of the calling thread.  Large
+    // data are sent together with the collected data by one system
+    // call.  Only the calling thread may send data to this socket
+    // while batching.  Sockets with <enable_send_queue> do not batch.
+    void begin_batch();
+
+    // Send the collected data by one system call and stop batching.
+    //
+    // The kernel send buffer is flushed once if any of the data were
+    // sent with `flush`.  Call this before invalidating the socket
+    // to send replies prior to that.
+    //
+    // @return `true` if this socket is valid, `false` otherwise.
+    bool end_batch();
+
     enum class recv_result {
         OK,    // Received some data.
         AGAIN, // No data was available.
@@ -185,8 +291,14 @@ public:
     // This function receives data from the socket.  Since this uses `with_fd`
     // internally, the reactor thread should not call this.
     //
+    // If the reactor receives data for this socket (`io_mode::RECV`),
+    // this takes all data received so far without a system call.
+    //
     // @return The result of the operation.
     recv_result receive(dynbuf& buf, const std::size_t max_recvsize) {
+        if( mode() == io_mode::RECV )
+            return take_received(buf);
+
         char* p = buf.prepare(max_recvsize);
         ::ssize_t n;
         auto ret = with_fd([=, &n](int fd) -> bool {
@@ -233,41 +345,142 @@ protected:
         return invalidate();
     }
 
+    // Read completion of zero-copy sends from the error queue.
+    //
+    // The socket is invalidated if a real error happened.
+    virtual bool on_error(int fd) override;
+
     virtual void on_invalidate(int fd) override {
         ::shutdown(fd, SHUT_RDWR);
         free_buffers();
         m_cond_write.notify_all();
     }
 
+    // Keep data received by the reactor for <receive>.
+    //
+    // Subclasses that call <receive> can override <preferred_mode>
+    // to return `io_mode::RECV` to use this.
+    virtual bool on_received(const char* p, ::ssize_t len) override final;
+
     // This method will be called everytime when <send>, <sendv>,
     // <send_close>, or <sendv_close> is blocked because of internal buffer full.
+    // With <enable_send_queue>, this is called without blocking when
+    // the queue exceeds the limit, and not again until the queue has
+    // been written out.  This may be called by any sending thread.
     //
     // Subclasses can override this to handle the buffer full event.
     virtual void on_buffer_full() {}
 
+    // Create a file to keep data beyond the limit of <enable_send_queue>.
+    //
+    // Subclasses can override this to return a file descriptor of a
+    // temporary file.  The socket owns and closes the file.  If this
+    // returns -1, data are kept in memory.  This must not throw.
+    virtual int create_spill_file() {
+        return -1;
+    }
+
 private:
     std::vector<char*> m_free_buffers;
     // tuple of <pointer, data written, data sent>
     std::vector<std::tuple<char*, std::size_t, std::size_t>> m_pending;
     std::vector<char> m_tmpbuf;
+    const bool m_pooled;
     bool m_shutdown = false;
     typedef std::unique_lock<std::mutex> lock_guard;
     mutable std::mutex m_lock;
     mutable std::condition_variable m_cond_write;
 
+    // data collected between <begin_batch> and <end_batch>.
+    dynbuf* m_batch = nullptr;
+    bool m_batch_flush = false;
+
+    // data received by the reactor and its guarding lock.
+    spinlock m_recv_lock;
+    dynbuf m_received;
+    int m_recv_status = 1;  // 0 at the end of stream, or negated errno.
+    bool m_recv_paused = false;
+
+    // buffers sent with MSG_ZEROCOPY and the ID of the last send of
+    // each.  The buffers are released in the order of IDs as the
+    // kernel reports completion of TCP sends in order.
+    std::size_t m_zerocopy_threshold = 0;  // 0 if disabled
+    std::uint32_t m_zerocopy_id = 0;       // ID of the next send
+    std::deque<std::pair<std::uint32_t, dynbuf>> m_zerocopy_buffers;
+
+    // data sent through the lock-free queue.  `data` holds copies of
+    // all data but `owned`, which is taken over from the sender and
+    // is sent after the first `owned_pos` bytes of `data`.
+    struct queued_data {
+        queued_data(): data(0), owned(0) {}
+        queued_data(queued_data&&) = default;
+        dynbuf data;
+        dynbuf owned;
+        std::size_t owned_pos = 0;
+        std::size_t sent = 0;
+        bool flush = false;
+        bool close = false;
+        bool zerocopy = false;  // `owned` has been sent with MSG_ZEROCOPY
+        std::size_t size() const noexcept {
+            return data.size() + owned.size();
+        }
+    };
+    std::unique_ptr<mpsc_queue<queued_data>> m_queue;
+    std::size_t m_queue_limit = 0;
+    std::atomic<std::size_t> m_queued_bytes{0};   // in memory
+    std::atomic<std::size_t> m_spilled_bytes{0};  // in the spill file
+    std::atomic_bool m_queue_full{false};
+    // the number of requests to write out the queue.  The thread that
+    // raises this from 0 writes out the queue until it sees no more
+    // requests.
+    std::atomic<unsigned int> m_drain_requests{0};
+    // the following are used only by the thread writing out the queue.
+    std::deque<queued_data> m_sending;
+    bool m_queue_flush = false;
+    // data in [m_spill_read, m_spill_write) of the spill file come
+    // after `m_sending` and before the queue.
+    int m_spill_fd = -1;
+    std::uint64_t m_spill_read = 0;
+    std::uint64_t m_spill_write = 0;
+
+    std::size_t buffer_size() const {
+        return m_pooled ? segment_pool::SEGMENT_SIZE : SENDBUF_SIZE;
+    }
+    std::size_t room() const {
+        if( m_pending.empty() ) return 0;
+        return buffer_size() - std::get<1>(m_pending.back());
+    }
     std::size_t capacity() const {
-        std::size_t c = m_free_buffers.size() * SENDBUF_SIZE;
-        if( m_pending.empty() ) return c;
-        return c + SENDBUF_SIZE - std::get<1>(m_pending.back());
+        return m_free_buffers.size() * SENDBUF_SIZE + room();
     }
     bool can_send(std::size_t len) const {
         if( m_shutdown ) return true; // in fact, fail
         if( ! m_tmpbuf.empty() ) return false;
         if( m_pending.empty() ) return true;
+        if( m_pooled ) return m_pending.size() < PENDING_SEGMENTS;
         return capacity() >= len;
     }
+    char* take_buffer() {
+        if( m_pooled )
+            return segment_pool::allocate();
+        char* p = m_free_buffers.back();
+        m_free_buffers.pop_back();
+        return p;
+    }
+    void put_buffer(char* p) {
+        if( m_pooled ) {
+            segment_pool::release(p);
+            return;
+        }
+        m_free_buffers.push_back(p);
+    }
+    bool reserve(std::size_t len);
+    bool wait_room(std::size_t len, lock_guard& g);
     bool _send(int fd, const char* p, std::size_t len, lock_guard& g);
-    bool _sendv(int fd, const iovec* iov, const int iovcnt, lock_guard& g);
+    bool _sendv(int fd, const iovec* iov, const int iovcnt, lock_guard& g,
+                dynbuf* owned = nullptr);
+    ssize_t send_zerocopy(int fd, const ::iovec& v, bool& sent);
+    bool reap_zerocopy(int fd);
     bool empty() const {
         return m_pending.empty() && m_tmpbuf.empty();
     }
@@ -279,6 +492,18 @@ private:
             throw_unix_error(errno, "setsockopt(TCP_NODELAY)");
     }
     void free_buffers();
+    recv_result take_received(dynbuf& buf);
+    bool sendv_(const iovec* iov, int iovcnt, dynbuf* owned, bool flush);
+    bool batch_sendv(const iovec* iov, int iovcnt, bool flush,
+                     dynbuf* owned);
+    bool queue_sendv(const iovec* iov, int iovcnt, dynbuf* owned,
+                     bool flush, bool close);
+    void queue_push(const iovec* iov, int iovcnt, dynbuf* owned,
+                    bool flush, bool close);
+    bool drain_queue(int fd);
+    bool write_queue(int fd);
+    bool spill_queue();
+    bool load_spill();
 };
 
 
@@ -286,13 +511,15 @@ private:
 // @bind_addr  A numeric IP address to be bound, or `NULL`.
 // @port       TCP port number to be bound.
 // @freebind   true to turn on IP_FREEBIND socket option.
+// @reuseport  true to turn on SO_REUSEPORT socket option.
 //
 // This is a helper function for <tcp_server_socket> template.
 // The socket is set non-blocking before return.
 //
 // @return  A UNIX file descriptor of a listening socket.
 int
-setup_server_socket(const char* bind_addr, std::uint16_t port, bool freebind);
+setup_server_socket(const char* bind_addr, std::uint16_t port,
+                    bool freebind, bool reuseport = false);
 
 
 // A <cybozu::resource> subclass to accept new TCP connections.
@@ -306,6 +533,7 @@ public:
     // @port       TCP port number to be bound.
     // @on_accept  Callback function.
     // @freebind   true to turn on IP_FREEBIND socket option.
+    // @reuseport  true to turn on SO_REUSEPORT socket option.
     //
     // This creates a socket and bind it to the given address and port.
     // If `bind_addr` is `NULL`, the socket will listen on any address.
@@ -316,9 +544,13 @@ public:
     // to be added to the reactor.  If `on_accept` returns an empty
     // <std::unique_ptr>, the new connection is closed immediately.
     // Otherwise, the new connection is added to the reactor.
+    //
+    // With `reuseport`, multiple sockets can be bound to the same address
+    // and port, and the kernel distributes new connections among them.
     tcp_server_socket(const char* bind_addr, std::uint16_t port,
-                      wrapper on_accept, bool freebind):
-        resource( setup_server_socket(bind_addr, port, freebind) ),
+                      wrapper on_accept, bool freebind,
+                      bool reuseport = false):
+        resource( setup_server_socket(bind_addr, port, freebind, reuseport) ),
         m_wrapper(on_accept) {}
     virtual ~tcp_server_socket() {}
 
@@ -327,20 +559,27 @@ private:
 
     virtual bool on_readable(int) override final;
     virtual bool on_writable(int) override final { return true; }
+    virtual io_mode preferred_mode() const override final {
+        return io_mode::ACCEPT;
+    }
+    virtual bool on_accept(int s) override final;
+    void add_connection(int s, const struct sockaddr* addr);
 };
 
 
 // Utility function to create a <std::unique_ptr> of <tcp_server_socket>.
 inline std::unique_ptr<tcp_server_socket> make_server_socket(
     const char* bind_addr, std::uint16_t port,
-    tcp_server_socket::wrapper w, bool freebind = false) {
+    tcp_server_socket::wrapper w, bool freebind = false,
+    bool reuseport = false) {
     return std::unique_ptr<tcp_server_socket>(
-        new tcp_server_socket(bind_addr, port, w, freebind) );
+        new tcp_server_socket(bind_addr, port, w, freebind, reuseport) );
 }
 inline std::unique_ptr<tcp_server_socket> make_server_socket(
     const ip_address& ip, std::uint16_t port,
-    tcp_server_socket::wrapper w, bool freebind = false) {
-    return make_server_socket(ip.str().c_str(), port, w, freebind);
+    tcp_server_socket::wrapper w, bool freebind = false,
+    bool reuseport = false) {
+    return make_server_socket(ip.str().c_str(), port, w, freebind, reuseport);
 }
 
 } // namespace cybozu
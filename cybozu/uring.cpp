@@ -0,0 +1,270 @@
+// (C) 2026 Cybozu.
+
+#include "uring.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <endian.h>
+#include <linux/time_types.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+
+int io_uring_setup(unsigned int entries, io_uring_params* p) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                   unsigned int flags, const void* arg, std::size_t argsz) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit,
+                                      min_complete, flags, arg, argsz));
+}
+
+int io_uring_register(int fd, unsigned int opcode, const void* arg,
+                      unsigned int nr_args) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode,
+                                      arg, nr_args));
+}
+
+void* map_memory(std::size_t len, int fd, off_t offset) {
+    int flags = MAP_SHARED | MAP_POPULATE;
+    if( fd == -1 )
+        flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void* p = ::mmap(nullptr, len, PROT_READ|PROT_WRITE, flags, fd, offset);
+    if( p == MAP_FAILED )
+        cybozu::throw_unix_error(errno, "mmap");
+    return p;
+}
+
+// Report a missing kernel feature.  This is not worth a stack dump
+// as the caller is expected to fall back to something else.
+[[noreturn]] void unsupported(int e, const char* func) {
+    throw std::system_error(e, std::system_category(), func);
+}
+
+template<typename T>
+inline T* at(void* base, std::uint32_t offset) noexcept {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+} // anonymous namespace
+
+namespace cybozu {
+
+const std::uint16_t uring::BUFFER_GROUP;
+
+uring::uring(unsigned int entries, unsigned int buffers,
+             std::size_t buffer_size):
+    m_buffer_size(buffer_size), m_buffer_count(buffers)
+{
+    if( buffers == 0 || buffers > 32768 || (buffers & (buffers - 1)) != 0 )
+        throw std::invalid_argument("uring: bad number of buffers");
+
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    // multishot receive and IORING_SETUP_SINGLE_ISSUER appeared in the
+    // same kernel release, so the latter tells the former is available.
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN |
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_R_DISABLED;
+    p.cq_entries = entries * 4;
+    m_fd = io_uring_setup(entries, &p);
+    if( m_fd == -1 )
+        unsupported(errno, "io_uring_setup");
+
+    try {
+        const std::uint32_t required = IORING_FEAT_SINGLE_MMAP |
+            IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+        if( (p.features & required) != required )
+            unsupported(ENOSYS, "io_uring_setup");
+
+        m_sq_size = p.sq_off.array + p.sq_entries * sizeof(std::uint32_t);
+        m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        m_sq_size = std::max(m_sq_size, m_cq_size);
+        m_sq_ptr = map_memory(m_sq_size, m_fd, IORING_OFF_SQ_RING);
+        m_cq_ptr = m_sq_ptr;
+
+        m_sq_head = at<std::uint32_t>(m_sq_ptr, p.sq_off.head);
+        m_sq_tail = at<std::uint32_t>(m_sq_ptr, p.sq_off.tail);
+        m_sq_mask = *at<std::uint32_t>(m_sq_ptr, p.sq_off.ring_mask);
+        m_sq_entries = *at<std::uint32_t>(m_sq_ptr, p.sq_off.ring_entries);
+        std::uint32_t* array = at<std::uint32_t>(m_sq_ptr, p.sq_off.array);
+        for( std::uint32_t i = 0; i < m_sq_entries; ++i )
+            array[i] = i;
+        m_sqe_tail = m_submitted = *m_sq_tail;
+
+        m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = static_cast<io_uring_sqe*>(
+            map_memory(m_sqes_size, m_fd, IORING_OFF_SQES));
+
+        m_cq_head = at<std::uint32_t>(m_cq_ptr, p.cq_off.head);
+        m_cq_tail = at<std::uint32_t>(m_cq_ptr, p.cq_off.tail);
+        m_cq_mask = *at<std::uint32_t>(m_cq_ptr, p.cq_off.ring_mask);
+        m_cqes = at<io_uring_cqe>(m_cq_ptr, p.cq_off.cqes);
+
+        // the buffer ring must be page aligned.
+        m_buf_ring_size = buffers * sizeof(io_uring_buf);
+        m_buf_ring = static_cast<io_uring_buf*>(
+            map_memory(m_buf_ring_size, -1, 0));
+        m_buf_mask = static_cast<std::uint16_t>(buffers - 1);
+        m_buffers = static_cast<char*>(
+            map_memory(buffers * buffer_size, -1, 0));
+
+        io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<std::uintptr_t>(m_buf_ring);
+        reg.ring_entries = buffers;
+        reg.bgid = BUFFER_GROUP;
+        if( io_uring_register(m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1 )
+            unsupported(errno, "io_uring_register(PBUF_RING)");
+        for( unsigned int i = 0; i < buffers; ++i )
+            recycle(static_cast<std::uint16_t>(i));
+    } catch( ... ) {
+        release();
+        throw;
+    }
+}
+
+uring::~uring() {
+    release();
+}
+
+void uring::release() noexcept {
+    if( m_buffers != nullptr )
+        ::munmap(m_buffers, m_buffer_count * m_buffer_size);
+    if( m_buf_ring != nullptr )
+        ::munmap(m_buf_ring, m_buf_ring_size);
+    if( m_sqes != nullptr )
+        ::munmap(m_sqes, m_sqes_size);
+    if( m_sq_ptr != nullptr )
+        ::munmap(m_sq_ptr, m_sq_size);
+    ::close(m_fd);
+}
+
+io_uring_sqe* uring::get_sqe() {
+    if( m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE)
+        >= m_sq_entries ) {
+        submit();
+        if( m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE)
+            >= m_sq_entries )
+            throw_unix_error(EBUSY, "io_uring_enter");
+    }
+    io_uring_sqe* sqe = &m_sqes[m_sqe_tail & m_sq_mask];
+    ++m_sqe_tail;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void uring::poll(int fd, std::uint32_t events, std::uint64_t user_data) {
+#if __BYTE_ORDER == __BIG_ENDIAN
+    events = (events << 16) | (events >> 16);
+#endif
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+}
+
+void uring::update_poll(std::uint64_t target, std::uint32_t events,
+                        std::uint64_t user_data) {
+#if __BYTE_ORDER == __BIG_ENDIAN
+    events = (events << 16) | (events >> 16);
+#endif
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->len = IORING_POLL_ADD_MULTI | IORING_POLL_UPDATE_EVENTS;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+}
+
+void uring::accept(int fd, std::uint64_t user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+}
+
+void uring::recv(int fd, std::uint64_t user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = user_data;
+}
+
+void uring::cancel(std::uint64_t target, std::uint64_t user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+}
+
+void uring::cancel_fd(int fd, std::uint64_t user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = user_data;
+}
+
+void uring::submit(int timeout) {
+    if( ! m_enabled ) {
+        if( io_uring_register(m_fd, IORING_REGISTER_ENABLE_RINGS,
+                              nullptr, 0) == -1 )
+            throw_unix_error(errno, "io_uring_register(ENABLE_RINGS)");
+        m_enabled = true;
+    }
+
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+
+    __kernel_timespec ts;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000L;
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<std::uintptr_t>(&ts);
+
+    // GETEVENTS also runs deferred completion work even if not waiting.
+    unsigned int to_submit = m_sqe_tail - m_submitted;
+    unsigned int wait_nr = (timeout > 0) ? 1 : 0;
+    int n = io_uring_enter(m_fd, to_submit, wait_nr,
+                           IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                           &arg, sizeof(arg));
+    if( n == -1 ) {
+        // EBUSY and EAGAIN mean the completion queue is full;
+        // requests will be submitted after completions are reaped.
+        if( errno == ETIME || errno == EINTR ||
+            errno == EBUSY || errno == EAGAIN )
+            return;
+        throw_unix_error(errno, "io_uring_enter");
+    }
+    m_submitted += static_cast<unsigned int>(n);
+}
+
+void uring::recycle(std::uint16_t bid) noexcept {
+    io_uring_buf& b = m_buf_ring[m_buf_tail & m_buf_mask];
+    b.addr = reinterpret_cast<std::uintptr_t>(buffer(bid));
+    b.len = static_cast<std::uint32_t>(m_buffer_size);
+    b.bid = bid;
+    ++m_buf_tail;
+    __atomic_store_n(&m_buf_ring[0].resv, m_buf_tail, __ATOMIC_RELEASE);
+}
+
+} // namespace cybozu
@@ -0,0 +1,145 @@
+// A minimal io_uring interface.
+// (C) 2026 Cybozu.
+
+#ifndef CYBOZU_URING_HPP
+#define CYBOZU_URING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+namespace cybozu {
+
+// An io_uring instance driven by raw system calls.
+//
+// This implements just enough of io_uring for <reactor>: multishot
+// poll, accept, and receive requests, cancellation, and a ring of
+// provided buffers for receive requests.  The ring is created disabled
+// and enabled by the first <submit> so that the thread that runs the
+// reactor becomes the only submitter.
+//
+// Only one thread may use an instance at a time.
+class uring {
+public:
+    // Constructor.
+    // @entries      The number of submission queue entries.
+    // @buffers      The number of provided buffers.  Must be a power of 2.
+    // @buffer_size  The size of each provided buffer.
+    //
+    // This throws <std::system_error> if the kernel does not support
+    // the features used by this class.
+    uring(unsigned int entries, unsigned int buffers, std::size_t buffer_size);
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+    ~uring();
+
+    // The buffer group of the provided buffers.
+    static const std::uint16_t BUFFER_GROUP = 0;
+
+    // Prepare a multishot poll request.
+    // @fd         A file descriptor.
+    // @events     Poll events.  Notification is edge-triggered.
+    // @user_data  User data of the request.
+    void poll(int fd, std::uint32_t events, std::uint64_t user_data);
+
+    // Prepare a request to update events of a poll request.
+    // @target     User data of the poll request.
+    // @events     New poll events.
+    // @user_data  User data of this request.
+    void update_poll(std::uint64_t target, std::uint32_t events,
+                     std::uint64_t user_data);
+
+    // Prepare a multishot accept request.
+    // @fd         A listening socket.
+    // @user_data  User data of the request.
+    //
+    // Accepted sockets are set non-blocking and close-on-exec.
+    void accept(int fd, std::uint64_t user_data);
+
+    // Prepare a multishot receive request with provided buffers.
+    // @fd         A connected socket.
+    // @user_data  User data of the request.
+    void recv(int fd, std::uint64_t user_data);
+
+    // Prepare a request to cancel a request.
+    // @target     User data of the request to be canceled.
+    // @user_data  User data of this request.
+    void cancel(std::uint64_t target, std::uint64_t user_data);
+
+    // Prepare a request to cancel all requests for a file descriptor.
+    // @fd         A file descriptor.
+    // @user_data  User data of this request.
+    void cancel_fd(int fd, std::uint64_t user_data);
+
+    // Submit prepared requests and wait for completions.
+    // @timeout  Timeout in milliseconds.  0 does not wait.
+    void submit(int timeout = 0);
+
+    // Call `f` for each completion.
+    // `f` should be a function like `void f(const io_uring_cqe& cqe)`.
+    template<typename Func>
+    void for_each_completion(Func&& f) {
+        std::uint32_t head = *m_cq_head;
+        std::uint32_t tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        for( ; head != tail; ++head ) {
+            f(m_cqes[head & m_cq_mask]);
+            // publish early so that the kernel can reuse the entries
+            // while `f` submits more requests.
+            __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    // Return a provided buffer selected by a receive request.
+    // @bid  The buffer ID in <io_uring_cqe::flags>.
+    const char* buffer(std::uint16_t bid) const noexcept {
+        return m_buffers + (static_cast<std::size_t>(bid) * m_buffer_size);
+    }
+
+    // Give a provided buffer back to the kernel.
+    // @bid  The buffer ID.
+    //
+    // The buffer becomes available to receive requests immediately.
+    void recycle(std::uint16_t bid) noexcept;
+
+private:
+    int m_fd;
+    bool m_enabled = false;
+
+    // submission queue
+    void* m_sq_ptr = nullptr;
+    std::size_t m_sq_size = 0;
+    std::uint32_t* m_sq_head;
+    std::uint32_t* m_sq_tail;
+    std::uint32_t m_sq_mask;
+    std::uint32_t m_sq_entries;
+    io_uring_sqe* m_sqes = nullptr;
+    std::size_t m_sqes_size = 0;
+    std::uint32_t m_sqe_tail = 0;
+    std::uint32_t m_submitted = 0;
+
+    // completion queue
+    void* m_cq_ptr = nullptr;
+    std::size_t m_cq_size = 0;
+    std::uint32_t* m_cq_head;
+    std::uint32_t* m_cq_tail;
+    std::uint32_t m_cq_mask;
+    io_uring_cqe* m_cqes;
+
+    // provided buffers.  The ring tail overlays <io_uring_buf::resv>
+    // of the first entry as in <io_uring_buf_ring>, whose flexible
+    // array member is laid out differently in C++.
+    io_uring_buf* m_buf_ring = nullptr;
+    std::size_t m_buf_ring_size = 0;
+    std::uint16_t m_buf_mask;
+    std::uint16_t m_buf_tail = 0;
+    char* m_buffers = nullptr;
+    const std::size_t m_buffer_size;
+    const unsigned int m_buffer_count;
+
+    io_uring_sqe* get_sqe();
+    void release() noexcept;
+};
+
+} // namespace cybozu
+
+#endif // CYBOZU_URING_HPP
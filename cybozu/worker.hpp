@@ -5,6 +5,9 @@
 #define CYBOZU_WORKER_HPP
 
 #include <cybozu/dynbuf.hpp>
+#include <cybozu/epoch.hpp>
+#include <cybozu/sharded_counter.hpp>
+#include <cybozu/spinlock.hpp>
 #include <cybozu/thread.hpp>
 #include <cybozu/util.hpp>
 
@@ -12,8 +15,13 @@
 #include <cstddef>
 #include <cstdint>
 #include <functional>
-#include <sys/eventfd.h>
+#include <memory>
+#include <linux/futex.h>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 namespace cybozu {
 
@@ -23,21 +31,41 @@ namespace cybozu {
 // A worker receives a new `job` through <post_job> as a callback function,
 // then invokes the function with that buffer.
 //
+// Jobs are queued in a bounded lock-free queue of each worker.  Only
+// one thread (the reactor) may post jobs to a worker, whereas any
+// worker given as a peer by <set_peers> may take jobs from the queue.
+// A worker that has run out of its own jobs steals jobs from its peers
+// before going to sleep.
+//
+// An idle worker spins for a while to catch new jobs without system
+// calls, then parks itself on a futex.  <post_job> makes a system call
+// only to wake up a parked worker.
+//
 // To stop the worker, call <stop>.
 class worker final: public thread_base<worker> {
 public:
+    // Jobs for workers are this kind of functions.
+    // `buf` is a memory buffer that can be used freely for temporary data.
+    using job = std::function<void(dynbuf& buf)>;
+
+    // The maximum number of queued jobs per worker.
+    static const std::size_t QUEUE_SIZE = 256;
+
+    // The number of polls of the queues before parking.
+    // This amounts to some tens of microseconds.
+    static const int SPIN_COUNT = 2000;
+
     // Constructor.
     // @bufsiz   The size of the internal buffer.
+    //
+    // Spinning is disabled on a single CPU where it only delays
+    // the thread that would post the next job.
     worker(std::size_t bufsiz)
-        : m_running(false), m_exit(false),
-          m_event(eventfd(0, EFD_CLOEXEC)), m_buffer(bufsiz)
-    {
-        if( m_event == -1 )
-            throw_unix_error(errno, "eventfd");
-    }
-    ~worker() {
-        ::close(m_event);
-    }
+        : m_running(false), m_exit(false), m_parked(0),
+          m_spin_count(std::thread::hardware_concurrency() > 1 ?
+                       SPIN_COUNT : 0),
+          m_buffer(bufsiz)
+    {}
 
     // forbid copy & assignment
     worker(const worker&) = delete;
@@ -45,67 +73,301 @@ public:
     worker(worker&&) = delete;
     worker& operator=(worker&&) = delete;
 
-    // Jobs for workers are this kind of functions.
-    // `buf` is a memory buffer that can be used freely for temporary data.
-    using job = std::function<void(dynbuf& buf)>;
+    // Set workers from which this worker may steal jobs.
+    // @workers  A list of workers.
+    // @first    The first index of peers in `workers`.
+    // @last     The index next to the last peer.
+    //
+    // This worker itself may be included in the range.
+    // Call this before <start>.
+    void set_peers(const std::vector<std::unique_ptr<worker>>& workers,
+                   std::size_t first, std::size_t last) {
+        m_peers.clear();
+        // start from the next worker so that thieves spread over peers.
+        const std::size_t n = last - first;
+        std::size_t start = 0;
+        for( std::size_t i = 0; i < n; ++i ) {
+            if( workers[first + i].get() == this )
+                start = i + 1;
+        }
+        for( std::size_t i = 0; i < n; ++i ) {
+            worker* pw = workers[first + (start + i) % n].get();
+            if( pw != this )
+                m_peers.push_back(pw);
+        }
+    }
 
-    // Return `true` while this worker thread is busy for a job.
+    // Return `true` while this worker thread is busy for jobs.
     bool is_running() const noexcept {
         return m_running.load(std::memory_order_acquire);
     }
 
+    // Return `true` if this worker has no jobs to run.
+    bool is_idle() const noexcept {
+        return ! is_running() && m_queue.empty();
+    }
+
+    // Return the number of queued jobs.
+    std::size_t queued_jobs() const noexcept {
+        return m_queue.size();
+    }
+
+    // Return the total number of jobs posted to this worker.
+    std::uint64_t posted_jobs() const noexcept {
+        return m_queue.tail();
+    }
+
+    // Return the total number of jobs taken from this worker's queue
+    // by this worker or its peers.
+    std::uint64_t taken_jobs() const noexcept {
+        return m_queue.head();
+    }
+
+    // Return the total number of jobs this worker has finished.
+    std::uint64_t finished_jobs() const noexcept {
+        return m_finished.load(std::memory_order_acquire);
+    }
+
+    // Return the record of quiescent states of this worker.
+    //
+    // A worker announces a quiescent state after every job, and stays
+    // offline while it is idle.  Note that jobs still queued may have
+    // references to shared objects.
+    const epoch_record& epoch() const noexcept {
+        return m_epoch;
+    }
+
+    // Return the total number of jobs posted to all workers.
+    static std::uint64_t total_jobs() noexcept {
+        return static_cast<std::uint64_t>(counters().jobs.sum());
+    }
+
+    // Return the total number of system calls to wake up workers.
+    static std::uint64_t total_wakeups() noexcept {
+        return static_cast<std::uint64_t>(counters().wakeups.sum());
+    }
+
     // Ask this worker thread to execute a new job.
-    // @job_  A callback function to be executed by the worker thread.
-    void post_job(job job_) {
-        m_job = job_;
-        m_running.store(true, std::memory_order_release);
-        notify();
+    // @job_  A callback function to be executed by a worker thread.
+    //
+    // `job_` is not copied and must be kept alive until it is executed.
+    // Only one thread may call this.  The queue must not be full.
+    void post_job(const job& job_) {
+        if( ! m_queue.push(&job_) )
+            throw std::logic_error("<worker::post_job> queue is full!");
+        counters().jobs.add(1);
+        // paired with the store to `m_parked` in <run>.
+        if( m_parked.load(std::memory_order_seq_cst) != 0 )
+            wake();
     }
 
     // Stop this worker thread.
     //
     // The thread will be joined automatically.
     void stop() {
-        m_exit = true;
-        m_running.store(true, std::memory_order_release);
-        notify();
+        m_exit.store(true, std::memory_order_seq_cst);
+        wake();
         m_thread.join();
     }
 
     // CRTP method for <thread_base>.
     void run() {
         while ( true ) {
-            // wait a new job or an exit signal
-            m_running.store(false, std::memory_order_release);
-            std::uint64_t i;
-            ssize_t n = ::read(m_event, &i, sizeof(i));
-            if( n == -1 )
-                throw_unix_error(errno, "read(eventfd)");
-            while( ! m_running.load(std::memory_order_acquire) );
+            m_running.store(true, std::memory_order_seq_cst);
+            // this must precede taking a job.
+            m_epoch.quiescent();
+            const job* j;
+            while( (j = take()) != nullptr ) {
+                (*j)(m_buffer);
+                m_buffer.reset();
+                m_finished.fetch_add(1, std::memory_order_release);
+                m_epoch.quiescent();
+            }
 
-            if( m_exit ) return;
+            if( m_exit.load(std::memory_order_acquire) ) return;
 
-            m_job(m_buffer);
-            m_buffer.reset();
+            m_running.store(false, std::memory_order_release);
+            m_epoch.offline();
+            if( spin() )
+                continue;
+
+            // paired with the load of `m_parked` in <post_job>.
+            // Either this finds a new job, or the poster wakes us up.
+            m_parked.store(1, std::memory_order_seq_cst);
+            if( ! has_jobs() && ! m_exit.load(std::memory_order_seq_cst) )
+                park();
+            m_parked.store(0, std::memory_order_relaxed);
         }
     }
 
 private:
+    // A bounded queue of jobs with a single producer and multiple
+    // consumers.  Consumers race for the head by compare-and-swap.
+    class job_queue {
+    public:
+        job_queue() {
+            for( auto& slot: m_slots )
+                slot.store(nullptr, std::memory_order_relaxed);
+        }
+
+        bool empty() const noexcept {
+            return size() == 0;
+        }
+
+        std::size_t size() const noexcept {
+            std::uint64_t h = head();
+            std::uint64_t t = tail();
+            return (t > h) ? static_cast<std::size_t>(t - h) : 0;
+        }
+
+        std::uint64_t head() const noexcept {
+            return m_head.load(std::memory_order_acquire);
+        }
+
+        std::uint64_t tail() const noexcept {
+            return m_tail.load(std::memory_order_seq_cst);
+        }
+
+        // Only the producer can call this.
+        bool push(const job* j) noexcept {
+            std::uint64_t t = m_tail.load(std::memory_order_relaxed);
+            if( t - m_head.load(std::memory_order_acquire) >= QUEUE_SIZE )
+                return false;
+            m_slots[t % QUEUE_SIZE].store(j, std::memory_order_relaxed);
+            m_tail.store(t + 1, std::memory_order_seq_cst);
+            return true;
+        }
+
+        const job* pop() noexcept {
+            std::uint64_t h = m_head.load(std::memory_order_acquire);
+            while( true ) {
+                if( h >= m_tail.load(std::memory_order_acquire) )
+                    return nullptr;
+                // the slot cannot be reused before the head moves past h,
+                // in which case the CAS below fails.
+                const job* j = m_slots[h % QUEUE_SIZE]
+                    .load(std::memory_order_relaxed);
+                if( m_head.compare_exchange_weak(h, h + 1,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_acquire) )
+                    return j;
+            }
+        }
+
+    private:
+        alignas(CACHELINE_SIZE)
+        std::atomic<std::uint64_t> m_head{0};
+        alignas(CACHELINE_SIZE)
+        std::atomic<std::uint64_t> m_tail{0};
+        std::atomic<const job*> m_slots[QUEUE_SIZE];
+    };
+
     alignas(CACHELINE_SIZE)
     std::atomic<bool> m_running;
-    bool m_exit;
-    const int m_event;
+    std::atomic<bool> m_exit;
+    std::atomic<std::uint64_t> m_finished{0};
+    std::atomic<std::uint32_t> m_parked; // futex word
+    epoch_record m_epoch;
+    const int m_spin_count;
     dynbuf m_buffer;
-    job m_job;
+    std::vector<worker*> m_peers;
+    job_queue m_queue;
 
-    void notify() {
-        std::uint64_t i = 1;
-        ssize_t n = ::write(m_event, &i, sizeof(i));
-        if( n == -1 )
-            throw_unix_error(errno, "write(eventfd)");
+    const job* take() noexcept {
+        const job* j = m_queue.pop();
+        if( j != nullptr )
+            return j;
+        for( worker* peer: m_peers ) {
+            j = peer->m_queue.pop();
+            if( j != nullptr )
+                return j;
+        }
+        return nullptr;
+    }
+
+    bool has_jobs() const noexcept {
+        if( ! m_queue.empty() )
+            return true;
+        for( const worker* peer: m_peers ) {
+            if( ! peer->m_queue.empty() )
+                return true;
+        }
+        return false;
+    }
+
+    // Poll the queues for a while.
+    bool spin() const noexcept {
+        for( int i = 0; i < m_spin_count; ++i ) {
+            if( has_jobs() || m_exit.load(std::memory_order_relaxed) )
+                return true;
+            cpu_relax();
+        }
+        return false;
+    }
+
+    void park() {
+        std::uint32_t* addr = reinterpret_cast<std::uint32_t*>(&m_parked);
+        while( m_parked.load(std::memory_order_acquire) != 0 ) {
+            long n = ::syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, 1,
+                               nullptr, nullptr, 0);
+            if( n == -1 && errno != EAGAIN && errno != EINTR )
+                throw_unix_error(errno, "futex(FUTEX_WAIT)");
+        }
+    }
+
+    void wake() {
+        if( m_parked.exchange(0, std::memory_order_seq_cst) == 0 )
+            return;
+        counters().wakeups.add(1);
+        std::uint32_t* addr = reinterpret_cast<std::uint32_t*>(&m_parked);
+        if( ::syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1,
+                      nullptr, nullptr, 0) == -1 )
+            throw_unix_error(errno, "futex(FUTEX_WAKE)");
+    }
+
+    struct worker_counters {
+        sharded_counter jobs;
+        sharded_counter wakeups;
+    };
+
+    static worker_counters& counters() noexcept {
+        static worker_counters c;
+        return c;
     }
 };
 
+
+// Choose a worker to post a job.
+// @workers  A list of workers.
+// @first    The first index of candidates in `workers`.
+// @last     The index next to the last candidate.
+// @index    The round-robin cursor in [`first`, `last`).
+//
+// An idle worker is preferred.  If all workers are busy, the one with
+// the fewest queued jobs is chosen; the job will be run by that worker
+// or stolen by a peer that runs out of jobs earlier.
+//
+// @return A worker, or `nullptr` if all queues are full.
+inline worker*
+choose_worker(const std::vector<std::unique_ptr<worker>>& workers,
+              std::size_t first, std::size_t last, std::size_t& index) {
+    worker* best = nullptr;
+    std::size_t best_queued = worker::QUEUE_SIZE;
+    for( std::size_t i = first; i < last; ++i ) {
+        worker* pw = workers[index].get();
+        if( ++index >= last )
+            index = first;
+        if( pw->is_idle() )
+            return pw;
+        std::size_t queued = pw->queued_jobs();
+        if( queued < best_queued ) {
+            best = pw;
+            best_queued = queued;
+        }
+    }
+    return best;
+}
+
 } // namespace cybozu
 
 #endif // CYBOZU_WORKER_HPP
@@ -23,12 +23,22 @@ const char BUCKETS[] = "buckets";
 const char MAX_DATA_SIZE[] = "max_data_size";
 const char HEAP_DATA_LIMIT[] = "heap_data_limit";
 const char MEMORY_LIMIT[] = "memory_limit";
+const char COMPRESSION_THRESHOLD[] = "compression_threshold";
+const char TIER_STORAGE_LIMIT[] = "tier_storage_limit";
+const char PAGE_FLUSH_BUDGET[] = "page_flush_budget";
+const char EVICTION_POLICY[] = "eviction_policy";
 const char REPL_BUFSIZE[] = "repl_buffer_size";
+const char REPL_LAG_LIMIT[] = "repl_lag_limit";
+const char SEND_BUFFER_LIMIT[] = "send_buffer_limit";
+const char ZEROCOPY_THRESHOLD[] = "zerocopy_threshold";
 const char INITIAL_REPL_SLEEP_DELAY_USEC[] = "initial_repl_sleep_delay_usec";
 const char SECURE_ERASE[] = "secure_erase";
 const char LOCK_MEMORY[] = "lock_memory";
 const char WORKERS[] = "workers";
+const char REACTORS[] = "reactors";
+const char IO_URING[] = "io_uring";
 const char GC_INTERVAL[] = "gc_interval";
+const char GC_THREADS[] = "gc_threads";
 const char SLAVE_TIMEOUT[] = "slave_timeout";
 const char COUNTER_ENABLE[] = "counter.enable";
 const char COUNTER_PORT[] = "counter.port";
@@ -43,6 +53,12 @@ std::unordered_map<std::string, cybozu::severity> THRESHOLDS {
     {"debug", cybozu::severity::debug}
 };
 
+std::unordered_map<std::string, yrmcds::eviction_policy> EVICTION_POLICIES {
+    {"lru", yrmcds::eviction_policy::lru},
+    {"tinylfu", yrmcds::eviction_policy::tinylfu},
+    {"size", yrmcds::eviction_policy::size}
+};
+
 inline std::size_t parse_unit(std::string& s, const char* cmd) {
     std::size_t base = 1;
     switch( s.back() ) {
@@ -200,6 +216,47 @@ void config::load(const std::string& path) {
         m_memory_limit = parse_unit(t, MEMORY_LIMIT);
     }
 
+    if( cp.exists(COMPRESSION_THRESHOLD) ) {
+        std::string t = cp.get(COMPRESSION_THRESHOLD);
+        if( t.empty() )
+            throw bad_config("compression_threshold must not be empty");
+        if( t == "0" ) {
+            m_compression_threshold = 0;
+        } else {
+            m_compression_threshold = parse_unit(t, COMPRESSION_THRESHOLD);
+        }
+    }
+
+    if( cp.exists(TIER_STORAGE_LIMIT) ) {
+        std::string t = cp.get(TIER_STORAGE_LIMIT);
+        if( t.empty() )
+            throw bad_config("tier_storage_limit must not be empty");
+        if( t == "0" ) {
+            m_tier_storage_limit = 0;
+        } else {
+            m_tier_storage_limit = parse_unit(t, TIER_STORAGE_LIMIT);
+        }
+    }
+
+    if( cp.exists(PAGE_FLUSH_BUDGET) ) {
+        std::string t = cp.get(PAGE_FLUSH_BUDGET);
+        if( t.empty() )
+            throw bad_config("page_flush_budget must not be empty");
+        if( t == "0" ) {
+            m_page_flush_budget = 0;
+        } else {
+            m_page_flush_budget = parse_unit(t, PAGE_FLUSH_BUDGET);
+        }
+    }
+
+    if( cp.exists(EVICTION_POLICY) ) {
+        auto it = EVICTION_POLICIES.find(cp.get(EVICTION_POLICY));
+        if( it == EVICTION_POLICIES.end() )
+            throw bad_config("Invalid eviction_policy: " +
+                             cp.get(EVICTION_POLICY));
+        m_eviction_policy = it->second;
+    }
+
     if( cp.exists(REPL_BUFSIZE) ) {
         int bufs = cp.get_as_int(REPL_BUFSIZE);
         if( bufs < 1 )
@@ -207,6 +264,35 @@ void config::load(const std::string& path) {
         m_repl_bufsize = bufs;
     }
 
+    if( cp.exists(REPL_LAG_LIMIT) ) {
+        std::string t = cp.get(REPL_LAG_LIMIT);
+        if( t.empty() )
+            throw bad_config("repl_lag_limit must not be empty");
+        if( t == "0" ) {
+            m_repl_lag_limit = 0;
+        } else {
+            m_repl_lag_limit = parse_unit(t, REPL_LAG_LIMIT);
+        }
+    }
+
+    if( cp.exists(SEND_BUFFER_LIMIT) ) {
+        std::string t = cp.get(SEND_BUFFER_LIMIT);
+        if( t.empty() )
+            throw bad_config("send_buffer_limit must not be empty");
+        m_send_buffer_limit = parse_unit(t, SEND_BUFFER_LIMIT);
+    }
+
+    if( cp.exists(ZEROCOPY_THRESHOLD) ) {
+        std::string t = cp.get(ZEROCOPY_THRESHOLD);
+        if( t.empty() )
+            throw bad_config("zerocopy_threshold must not be empty");
+        if( t == "0" ) {
+            m_zerocopy_threshold = 0;
+        } else {
+            m_zerocopy_threshold = parse_unit(t, ZEROCOPY_THRESHOLD);
+        }
+    }
+
     if( cp.exists(INITIAL_REPL_SLEEP_DELAY_USEC) ) {
         std::uint64_t n = cp.get_as_uint64(INITIAL_REPL_SLEEP_DELAY_USEC);
         m_initial_repl_sleep_delay_usec = n;
@@ -224,12 +310,23 @@ void config::load(const std::string& path) {
         int n = cp.get_as_int(WORKERS);
         if( n < 1 )
             throw bad_config("workers must be > 0");
-        if( n > MAX_WORKERS )
-            throw bad_config("workers must be <= " +
-                             std::to_string(MAX_WORKERS));
         m_workers = n;
     }
 
+    if( cp.exists(REACTORS) ) {
+        int n = cp.get_as_int(REACTORS);
+        if( n < 1 )
+            throw bad_config("reactors must be > 0");
+        if( n > MAX_REACTORS )
+            throw bad_config("reactors must be <= " +
+                             std::to_string(MAX_REACTORS));
+        m_reactors = n;
+    }
+
+    if( cp.exists(IO_URING) ) {
+        m_io_uring = cp.get_as_bool(IO_URING);
+    }
+
     if( cp.exists(GC_INTERVAL) ) {
         int n = cp.get_as_int(GC_INTERVAL);
         if( n < 1 )
@@ -237,6 +334,16 @@ void config::load(const std::string& path) {
         m_gc_interval = n;
     }
 
+    if( cp.exists(GC_THREADS) ) {
+        int n = cp.get_as_int(GC_THREADS);
+        if( n < 1 )
+            throw bad_config("gc_threads must be > 0");
+        if( n > MAX_GC_THREADS )
+            throw bad_config("gc_threads must be <= " +
+                             std::to_string(MAX_GC_THREADS));
+        m_gc_threads = n;
+    }
+
     if( cp.exists(SLAVE_TIMEOUT) ) {
         int n = cp.get_as_int(SLAVE_TIMEOUT);
         if( n < 1 )
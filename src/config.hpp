@@ -45,6 +45,13 @@ private:
     unsigned int m_stat_interval = DEFAULT_STAT_INTERVAL;
 };
 
+// Eviction policies.
+enum class eviction_policy {
+    lru,     // sampled LRU
+    tinylfu, // W-TinyLFU with a count-min sketch
+    size,    // prefer large cold objects
+};
+
 // Configurations for yrmcds.
 //
 // Configurations for yrmcds.
@@ -108,9 +115,30 @@ public:
     std::size_t memory_limit() const noexcept {
         return m_memory_limit;
     }
+    std::size_t compression_threshold() const noexcept {
+        return m_compression_threshold;
+    }
+    std::size_t tier_storage_limit() const noexcept {
+        return m_tier_storage_limit;
+    }
+    std::size_t page_flush_budget() const noexcept {
+        return m_page_flush_budget;
+    }
+    yrmcds::eviction_policy eviction_policy() const noexcept {
+        return m_eviction_policy;
+    }
     unsigned int repl_bufsize() const noexcept {
         return m_repl_bufsize;
     }
+    std::size_t repl_lag_limit() const noexcept {
+        return m_repl_lag_limit;
+    }
+    std::size_t send_buffer_limit() const noexcept {
+        return m_send_buffer_limit;
+    }
+    std::size_t zerocopy_threshold() const noexcept {
+        return m_zerocopy_threshold;
+    }
     std::uint64_t initial_repl_sleep_delay_usec() const noexcept {
         return m_initial_repl_sleep_delay_usec;
     }
@@ -123,9 +151,18 @@ public:
     unsigned int workers() const noexcept {
         return m_workers;
     }
+    unsigned int reactors() const noexcept {
+        return m_reactors;
+    }
+    bool io_uring() const noexcept {
+        return m_io_uring;
+    }
     unsigned int gc_interval() const noexcept {
         return m_gc_interval;
     }
+    unsigned int gc_threads() const noexcept {
+        return m_gc_threads;
+    }
     unsigned int slave_timeout() const noexcept {
         return m_slave_timeout;
     }
@@ -138,6 +175,22 @@ public:
         m_heap_data_limit = new_limit;
     }
 
+    void set_memory_limit(std::size_t new_limit) noexcept {
+        m_memory_limit = new_limit;
+    }
+
+    void set_eviction_policy(yrmcds::eviction_policy new_policy) noexcept {
+        m_eviction_policy = new_policy;
+    }
+
+    void set_compression_threshold(std::size_t new_threshold) noexcept {
+        m_compression_threshold = new_threshold;
+    }
+
+    void set_tier_storage_limit(std::size_t new_limit) noexcept {
+        m_tier_storage_limit = new_limit;
+    }
+
 private:
     alignas(CACHELINE_SIZE)
     cybozu::ip_address m_vip;
@@ -154,12 +207,22 @@ private:
     std::size_t m_max_data_size = DEFAULT_MAX_DATA_SIZE;
     std::size_t m_heap_data_limit = DEFAULT_HEAP_DATA_LIMIT;
     std::size_t m_memory_limit = DEFAULT_MEMORY_LIMIT;
+    std::size_t m_compression_threshold = DEFAULT_COMPRESSION_THRESHOLD;
+    std::size_t m_tier_storage_limit = DEFAULT_TIER_STORAGE_LIMIT;
+    std::size_t m_page_flush_budget = DEFAULT_PAGE_FLUSH_BUDGET;
+    yrmcds::eviction_policy m_eviction_policy = eviction_policy::lru;
     unsigned int m_repl_bufsize = DEFAULT_REPL_BUFSIZE;
+    std::size_t m_repl_lag_limit = DEFAULT_REPL_LAG_LIMIT;
+    std::size_t m_send_buffer_limit = DEFAULT_SEND_BUFFER_LIMIT;
+    std::size_t m_zerocopy_threshold = DEFAULT_ZEROCOPY_THRESHOLD;
     uint64_t m_initial_repl_sleep_delay_usec = DEFAULT_INITIAL_REPL_SLEEP_DELAY_USEC;
     bool m_secure_erase = false;
     bool m_lock_memory = false;
     unsigned int m_workers = DEFAULT_WORKER_THREADS;
+    unsigned int m_reactors = DEFAULT_REACTORS;
+    bool m_io_uring = true;
     unsigned int m_gc_interval = DEFAULT_GC_INTERVAL;
+    unsigned int m_gc_threads = DEFAULT_GC_THREADS;
     unsigned int m_slave_timeout = DEFAULT_SLAVE_TIMEOUT;
     counter_config m_counter_config;
 };
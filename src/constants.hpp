@@ -16,10 +16,18 @@ const unsigned int  DEFAULT_BUCKETS        = 1000000;
 const std::size_t   DEFAULT_MAX_DATA_SIZE  = static_cast<std::size_t>(1) << 20;
 const std::size_t   DEFAULT_HEAP_DATA_LIMIT= 256 << 10;
 const std::size_t   DEFAULT_MEMORY_LIMIT   = static_cast<std::size_t>(1) << 30;
+const std::size_t   DEFAULT_COMPRESSION_THRESHOLD = 0; // disabled
+const std::size_t   DEFAULT_TIER_STORAGE_LIMIT = 0; // disabled
+const std::size_t   DEFAULT_PAGE_FLUSH_BUDGET = static_cast<std::size_t>(256) << 20;
 const unsigned int  DEFAULT_REPL_BUFSIZE   = 30;
+const std::size_t   DEFAULT_REPL_LAG_LIMIT = static_cast<std::size_t>(1) << 30;
+const std::size_t   DEFAULT_SEND_BUFFER_LIMIT = static_cast<std::size_t>(256) << 20;
+const std::size_t   DEFAULT_ZEROCOPY_THRESHOLD = 0; // disabled
 const std::uint64_t DEFAULT_INITIAL_REPL_SLEEP_DELAY_USEC = 0;
 const int           DEFAULT_WORKER_THREADS = 8;
 const unsigned int  DEFAULT_GC_INTERVAL    = 10;
+const unsigned int  DEFAULT_GC_THREADS     = 1;
+const unsigned int  DEFAULT_REACTORS       = 1;
 const unsigned int  DEFAULT_SLAVE_TIMEOUT  = 10;
 const char          DEFAULT_TMPDIR[]       = "/var/tmp";
 const unsigned int  DEFAULT_STAT_INTERVAL  = 86400;
@@ -27,12 +35,23 @@ const unsigned int  DEFAULT_STAT_INTERVAL  = 86400;
 const std::size_t   MAX_KEY_LENGTH      = 250; // 250 bytes
 const int           MASTER_CHECKS       = 50; // wait 50 * 100ms = 5 seconds
 const int           FLUSH_AGE           = 10;
+const unsigned int  COMPRESS_AGE        = 3;
+const unsigned int  DEMOTE_AGE          = 6;
+const std::size_t   EVICT_SAMPLES       = 5;
+const std::size_t   EVICT_LOW_WATERMARK = 95; // % of memory_limit
+const std::size_t   EVICT_STEP_ROUNDS   = 8;
+const std::uint64_t TIER_SEGMENT_SIZE   = 64 << 20; // 64 MiB
+const std::size_t   TIER_BATCH_SIZE     = 1 << 20; // 1 MiB
 const std::size_t   MAX_RECVSIZE        = 2 << 20; // 2 MiB
+const std::size_t   PENDING_RECVSIZE    = 16 << 10; // 16 KiB
 const std::size_t   WORKER_BUFSIZE      = 5 << 20; // 5 MiB
-const int           MAX_WORKERS         = 64;
+const int           MAX_GC_THREADS      = 16;
+const int           MAX_REACTORS        = 16;
 const std::size_t   MAX_REQUEST_LENGTH  = 30 << 20; // 30 MiB
 const int           MAX_SLAVES          = 5;
 const int           MAX_CONSECUTIVE_GCS = 3;
+const unsigned int  GC_PASS_INTERVALS   = 6; // a GC pass takes 6 gc_intervals
+const std::size_t   GC_SLICE_BUCKETS    = 1024;
 
 const char          VERSION[] = "yrmcds version 1.1.12";
 
@@ -36,9 +36,11 @@ void gc_thread::gc() {
         return false;
     };
 
-    for( auto it = m_hash.begin(); it != m_hash.end(); ++it ) {
+    const std::size_t buckets = m_hash.bucket_count();
+    for( std::size_t i = m_hash.next_occupied(0, buckets); i < buckets;
+         i = m_hash.next_occupied(i + 1, buckets) ) {
         m_objects_in_bucket = 0;
-        it->gc(pred);
+        (m_hash.begin() + i)->gc(pred);
     }
 }
 
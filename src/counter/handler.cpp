@@ -39,37 +39,33 @@ bool handler::gc_ready() {
 }
 
 void handler::on_master_start() {
-    using cybozu::make_server_socket;
     cybozu::tcp_server_socket::wrapper w =
         [this](int s, const cybozu::ip_address&) {
-            return make_counter_socket(s);
+            return make_counter_socket(s, m_finder);
         };
-    auto port = g_config.counter().port();
-
-    if( g_config.bind_ip().empty() ) {
-        m_reactor.add_resource(
-            make_server_socket(nullptr, port, w),
-            cybozu::reactor::EVENT_IN);
-    } else {
-        m_reactor.add_resource(
-            make_server_socket(g_config.vip(), port, w, true),
-            cybozu::reactor::EVENT_IN);
-        for( auto& s: g_config.bind_ip() ) {
-            m_reactor.add_resource(
-                make_server_socket(s, port, w),
-                cybozu::reactor::EVENT_IN);
-        }
-    }
+    add_listeners(m_reactor, g_config.counter().port(), w,
+                  g_config.reactors() > 1);
+}
+
+void handler::on_reactor_start(cybozu::reactor& r,
+                               const std::function<cybozu::worker*()>& finder) {
+    cybozu::tcp_server_socket::wrapper w =
+        [this,&finder](int s, const cybozu::ip_address&) {
+            return make_counter_socket(s, finder);
+        };
+    add_listeners(r, g_config.counter().port(), w, true);
 }
 
-std::unique_ptr<cybozu::tcp_socket> handler::make_counter_socket(int s) {
+std::unique_ptr<cybozu::tcp_socket>
+handler::make_counter_socket(int s,
+                             const std::function<cybozu::worker*()>& finder) {
     unsigned int mc = g_config.counter().max_connections();
     if( mc != 0 &&
         g_stats.curr_connections.load(relaxed) >= mc )
         return nullptr;
 
     return std::unique_ptr<cybozu::tcp_socket>(
-        new counter_socket(s, m_finder, m_hash) );
+        new counter_socket(s, finder, m_hash) );
 }
 
 void handler::on_master_interval() {
@@ -24,13 +24,16 @@ public:
     virtual void on_master_start() override;
     virtual void on_master_interval() override;
     virtual void on_master_end() override;
+    virtual void on_reactor_start(cybozu::reactor& r,
+                                  const std::function<cybozu::worker*()>& finder) override;
     virtual bool on_slave_start() override;
     virtual void dump_stats() override;
 
 private:
     void clear();
     bool gc_ready();
-    std::unique_ptr<cybozu::tcp_socket> make_counter_socket(int s);
+    std::unique_ptr<cybozu::tcp_socket>
+    make_counter_socket(int s, const std::function<cybozu::worker*()>& finder);
 
     std::function<cybozu::worker*()> m_finder;
     cybozu::reactor& m_reactor;
@@ -40,6 +40,8 @@ counter_socket::counter_socket(int fd,
                 break;
             }
 
+            // replies to pipelined requests are sent at once.
+            begin_batch();
             const char* head = buf.data();
             std::size_t len = buf.size();
             while( len > 0 ) {
@@ -50,6 +52,7 @@ counter_socket::counter_socket(int fd,
                 len -= c;
                 execute(parser);
             }
+            end_batch();
             if( len > MAX_REQUEST_LENGTH ) {
                 cybozu::logger::warning() << "denied too large request of "
                                           << len << " bytes.";
@@ -86,7 +89,7 @@ bool counter_socket::on_readable(int fd) {
         return true;
     }
 
-    // find an idle worker.
+    // find a worker to run the job.
     cybozu::worker* w = m_finder();
     if( w == nullptr ) {
         m_reactor->add_readable(*this);
@@ -101,7 +104,7 @@ bool counter_socket::on_readable(int fd) {
 bool counter_socket::on_writable(int fd) {
     cybozu::worker* w = m_finder();
     if( w == nullptr ) {
-        // if there is no idle worker, fallback to the default.
+        // if all job queues are full, fallback to the default.
         return cybozu::tcp_socket::on_writable(fd);
     }
 
@@ -49,6 +49,9 @@ private:
 
     bool on_readable(int) override;
     bool on_writable(int) override;
+    io_mode preferred_mode() const override {
+        return io_mode::RECV;
+    }
 
     void cmd_get(const counter::request& cmd, counter::response& r);
     void cmd_acquire(const counter::request& cmd, counter::response& r);
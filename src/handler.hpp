@@ -4,10 +4,49 @@
 #ifndef YRMCDS_HANDLER_HPP
 #define YRMCDS_HANDLER_HPP
 
+#include "config.hpp"
+
 #include <cybozu/logger.hpp>
+#include <cybozu/reactor.hpp>
+#include <cybozu/tcp.hpp>
+#include <cybozu/worker.hpp>
+
+#include <cstdint>
+#include <functional>
 
 namespace yrmcds {
 
+// Return the reactor backend chosen by the configuration.
+inline cybozu::reactor::backend reactor_backend() {
+    return g_config.io_uring() ? cybozu::reactor::backend::IO_URING
+                               : cybozu::reactor::backend::EPOLL;
+}
+
+// Add listening sockets for `port` to a reactor.
+// @r          The reactor.
+// @port       TCP port number.
+// @w          Callback function for new connections.
+// @reuseport  true to turn on SO_REUSEPORT socket option.
+//
+// Sockets are bound to `virtual_ip` and `bind_ip` if `bind_ip` is
+// configured, or to any address otherwise.
+inline void add_listeners(cybozu::reactor& r, std::uint16_t port,
+                          const cybozu::tcp_server_socket::wrapper& w,
+                          bool reuseport = false) {
+    using cybozu::make_server_socket;
+    if( g_config.bind_ip().empty() ) {
+        r.add_resource(make_server_socket(nullptr, port, w, false, reuseport),
+                       cybozu::reactor::EVENT_IN);
+        return;
+    }
+    r.add_resource(make_server_socket(g_config.vip(), port, w, true, reuseport),
+                   cybozu::reactor::EVENT_IN);
+    for( auto& s: g_config.bind_ip() ) {
+        r.add_resource(make_server_socket(s, port, w, false, reuseport),
+                       cybozu::reactor::EVENT_IN);
+    }
+}
+
 // An interface for protocol-specific logics.
 class protocol_handler {
 public:
@@ -28,6 +67,16 @@ public:
     // Called when the server leaves the master mode.
     virtual void on_master_end() {}
 
+    // Called when an additional reactor is prepared in the master mode.
+    // @r       The reactor, which is not running yet.
+    // @finder  A function to find a worker of the reactor.
+    //
+    // Handlers can add listening sockets bound with `SO_REUSEPORT`
+    // to `r`.  Connections accepted by them belong to `r` and must be
+    // served by the workers found by `finder`.  `finder` outlives `r`.
+    virtual void on_reactor_start(cybozu::reactor& r,
+                                  const std::function<cybozu::worker*()>& finder) {}
+
     // Called when the server enters the slave mode.
     //
     // If this function succeeded, returns `true`.
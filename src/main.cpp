@@ -6,6 +6,7 @@
 #include "server.hpp"
 
 #include <cybozu/filesystem.hpp>
+#include <cybozu/segment_pool.hpp>
 #include <cybozu/siphash.hpp>
 #include <cybozu/util.hpp>
 
@@ -103,6 +104,10 @@ int main(int argc, char** argv) {
         if( ! load_config(args) )
             return 1;
 
+        cybozu::segment_pool::set_limit(
+            yrmcds::g_config.send_buffer_limit() /
+            cybozu::segment_pool::SEGMENT_SIZE);
+
         if( yrmcds::g_config.lock_memory() ) {
             if( ::mlockall( MCL_CURRENT | MCL_FUTURE ) == -1 )
                 cybozu::throw_unix_error(errno, "mlockall");
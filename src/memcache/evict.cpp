@@ -0,0 +1,136 @@
+// (C) 2026 Cybozu.
+
+#include "evict.hpp"
+#include "policy.hpp"
+#include "replication.hpp"
+#include "../global.hpp"
+
+#include <atomic>
+#include <limits>
+
+namespace {
+
+const std::memory_order relaxed = std::memory_order_relaxed;
+
+std::atomic<bool> g_evicting(false);
+std::atomic<bool> g_requested(false);
+std::atomic<std::size_t> g_cursor(0);
+
+// An eviction candidate.
+struct candidate {
+    bool found = false;
+    std::size_t bucket = 0;
+    bool demoted = false;
+    std::uint64_t score = 0;
+    std::uint64_t hash = 0;
+
+    // Return `true` if `obj` should be evicted before this candidate.
+    bool colder(bool obj_demoted, std::uint64_t obj_score) const noexcept {
+        if( ! found ) return true;
+        if( obj_demoted != demoted ) return demoted;
+        return obj_score > score;
+    }
+};
+
+} // anonymous namespace
+
+namespace yrmcds { namespace memcache {
+
+namespace {
+
+// Evict objects.
+// @step  `true` to run at most `EVICT_STEP_ROUNDS` rounds until the
+//        usage falls under `memory_limit`.
+std::uint32_t evict(cybozu::hash_map<object>& hash,
+                    const std::vector<repl_socket*>& slaves, bool step) {
+    if( g_evicting.exchange(true, std::memory_order_acquire) )
+        return 0;
+
+    const std::size_t buckets = hash.bucket_count();
+    std::size_t cursor = g_cursor.load(relaxed);
+    std::uint32_t evictions = 0;
+
+    yrmcds::memcache::policy& policy = current_policy();
+    const std::uint32_t now =
+        static_cast<std::uint32_t>(g_current_time.load(relaxed));
+    std::uint64_t evicted_bytes = 0;
+
+    std::size_t rounds = 0;
+    while( step ? (memory_exceeded() && rounds < EVICT_STEP_ROUNDS)
+                : memory_above_low_watermark() ) {
+        ++ rounds;
+        candidate victim;
+        bool non_empty;
+        auto sample = [&victim,&non_empty,&cursor,&policy,now](
+            const cybozu::hash_key& k, object& obj) {
+            non_empty = true;
+            if( obj.locked() ) return;
+            // objects stale since flush_all go first.
+            std::uint64_t score = obj.stale() ?
+                std::numeric_limits<std::uint64_t>::max() :
+                policy.score(k, obj, now);
+            if( ! victim.colder(obj.demoted(), score) ) return;
+            victim.found = true;
+            victim.bucket = cursor;
+            victim.demoted = obj.demoted();
+            victim.score = score;
+            victim.hash = k.hash();
+        };
+        std::size_t sampled = 0;
+        for( std::size_t i = 0; i < buckets && sampled < EVICT_SAMPLES; ++i ) {
+            cursor = (cursor + 1) % buckets;
+            if( ! hash.occupied(cursor) )
+                continue;
+            non_empty = false;
+            (hash.begin() + cursor)->foreach(sample);
+            if( non_empty )
+                ++ sampled;
+        }
+        if( ! victim.found )
+            break;
+
+        bool evicted = false;
+        auto pred = [&victim,&evicted,&evicted_bytes,&slaves](
+            const cybozu::hash_key& k, object& obj) -> bool {
+            if( evicted || obj.locked() || k.hash() != victim.hash )
+                return false;
+            evicted = true;
+            evicted_bytes += obj.charge();
+            // slaves expire and flush objects by themselves.
+            // The deletion is sent while the bucket is locked so that
+            // it is ordered with updates of the same key.
+            if( ! slaves.empty() && ! obj.expired() )
+                repl_delete(slaves, k);
+            return true;
+        };
+        (hash.begin() + victim.bucket)->gc(pred);
+        if( evicted )
+            ++ evictions;
+    }
+
+    g_cursor.store(cursor, relaxed);
+    g_stats.total_evictions.fetch_add(evictions, relaxed);
+    g_stats.evicted_bytes.fetch_add(evicted_bytes, relaxed);
+    g_evicting.store(false, std::memory_order_release);
+    return evictions;
+}
+
+} // anonymous namespace
+
+std::uint32_t evict_objects(cybozu::hash_map<object>& hash,
+                            const std::vector<repl_socket*>& slaves) {
+    g_requested.store(false, relaxed);
+    return evict(hash, slaves, false);
+}
+
+std::uint32_t evict_some(cybozu::hash_map<object>& hash,
+                         const std::vector<repl_socket*>& slaves) {
+    g_requested.store(true, relaxed);
+    return evict(hash, slaves, true);
+}
+
+bool eviction_requested() noexcept {
+    return g_requested.load(relaxed);
+}
+
+}} // namespace yrmcds::memcache
@@ -0,0 +1,71 @@
+// Eviction of objects.
+// (C) 2026 Cybozu.
+
+#ifndef YRMCDS_MEMCACHE_EVICT_HPP
+#define YRMCDS_MEMCACHE_EVICT_HPP
+
+#include "../config.hpp"
+#include "../constants.hpp"
+#include "object.hpp"
+#include "sockets.hpp"
+#include "stats.hpp"
+
+#include <cybozu/hash_map.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace yrmcds { namespace memcache {
+
+// Return `true` if objects use more memory than `memory_limit`.
+//
+// `memory_limit` is the high watermark to start eviction.
+inline bool memory_exceeded() noexcept {
+    return g_stats.used_memory.load() >
+        static_cast<std::int64_t>(g_config.memory_limit());
+}
+
+// Return `true` if objects use more memory than the low watermark.
+inline bool memory_above_low_watermark() noexcept {
+    return g_stats.used_memory.load() >
+        static_cast<std::int64_t>(g_config.memory_limit() / 100 *
+                                  EVICT_LOW_WATERMARK);
+}
+
+// Evict objects until the memory usage falls under the low watermark.
+// @hash    The object hash.
+// @slaves  Slaves to replicate deletions.
+//
+// This implements sampled eviction.  Each round samples
+// `EVICT_SAMPLES` non-empty buckets following a cursor shared by all
+// callers, and evicts the object scored highest by <current_policy>.
+// Locked objects are never evicted, and objects demoted to the second
+// storage tier are evicted only if no other objects are sampled.
+// Objects made stale by `flush_all` are scored highest.
+//
+// This is called by the GC thread when the usage exceeds
+// `memory_limit`.  Only one thread evicts at a time; others return
+// immediately.
+//
+// @return  The number of evicted objects.
+std::uint32_t evict_objects(cybozu::hash_map<object>& hash,
+                            const std::vector<repl_socket*>& slaves);
+
+// Evict a few objects until the memory usage falls under `memory_limit`.
+// @hash    The object hash.
+// @slaves  Slaves to replicate deletions.
+//
+// This is a bounded variant of <evict_objects> for worker threads.
+// It runs at most `EVICT_STEP_ROUNDS` rounds, and asks the GC thread
+// to do the rest by <eviction_requested>.
+//
+// @return  The number of evicted objects.
+std::uint32_t evict_some(cybozu::hash_map<object>& hash,
+                         const std::vector<repl_socket*>& slaves);
+
+// Return `true` if <evict_some> has run since the last <evict_objects>.
+bool eviction_requested() noexcept;
+
+}} // namespace yrmcds::memcache
+
+#endif // YRMCDS_MEMCACHE_EVICT_HPP
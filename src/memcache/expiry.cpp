@@ -0,0 +1,99 @@
+// (C) 2026 Cybozu.
+
+#include "expiry.hpp"
+
+namespace {
+
+const std::memory_order relaxed = std::memory_order_relaxed;
+
+} // anonymous namespace
+
+namespace yrmcds { namespace memcache {
+
+expiry_wheel g_expiry;
+
+expiry_wheel::slot& expiry_wheel::target(const entry& e, std::time_t now) {
+    if( now == 0 ) {
+        // not started yet.
+        return m_overflow;
+    }
+    if( e.exptime <= now )
+        return m_level0[(now + 1) & (L0_SLOTS - 1)];
+    if( e.exptime - now <= static_cast<std::time_t>(L0_SLOTS) ) {
+        // the slot of `now + L0_SLOTS` has been drained at `now`.
+        return m_level0[e.exptime & (L0_SLOTS - 1)];
+    }
+    if( e.exptime - now < static_cast<std::time_t>(L0_SLOTS * L1_SLOTS) )
+        return m_level1[(e.exptime >> L0_BITS) & (L1_SLOTS - 1)];
+    return m_overflow;
+}
+
+void expiry_wheel::put(const entry& e, std::time_t now) {
+    slot& s = target(e, now);
+    std::lock_guard<cybozu::spinlock> g(s.lock);
+    s.entries.push_back(e);
+}
+
+void expiry_wheel::take(slot& s, std::vector<entry>& entries) {
+    entries.clear();
+    std::lock_guard<cybozu::spinlock> g(s.lock);
+    entries.swap(s.entries);
+}
+
+void expiry_wheel::add(std::uint64_t hash, std::time_t exptime) {
+    const entry e{hash, exptime};
+    while( true ) {
+        std::time_t now = m_now.load(relaxed);
+        slot& s = target(e, now);
+        std::lock_guard<cybozu::spinlock> g(s.lock);
+        // <expire> may have advanced the time and drained the slot
+        // meanwhile.  It stores the time before taking a slot, so
+        // the time read under the slot lock is not stale.
+        if( m_now.load(relaxed) != now )
+            continue;
+        s.entries.push_back(e);
+        break;
+    }
+    m_size.fetch_add(1, relaxed);
+}
+
+void expiry_wheel::expire(std::time_t now,
+                          std::vector<std::uint64_t>& hashes) {
+    std::vector<entry> entries;
+    std::time_t t = m_now.load(relaxed);
+    if( t == 0 ) {
+        m_now.store(now - 1, relaxed);
+        take(m_overflow, entries);
+        for( const entry& e: entries )
+            put(e, now - 1);
+        t = now - 1;
+    }
+
+    std::size_t collected = 0;
+    while( t < now ) {
+        ++ t;
+        m_now.store(t, relaxed);
+        if( (t & (L0_SLOTS - 1)) == 0 ) {
+            // cascade the overflow list and the second level.
+            take(m_overflow, entries);
+            for( const entry& e: entries )
+                put(e, t - 1);
+            take(m_level1[(t >> L0_BITS) & (L1_SLOTS - 1)], entries);
+            for( const entry& e: entries )
+                put(e, t - 1);
+        }
+        take(m_level0[t & (L0_SLOTS - 1)], entries);
+        for( const entry& e: entries ) {
+            if( e.exptime > t ) {
+                // registered while the time was advancing.
+                put(e, t);
+                continue;
+            }
+            hashes.push_back(e.hash);
+            ++ collected;
+        }
+    }
+    m_size.fetch_sub(collected, relaxed);
+}
+
+}} // namespace yrmcds::memcache
@@ -0,0 +1,104 @@
+// Expiration timer wheel.
+// (C) 2026 Cybozu.
+
+#ifndef YRMCDS_MEMCACHE_EXPIRY_HPP
+#define YRMCDS_MEMCACHE_EXPIRY_HPP
+
+#include "object.hpp"
+
+#include <cybozu/hash_map.hpp>
+#include <cybozu/spinlock.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <vector>
+
+namespace yrmcds { namespace memcache {
+
+// A hierarchical timing wheel of expiration times.
+//
+// Worker threads register the key hash of an object with its
+// expiration time, and GC thread collects hashes of keys whose
+// expiration time has come.  The first level has a slot for each
+// second of the next `L0_SLOTS` seconds, and the second level has
+// a slot for each `L0_SLOTS` seconds.  Entries further in the future
+// are kept in an overflow list.  Entries move to lower levels as the
+// time advances.
+//
+// Entries are hints: objects may have been removed or their expiration
+// time may have been changed before the entries are collected.
+class expiry_wheel {
+public:
+    static const std::size_t L0_BITS = 12;
+    static const std::size_t L0_SLOTS = 1 << L0_BITS;
+    static const std::size_t L1_SLOTS = 1024;
+
+    expiry_wheel(): m_level0(L0_SLOTS), m_level1(L1_SLOTS) {}
+    expiry_wheel(const expiry_wheel&) = delete;
+    expiry_wheel& operator=(const expiry_wheel&) = delete;
+
+    // Register an expiration time.
+    // @hash     The hash value of the key.
+    // @exptime  The expiration time.
+    //
+    // This can be called concurrently by any threads.
+    void add(std::uint64_t hash, std::time_t exptime);
+
+    // Collect hashes whose expiration time is not later than `now`.
+    // @now     The current time.
+    // @hashes  Collected hashes are appended to this.
+    //
+    // This may be called only by a single thread.
+    void expire(std::time_t now, std::vector<std::uint64_t>& hashes);
+
+    // Return the number of registered entries.
+    std::size_t size() const noexcept {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct entry {
+        std::uint64_t hash;
+        std::time_t exptime;
+    };
+    struct slot {
+        cybozu::spinlock lock;
+        std::vector<entry> entries;
+    };
+
+    slot& target(const entry& e, std::time_t now);
+    void put(const entry& e, std::time_t now);
+    static void take(slot& s, std::vector<entry>& entries);
+
+    std::atomic<std::time_t> m_now{0}; // the last collected second
+    std::atomic<std::size_t> m_size{0};
+    std::vector<slot> m_level0;
+    std::vector<slot> m_level1;
+    slot m_overflow;
+};
+
+// The expiration timer wheel of the object hash.
+extern expiry_wheel g_expiry;
+
+// Register the expiration time of an object to <g_expiry>.
+// @k    The key of the object.
+// @obj  The object.
+//
+// This must be called with the bucket of `k` locked.  An object has
+// at most one entry that expires no later than the object so that
+// repeated updates of the same object do not bloat the wheel.
+inline void schedule_expiry(const cybozu::hash_key& k, object& obj) {
+    std::uint32_t exptime = obj.exptime();
+    if( exptime == 0 ) return;
+    std::uint32_t scheduled = obj.scheduled();
+    if( scheduled != 0 && scheduled <= exptime ) return;
+    obj.set_scheduled(exptime);
+    g_expiry.add(k.hash(), exptime);
+}
+
+}} // namespace yrmcds::memcache
+
+#endif // YRMCDS_MEMCACHE_EXPIRY_HPP
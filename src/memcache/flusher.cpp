@@ -0,0 +1,105 @@
+// (C) 2026 Cybozu.
+
+#include "flusher.hpp"
+#include "stats.hpp"
+
+#include <cybozu/logger.hpp>
+
+#include <chrono>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+const std::memory_order relaxed = std::memory_order_relaxed;
+
+// From linux/ioprio.h, which is not always installed.
+const int IOPRIO_WHO_PROCESS = 1;
+const int IOPRIO_CLASS_IDLE = 3;
+const int IOPRIO_CLASS_SHIFT = 13;
+
+void lower_priority() {
+    pid_t tid = static_cast<pid_t>(::syscall(SYS_gettid));
+    if( ::setpriority(PRIO_PROCESS, tid, 19) == -1 )
+        cybozu::logger::debug() << "setpriority failed for page flusher.";
+    if( ::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid,
+                  IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) == -1 )
+        cybozu::logger::debug() << "ioprio_set failed for page flusher.";
+}
+
+} // anonymous namespace
+
+namespace yrmcds { namespace memcache {
+
+page_flusher::~page_flusher() {
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        m_stop = true;
+    }
+    m_cond.notify_one();
+    if( m_thread.joinable() )
+        m_thread.join();
+    for( auto& f: m_files )
+        ::close(f.fd);
+}
+
+void page_flusher::add(int fd, std::size_t length) {
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        m_files.push_back({fd, length});
+    }
+    m_cond.notify_one();
+}
+
+void page_flusher::run() {
+    lower_priority();
+
+    std::vector<file> files;
+    while( true ) {
+        {
+            std::unique_lock<std::mutex> g(m_lock);
+            m_cond.wait(g, [this]{ return m_stop || ! m_files.empty(); });
+            if( m_files.empty() )
+                return;
+            files.swap(m_files);
+        }
+        flush(files);
+        files.clear();
+    }
+}
+
+void page_flusher::flush(const std::vector<file>& files) {
+    using namespace std::chrono;
+    auto t1 = steady_clock::now();
+
+    // Start writeback of all files first so that the I/O is merged.
+    for( auto& f: files )
+        ::sync_file_range(f.fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+
+    const std::size_t page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::uint64_t pages = 0;
+    for( auto& f: files ) {
+        if( ::sync_file_range(f.fd, 0, 0,
+                              SYNC_FILE_RANGE_WAIT_BEFORE |
+                              SYNC_FILE_RANGE_WRITE |
+                              SYNC_FILE_RANGE_WAIT_AFTER) == 0 &&
+            ::posix_fadvise(f.fd, 0, 0, POSIX_FADV_DONTNEED) == 0 )
+            pages += (f.length + page_size - 1) / page_size;
+        ::close(f.fd);
+    }
+
+    auto t2 = steady_clock::now();
+    std::uint64_t us = static_cast<std::uint64_t>(
+        duration_cast<microseconds>(t2-t1).count() );
+    g_stats.flushed_files.fetch_add(files.size(), relaxed);
+    g_stats.dropped_pages.fetch_add(pages, relaxed);
+    g_stats.last_flush_elapsed.store(us, relaxed);
+    g_stats.total_flush_elapsed.fetch_add(us, relaxed);
+    cybozu::logger::debug() << "Page flush end: elapsed=" << us
+                            << "us, files=" << files.size()
+                            << ", pages=" << pages;
+}
+
+}} // namespace yrmcds::memcache
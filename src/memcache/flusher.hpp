@@ -0,0 +1,56 @@
+// Page cache flusher for temporary files.
+// (C) 2026 Cybozu.
+
+#ifndef YRMCDS_MEMCACHE_FLUSHER_HPP
+#define YRMCDS_MEMCACHE_FLUSHER_HPP
+
+#include <cybozu/thread.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace yrmcds { namespace memcache {
+
+// A thread to purge temporary file contents from the page cache.
+//
+// Files are flushed in batches: writeback of all queued files is
+// started at once by `sync_file_range`, then their pages are dropped
+// by `posix_fadvise(POSIX_FADV_DONTNEED)`.  The thread runs with the
+// lowest CPU and I/O priority.  Files queued before destruction are
+// flushed before the thread exits.
+class page_flusher final: public cybozu::thread_base<page_flusher> {
+public:
+    page_flusher() = default;
+    page_flusher(const page_flusher&) = delete;
+    page_flusher& operator=(const page_flusher&) = delete;
+    page_flusher(page_flusher&&) = delete;
+    page_flusher& operator=(page_flusher&&) = delete;
+    ~page_flusher();
+
+    // Queue a file to be flushed.
+    // @fd      A file descriptor.  Ownership is transferred.
+    // @length  The length of the file.
+    void add(int fd, std::size_t length);
+
+    void run();
+
+private:
+    struct file {
+        int fd;
+        std::size_t length;
+    };
+
+    void flush(const std::vector<file>& files);
+
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    // the following members are guarded by m_lock.
+    std::vector<file> m_files;
+    bool m_stop = false;
+};
+
+}} // namespace yrmcds::memcache
+
+#endif // YRMCDS_MEMCACHE_FLUSHER_HPP
@@ -1,15 +1,99 @@
 // (C) 2013 Cybozu.
 
 #include "../config.hpp"
+#include "evict.hpp"
+#include "expiry.hpp"
 #include "gc.hpp"
 #include "replication.hpp"
 #include "stats.hpp"
 
 #include <algorithm>
 #include <cstdlib>
+#include <functional>
+#include <memory>
+#include <limits>
+#include <thread>
+
+#ifdef USE_TCMALLOC
+#  ifdef TCMALLOC_IN_GOOGLE
+#    include <google/malloc_extension.h>
+#  else
+#    include <gperftools/malloc_extension.h>
+#  endif
+#endif
+
+namespace {
+
+const std::memory_order relaxed = std::memory_order_relaxed;
+
+// Return `true` if most worker threads are busy.
+inline bool workers_saturated() noexcept {
+    return yrmcds::memcache::g_stats.busy_workers.sum() * 4 >=
+        static_cast<std::int64_t>(yrmcds::g_config.workers()) * 3;
+}
+
+} // anonymous namespace
 
 namespace yrmcds { namespace memcache {
 
+gc_helper::~gc_helper() {
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if( m_thread.joinable() )
+        m_thread.join();
+}
+
+void gc_helper::post(const std::function<void()>& job) {
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        m_job = job;
+    }
+    m_cond.notify_all();
+}
+
+void gc_helper::wait() {
+    std::unique_lock<std::mutex> g(m_lock);
+    m_cond.wait(g, [this]{ return ! m_job; });
+}
+
+void gc_helper::run() {
+    while( true ) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> g(m_lock);
+            m_cond.wait(g, [this]{ return m_stop || m_job; });
+            if( ! m_job )
+                return;
+            job = m_job;
+        }
+        job();
+        {
+            std::lock_guard<std::mutex> g(m_lock);
+            m_job = nullptr;
+        }
+        m_cond.notify_all();
+    }
+}
+
+gc_state::gc_state(std::size_t buckets, unsigned int partitions):
+    m_buckets(buckets),
+    m_segment_objects((buckets + GC_SLICE_BUCKETS - 1) / GC_SLICE_BUCKETS) {
+    std::size_t segments = m_segment_objects.size();
+    if( partitions > segments )
+        partitions = static_cast<unsigned int>(std::max(segments,
+                                                        std::size_t(1)));
+    m_partitions.reserve(partitions);
+    for( unsigned int i = 0; i < partitions; ++i ) {
+        std::size_t begin = segments * i / partitions * GC_SLICE_BUCKETS;
+        std::size_t end = segments * (i + 1) / partitions * GC_SLICE_BUCKETS;
+        m_partitions.emplace_back(std::min(begin, buckets),
+                                  std::min(end, buckets));
+    }
+}
+
 void gc_thread::run() {
     if( ! cybozu::has_ip_address(g_config.vip()) ) {
         cybozu::logger::error() << "VIP has been lost.  Exiting quickly...";
@@ -18,105 +102,281 @@ void gc_thread::run() {
 
     using namespace std::chrono;
     auto t1 = steady_clock::now();
-    gc();
-    if( ! m_new_slaves.empty() )
-        cybozu::logger::info() << "Initial replication completed for "
-                               << m_new_slaves.size() << " new slave(s).";
-    g_stats.objects.store(m_objects, std::memory_order_relaxed);
-    g_stats.objects_under_1k.store(m_objects_under_1k, std::memory_order_relaxed);
-    g_stats.objects_under_4k.store(m_objects_under_4k, std::memory_order_relaxed);
-    g_stats.objects_under_16k.store(m_objects_under_16k, std::memory_order_relaxed);
-    g_stats.objects_under_64k.store(m_objects_under_64k, std::memory_order_relaxed);
-    g_stats.objects_under_256k.store(m_objects_under_256k, std::memory_order_relaxed);
-    g_stats.objects_under_1m.store(m_objects_under_1m, std::memory_order_relaxed);
-    g_stats.objects_under_4m.store(m_objects_under_4m, std::memory_order_relaxed);
-    g_stats.objects_huge.store(m_objects_huge, std::memory_order_relaxed);
-    g_stats.used_memory.store(m_used_memory, std::memory_order_relaxed);
-    g_stats.conflicts.store(m_conflicts, std::memory_order_relaxed);
-    g_stats.gc_count.fetch_add(1, std::memory_order_relaxed);
-    g_stats.oldest_age.store(m_oldest_age, std::memory_order_relaxed);
-    g_stats.largest_object_size.store(m_largest_object_size, std::memory_order_relaxed);
-    g_stats.last_expirations.store(m_last_expirations, std::memory_order_relaxed);
-    g_stats.last_evictions.store(m_last_evictions, std::memory_order_relaxed);
-    g_stats.total_evictions.fetch_add(m_last_evictions, std::memory_order_relaxed);
+    std::time_t now = g_current_time.load(relaxed);
+    std::time_t elapsed = (m_state.m_last_run == 0) ? 1 :
+        (now - m_state.m_last_run);
+    m_state.m_last_run = now;
+    gc(std::max(elapsed, static_cast<std::time_t>(1)));
+
+#ifdef USE_TCMALLOC
+    // cross-check the accounted memory with tcmalloc.
+    std::size_t allocated = 0;
+    MallocExtension::instance()->GetNumericProperty(
+        "generic.current_allocated_bytes", &allocated);
+    g_stats.allocated_bytes.store(allocated, relaxed);
+#endif
+    g_stats.last_expirations.store(m_last_expirations, relaxed);
+    g_stats.last_evictions.store(m_last_evictions, relaxed);
+    g_stats.last_demotions.store(m_last_demotions, relaxed);
 
     auto t2 = steady_clock::now();
     std::uint64_t us = static_cast<std::uint64_t>(
         duration_cast<microseconds>(t2-t1).count() );
-    g_stats.last_gc_elapsed.store(us, std::memory_order_relaxed);
-    g_stats.total_gc_elapsed.fetch_add(us, std::memory_order_relaxed);
+    g_stats.last_gc_elapsed.store(us, relaxed);
+    g_stats.total_gc_elapsed.fetch_add(us, relaxed);
     cybozu::logger::debug() << "GC end: elapsed=" << us
                             << "us, expired=" << m_last_expirations
                             << ", evicted=" << m_last_evictions
-                            << ", survived=" << m_objects;
+                            << ", demoted=" << m_last_demotions;
 }
 
-void gc_thread::gc() {
-    std::time_t t = g_stats.flush_time.load();
-    bool flush = (t != 0) && (std::time(nullptr) >= t);
-    unsigned int evict_age = 0;
-    if( (! flush) &&
-        (g_stats.used_memory.load(std::memory_order_relaxed) >
-         g_config.memory_limit()) ) {
-        unsigned int oldest_age =
-            g_stats.oldest_age.load(std::memory_order_relaxed);
-        unsigned int one_hour = 3600U / g_config.gc_interval() + 1;
-        if( oldest_age < (one_hour * 2) ) {
-            evict_age = std::max(1U, oldest_age / 2);
-        } else {
-            evict_age = oldest_age - one_hour;
+void gc_thread::expired_buckets(std::vector<std::uint64_t>& buckets) {
+    g_expiry.expire(g_current_time.load(relaxed), buckets);
+    const std::size_t n = m_hash.bucket_count();
+    for( std::uint64_t& h: buckets )
+        h %= n;
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+}
+
+void gc_thread::gc(std::time_t elapsed) {
+    auto& partitions = m_state.m_partitions;
+    // stale objects left by flush_all are swept by a pass.
+    std::uint32_t generation =
+        g_generation.current(g_current_time.load(relaxed));
+    if( generation != m_state.m_generation ) {
+        m_state.m_generation = generation;
+        for( auto& part: partitions )
+            part.flush_remaining = part.end - part.begin;
+    }
+    bool sweep = false;
+    for( auto& part: partitions )
+        sweep = sweep || (part.flush_remaining != 0);
+
+    // workers evict only a few objects; evict the rest down to
+    // the low watermark here.
+    if( memory_exceeded() || eviction_requested() ) {
+        m_last_evictions = evict_objects(m_hash, m_slaves);
+        cybozu::logger::warning() << "Evicted " << m_last_evictions
+                                  << " objects";
+    }
+
+    std::vector<std::uint64_t> expired;
+    expired_buckets(expired);
+
+    // Pace the scan so that a pass takes GC_PASS_INTERVALS gc_intervals.
+    const std::time_t interval = std::max(g_config.gc_interval(), 1U);
+    gc_plan plan;
+    plan.ratio = static_cast<double>(elapsed) / (interval * GC_PASS_INTERVALS);
+    bool pressure = memory_above_low_watermark();
+    if( pressure || sweep )
+        plan.ratio *= 4;
+    plan.urgent = m_state.replicating();
+    // Demote cold objects while the memory is under pressure.
+    plan.demote = (! sweep) && tier_store::enabled() && pressure;
+    plan.flush_budget = g_config.page_flush_budget();
+    if( plan.flush_budget == 0 ) {
+        plan.flush_budget = std::numeric_limits<std::size_t>::max();
+    } else {
+        plan.flush_budget = plan.flush_budget / interval * elapsed /
+            partitions.size();
+    }
+    plan.expired = &expired;
+
+    for( auto& s: m_state.m_new_slaves )
+        m_new_slaves.push_back(s.slave);
+
+    std::vector<gc_result> results(partitions.size());
+    auto& helpers = m_state.m_helpers;
+    while( helpers.size() + 1 < partitions.size() ) {
+        helpers.emplace_back(new gc_helper);
+        helpers.back()->start();
+    }
+    for( std::size_t i = 1; i < partitions.size(); ++i ) {
+        gc_partition& part = partitions[i];
+        gc_result& result = results[i];
+        helpers[i - 1]->post([this,&part,&plan,&result] {
+                scan(part, plan, result);
+            });
+    }
+    scan(partitions[0], plan, results[0]);
+    for( std::size_t i = 1; i < partitions.size(); ++i )
+        helpers[i - 1]->wait();
+    m_tier.flush(true);
+
+    std::size_t scanned = 0;
+    std::uint32_t objects = 0;
+    bool pass_done = true;
+    for( std::size_t i = 0; i < partitions.size(); ++i ) {
+        m_last_expirations += results[i].expirations;
+        m_last_demotions += results[i].demotions;
+        scanned += results[i].scanned;
+        objects += partitions[i].objects;
+        pass_done = pass_done && partitions[i].pass_done;
+    }
+    g_stats.objects.store(objects, relaxed);
+    if( pass_done )
+        end_pass();
+    if( ! m_new_slaves.empty() )
+        end_initial_replication(scanned);
+}
+
+void gc_thread::end_initial_replication(std::size_t scanned) {
+    auto& new_slaves = m_state.m_new_slaves;
+    for( auto it = new_slaves.begin(); it != new_slaves.end(); ) {
+        if( it->remaining > scanned ) {
+            it->remaining -= scanned;
+            ++it;
+            continue;
         }
-        cybozu::logger::warning() << "Evicting object of "
-                                  << evict_age << " gc old";
+        cybozu::logger::info() << "Initial replication completed for "
+                               << "a new slave.";
+        it = new_slaves.erase(it);
     }
+}
 
-    auto pred =
-        [this,flush,evict_age](const cybozu::hash_key& k, object& obj) ->bool {
-        if( flush && (! obj.locked()) ) {
-            if( ! m_slaves.empty() )
-                repl_delete(m_slaves, k);
-            return true;
+void gc_thread::end_segment(gc_partition& part, std::size_t segment) {
+    std::uint32_t& count = m_state.m_segment_objects[segment];
+    part.objects = part.objects - count + part.segment_running;
+    count = part.segment_running;
+    part.segment_running = 0;
+}
+
+void gc_thread::end_pass() {
+    gc_pass_stats p;
+    for( auto& part: m_state.m_partitions ) {
+        const gc_pass_stats& q = part.last_pass;
+        p.objects_under_1k += q.objects_under_1k;
+        p.objects_under_4k += q.objects_under_4k;
+        p.objects_under_16k += q.objects_under_16k;
+        p.objects_under_64k += q.objects_under_64k;
+        p.objects_under_256k += q.objects_under_256k;
+        p.objects_under_1m += q.objects_under_1m;
+        p.objects_under_4m += q.objects_under_4m;
+        p.objects_huge += q.objects_huge;
+        p.compressed_objects += q.compressed_objects;
+        for( std::size_t i = 0; i < SIZE_CLASSES; ++i ) {
+            p.size_class_bytes[i] += q.size_class_bytes[i];
+            p.size_class_stored[i] += q.size_class_stored[i];
         }
-        if( evict_age > 0 && obj.age() >= evict_age && (! obj.locked()) ) {
-            ++ m_last_evictions;
-            if( ! m_slaves.empty() )
-                repl_delete(m_slaves, k);
+        p.conflicts += q.conflicts;
+        p.oldest_age = std::max(p.oldest_age, q.oldest_age);
+        p.largest_object_size = std::max(p.largest_object_size,
+                                         q.largest_object_size);
+        part.pass_done = false;
+    }
+
+    g_stats.objects_under_1k.store(p.objects_under_1k, relaxed);
+    g_stats.objects_under_4k.store(p.objects_under_4k, relaxed);
+    g_stats.objects_under_16k.store(p.objects_under_16k, relaxed);
+    g_stats.objects_under_64k.store(p.objects_under_64k, relaxed);
+    g_stats.objects_under_256k.store(p.objects_under_256k, relaxed);
+    g_stats.objects_under_1m.store(p.objects_under_1m, relaxed);
+    g_stats.objects_under_4m.store(p.objects_under_4m, relaxed);
+    g_stats.objects_huge.store(p.objects_huge, relaxed);
+    g_stats.compressed_objects.store(p.compressed_objects, relaxed);
+    for( std::size_t i = 0; i < SIZE_CLASSES; ++i ) {
+        g_stats.size_class_bytes[i].store(p.size_class_bytes[i], relaxed);
+        g_stats.size_class_stored[i].store(p.size_class_stored[i], relaxed);
+    }
+    g_stats.conflicts.store(p.conflicts, relaxed);
+    g_stats.oldest_age.store(p.oldest_age, relaxed);
+    g_stats.largest_object_size.store(p.largest_object_size, relaxed);
+    g_stats.gc_count.fetch_add(1, relaxed);
+#ifdef USE_TCMALLOC
+    cybozu::logger::debug() << "Memory: accounted="
+                            << g_stats.used_memory.sum()
+                            << ", allocated="
+                            << g_stats.allocated_bytes.load(relaxed);
+#endif
+}
+
+void gc_thread::scan(gc_partition& part, const gc_plan& plan,
+                     gc_result& result) {
+    if( part.begin == part.end ) {
+        part.pass_done = true;
+        return;
+    }
+
+    // remove objects found by the expiration timer wheel.
+    std::time_t now = g_current_time.load(relaxed);
+    auto expire_pred =
+        [now,&result](const cybozu::hash_key& k, object& obj) -> bool {
+        // slaves expire and flush objects by themselves.
+        if( obj.expired() ) {
+            if( ! obj.stale() )
+                ++ result.expirations;
             return true;
         }
+        // the expiration time has been extended, or the object is locked.
+        if( obj.scheduled() != 0 && obj.scheduled() <= now ) {
+            obj.set_scheduled(0);
+            schedule_expiry(k, obj);
+        }
+        return false;
+    };
+    const std::vector<std::uint64_t>& expired = *plan.expired;
+    for( auto it = std::lower_bound(expired.begin(), expired.end(),
+                                    part.begin);
+         it != expired.end() && *it < part.end; ++it )
+        (m_hash.begin() + *it)->gc(expire_pred);
+
+    gc_pass_stats& p = part.pass;
+    std::size_t flush_budget = plan.flush_budget;
+    const bool demote = plan.demote;
+    int objects_in_bucket = 0;
+
+    auto pred = [this,&p,&part,&result,&flush_budget,
+                 &objects_in_bucket,demote](const cybozu::hash_key& k,
+                                            object& obj) -> bool {
+        // slaves expire and flush objects by themselves.
         if( obj.expired() ) {
-            ++ m_last_expirations;
-            if( ! m_slaves.empty() )
-                repl_delete(m_slaves, k);
+            if( ! obj.stale() )
+                ++ result.expirations;
             return true;
         }
 
-        obj.survive(m_flushers);
-        if( ++m_objects_in_bucket == 2 )
-            ++ m_conflicts;
-        ++ m_objects;
+        obj.survive();
+        obj.drop_cache(m_flusher, flush_budget);
+        if( obj.demoted() ) {
+            std::lock_guard<std::mutex> g(m_tier_lock);
+            obj.demote(m_tier); // move out of a sparse segment
+            m_tier.flush();
+        } else if( demote && obj.age() >= DEMOTE_AGE &&
+                   ! tier_store::full() ) {
+            std::lock_guard<std::mutex> g(m_tier_lock);
+            if( obj.demote(m_tier) )
+                ++ result.demotions;
+            m_tier.flush();
+        }
+        if( ++objects_in_bucket == 2 )
+            ++ p.conflicts;
+        ++ part.segment_running;
         std::size_t size = obj.size();
         if( size < 1024 ) {
-            ++ m_objects_under_1k;
+            ++ p.objects_under_1k;
         } else if( size < 4096 ) {
-            ++ m_objects_under_4k;
+            ++ p.objects_under_4k;
         } else if( size < (16 <<10) ) {
-            ++ m_objects_under_16k;
+            ++ p.objects_under_16k;
         } else if( size < (64 <<10) ) {
-            ++ m_objects_under_64k;
+            ++ p.objects_under_64k;
         } else if( size < (256 <<10) ) {
-            ++ m_objects_under_256k;
+            ++ p.objects_under_256k;
         } else if( size < (1 <<20) ) {
-            ++ m_objects_under_1m;
+            ++ p.objects_under_1m;
         } else if( size < (4 <<20) ) {
-            ++ m_objects_under_4m;
+            ++ p.objects_under_4m;
         } else {
-            ++ m_objects_huge;
+            ++ p.objects_huge;
         }
-        m_used_memory += sizeof(cybozu::hash_key) + k.length() + sizeof(object);
-        if( g_config.heap_data_limit() >= obj.size() )
-            m_used_memory += obj.size();
-        m_oldest_age = std::max(m_oldest_age, obj.age());
-        m_largest_object_size = std::max(m_largest_object_size, obj.size());
+        std::size_t stored_size = obj.stored_size();
+        p.size_class_bytes[size_class(size)] += size;
+        p.size_class_stored[size_class(size)] += stored_size;
+        if( obj.compressed() )
+            ++ p.compressed_objects;
+        p.oldest_age = std::max(p.oldest_age, obj.age());
+        p.largest_object_size = std::max(p.largest_object_size, obj.size());
         if( ! m_new_slaves.empty() )
             repl_object(m_new_slaves, k, obj, false);
         return false;
@@ -128,12 +388,27 @@ void gc_thread::gc() {
     constexpr std::uint64_t SLEEP_THRESHOLD = 10000;
     std::uint64_t sleep_sum = 0;
 
-    for( auto it = m_hash.begin(); it != m_hash.end(); ++it ) {
-        m_objects_in_bucket = 0;
-        it->gc(pred);
-        m_flushers.clear();
+    const std::size_t size = part.end - part.begin;
+    std::size_t target = size;
+    if( ! plan.urgent )
+        target = std::min(size,
+                          static_cast<std::size_t>(size * plan.ratio) + 1);
+    const std::size_t minimum = target / 4;
+    std::size_t& cursor = part.cursor;
+
+    for( std::size_t& scanned = result.scanned; scanned < target; ) {
+        bool flush = part.flush_remaining != 0;
+        // empty buckets are skipped by looking at the occupancy map only.
+        bool occupied = m_hash.occupied(cursor);
+        if( occupied ) {
+            objects_in_bucket = 0;
+            (m_hash.begin() + cursor)->gc(pred);
+        }
+        ++ scanned;
+        if( flush )
+            -- part.flush_remaining;
 
-        if( ! m_new_slaves.empty() ) {
+        if( occupied && ! m_new_slaves.empty() ) {
             sleep_sum += g_config.initial_repl_sleep_delay_usec();
             if( sleep_sum >= SLEEP_THRESHOLD ) {
                 std::this_thread::sleep_for(
@@ -141,11 +416,65 @@ void gc_thread::gc() {
                 sleep_sum = 0;
             }
         }
-    }
 
-    if( flush )
-        g_stats.flush_time.store(0);
+        ++ cursor;
+        if( cursor == part.end || (cursor % GC_SLICE_BUCKETS) == 0 )
+            end_segment(part, (cursor - 1) / GC_SLICE_BUCKETS);
+        if( cursor == part.end ) {
+            cursor = part.begin;
+            part.last_pass = p;
+            part.pass_done = true;
+            p = gc_pass_stats();
+        }
+
+        // yield to worker threads at the end of each slice.
+        if( (cursor % GC_SLICE_BUCKETS) == 0 && ! plan.urgent &&
+            scanned >= minimum && workers_saturated() )
+            break;
+    }
 }
 
+void slave_gc::run() {
+    std::time_t now = g_current_time.load(relaxed);
+    std::uint32_t expirations = 0;
+    auto pred = [now,&expirations](const cybozu::hash_key& k,
+                                   object& obj) -> bool {
+        if( obj.expired() ) {
+            ++ expirations;
+            return true;
+        }
+        if( obj.scheduled() != 0 && obj.scheduled() <= now ) {
+            obj.set_scheduled(0);
+            schedule_expiry(k, obj);
+        }
+        return false;
+    };
+
+    std::vector<std::uint64_t> expired;
+    g_expiry.expire(now, expired);
+    const std::size_t n = m_hash.bucket_count();
+    for( std::uint64_t h: expired )
+        (m_hash.begin() + (h % n))->gc(pred);
+
+    std::uint32_t generation = g_generation.current(now);
+    if( generation != m_generation ) {
+        m_generation = generation;
+        m_sweep_remaining = n;
+    }
+    if( m_sweep_remaining != 0 ) {
+        const std::size_t interval = std::max(g_config.gc_interval(), 1U);
+        std::size_t count = std::max(n / (interval * GC_PASS_INTERVALS),
+                                     GC_SLICE_BUCKETS);
+        count = std::min(count, m_sweep_remaining);
+        m_sweep_remaining -= count;
+        for( ; count != 0; --count ) {
+            if( m_hash.occupied(m_cursor) )
+                (m_hash.begin() + m_cursor)->gc(pred);
+            m_cursor = (m_cursor + 1) % n;
+        }
+    }
+
+    g_stats.repl_expired += expirations;
+}
 
 }} // namespace yrmcds::memcache
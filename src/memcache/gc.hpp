@@ -4,9 +4,12 @@
 #ifndef YRMCDS_MEMCACHE_GC_HPP
 #define YRMCDS_MEMCACHE_GC_HPP
 
+#include "../config.hpp"
+#include "flusher.hpp"
 #include "object.hpp"
 #include "sockets.hpp"
 #include "stats.hpp"
+#include "tier.hpp"
 
 #include <cybozu/hash_map.hpp>
 #include <cybozu/logger.hpp>
@@ -14,24 +17,162 @@
 
 #include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace yrmcds { namespace memcache {
 
+// Statistics accumulated over a pass of GC.
+struct gc_pass_stats {
+    std::uint32_t objects_under_1k = 0;
+    std::uint32_t objects_under_4k = 0;
+    std::uint32_t objects_under_16k = 0;
+    std::uint32_t objects_under_64k = 0;
+    std::uint32_t objects_under_256k = 0;
+    std::uint32_t objects_under_1m = 0;
+    std::uint32_t objects_under_4m = 0;
+    std::uint32_t objects_huge = 0;
+    std::uint32_t compressed_objects = 0;
+    std::uint64_t size_class_bytes[SIZE_CLASSES] = {};
+    std::uint64_t size_class_stored[SIZE_CLASSES] = {};
+    std::uint32_t conflicts = 0;
+    std::uint32_t oldest_age = 0;
+    std::size_t   largest_object_size = 0;
+};
+
+
+// A range of buckets scanned by a GC thread.
+//
+// Boundaries are aligned to `GC_SLICE_BUCKETS`.
+struct gc_partition {
+    std::size_t begin;
+    std::size_t end;
+    std::size_t cursor;
+    std::size_t flush_remaining = 0;
+    std::uint32_t objects = 0;          // objects in the partition
+    std::uint32_t segment_running = 0;  // objects in the current segment
+    gc_pass_stats pass;                 // the current pass
+    gc_pass_stats last_pass;            // the last completed pass
+    bool pass_done = false;
+
+    gc_partition(std::size_t begin_, std::size_t end_):
+        begin(begin_), end(end_), cursor(begin_) {}
+};
+
+
+// A thread to scan partitions of the hash for <gc_thread>.
+//
+// Helpers are kept in <gc_state> and woken for each GC run, so that
+// runs do not create and join threads every time.
+class gc_helper final: public cybozu::thread_base<gc_helper> {
+public:
+    gc_helper() = default;
+    gc_helper(const gc_helper&) = delete;
+    gc_helper& operator=(const gc_helper&) = delete;
+    gc_helper(gc_helper&&) = delete;
+    gc_helper& operator=(gc_helper&&) = delete;
+    ~gc_helper();
+
+    // Run `job` in the helper thread.
+    //
+    // The previous job must have been waited for by <wait>.
+    void post(const std::function<void()>& job);
+
+    // Wait for the job posted by <post> to finish.
+    void wait();
+
+    void run();
+
+private:
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    // the following members are guarded by m_lock.
+    std::function<void()> m_job;
+    bool m_stop = false;
+};
+
+
+// The state of the incremental GC kept across <gc_thread> runs.
+//
+// This is accessed by the running <gc_thread>, or by the reactor
+// thread while no <gc_thread> is running.
+class gc_state {
+public:
+    // @buckets     The number of buckets of the object hash.
+    // @partitions  The number of partitions to scan in parallel.
+    gc_state(std::size_t buckets, unsigned int partitions);
+    gc_state(const gc_state&) = delete;
+    gc_state& operator=(const gc_state&) = delete;
+
+    // Start initial replication to a new slave.
+    void add_new_slave(repl_socket* slave) {
+        m_new_slaves.push_back({slave, m_buckets});
+    }
+
+    // Stop initial replication to slaves not in `slaves`.
+    void retain_slaves(const std::vector<repl_socket*>& slaves) {
+        auto gone = [&slaves](const new_slave& s) {
+            return std::find(slaves.begin(), slaves.end(), s.slave) ==
+                slaves.end();
+        };
+        m_new_slaves.erase(std::remove_if(m_new_slaves.begin(),
+                                          m_new_slaves.end(), gone),
+                           m_new_slaves.end());
+    }
+
+    // Return `true` if initial replication is in progress.
+    bool replicating() const noexcept {
+        return ! m_new_slaves.empty();
+    }
+
+private:
+    struct new_slave {
+        repl_socket* slave;
+        std::size_t remaining; // buckets to be replicated
+    };
+
+    const std::size_t m_buckets;
+    std::time_t m_last_run = 0;
+    std::uint32_t m_generation = 0; // the generation last swept
+    std::vector<new_slave> m_new_slaves;
+    std::vector<std::uint32_t> m_segment_objects;
+    std::vector<gc_partition> m_partitions;
+    // helpers for partitions other than the first, started lazily.
+    std::vector<std::unique_ptr<gc_helper>> m_helpers;
+
+    friend class gc_thread;
+};
+
+
+// The GC thread.
+//
+// GC is incremental.  Each run removes objects found expired by the
+// expiration timer wheel, then scans a part of the hash following
+// the cursors in <gc_state>.  A pass over the whole hash is spread
+// over `gc_interval * GC_PASS_INTERVALS` seconds.  The scan goes
+// faster under memory pressure or after `flush_all`, and yields to
+// worker threads when most of them are busy.  Initial replication to
+// new slaves scans the whole hash as fast as possible.
+//
+// The hash is partitioned into `gc_threads` ranges of buckets.  Each
+// range is scanned by a dedicated thread with its own accumulators,
+// which are merged when all threads have finished.  The first range
+// is scanned by this thread, and the others by <gc_helper> threads.
 class gc_thread final: public cybozu::thread_base<gc_thread> {
 public:
     gc_thread(cybozu::hash_map<object>& m,
-              const std::vector<repl_socket*>& slaves,
-              const std::vector<repl_socket*>& new_slaves):
-        m_hash(m), m_slaves(slaves), m_new_slaves(new_slaves) {
-        for( repl_socket* s: new_slaves ) {
-            if( std::find(slaves.begin(), slaves.end(), s) == slaves.end() )
-                m_slaves.push_back(s);
-        }
-        m_flushers.reserve(10);
-    }
+              tier_store& tier,
+              page_flusher& flusher,
+              gc_state& state,
+              const std::vector<repl_socket*>& slaves):
+        m_hash(m), m_tier(tier), m_flusher(flusher), m_state(state),
+        m_slaves(slaves) {}
     gc_thread(const gc_thread&) = delete;
     gc_thread& operator=(const gc_thread&) = delete;
     gc_thread(gc_thread&&) = delete;
@@ -41,29 +182,63 @@ public:
     void run();
 
 private:
-    void gc();
+    // Results of a run in a partition.
+    struct gc_result {
+        std::uint32_t expirations = 0;
+        std::uint32_t demotions = 0;
+        std::size_t scanned = 0;
+    };
+
+    // Parameters of a run shared by all partitions.
+    struct gc_plan {
+        double ratio;       // ratio of buckets to be scanned
+        bool urgent;        // scan everything without yielding
+        bool demote;        // demote cold objects
+        std::size_t flush_budget;
+        const std::vector<std::uint64_t>* expired; // sorted bucket indices
+    };
+
+    void gc(std::time_t elapsed);
+    void expired_buckets(std::vector<std::uint64_t>& buckets);
+    void scan(gc_partition& part, const gc_plan& plan, gc_result& result);
+    void end_segment(gc_partition& part, std::size_t segment);
+    void end_pass();
+    void end_initial_replication(std::size_t scanned);
 
     cybozu::hash_map<object>& m_hash;
+    tier_store& m_tier;
+    std::mutex m_tier_lock;
+    page_flusher& m_flusher;
+    gc_state& m_state;
     std::vector<repl_socket*> m_slaves;
     std::vector<repl_socket*> m_new_slaves;
-    std::uint32_t m_objects = 0;
-    std::uint32_t m_objects_under_1k = 0;
-    std::uint32_t m_objects_under_4k = 0;
-    std::uint32_t m_objects_under_16k = 0;
-    std::uint32_t m_objects_under_64k = 0;
-    std::uint32_t m_objects_under_256k = 0;
-    std::uint32_t m_objects_under_1m = 0;
-    std::uint32_t m_objects_under_4m = 0;
-    std::uint32_t m_objects_huge = 0;
-    std::size_t   m_used_memory = 0;
-    std::uint32_t m_conflicts = 0;
-    std::uint32_t m_oldest_age = 0;
-    std::size_t   m_largest_object_size = 0;
     std::uint32_t m_last_expirations = 0;
     std::uint32_t m_last_evictions = 0;
+    std::uint32_t m_last_demotions = 0;
+};
+
+
+// Housekeeping on a slave.
+//
+// The master does not replicate removals of expired objects.  Slaves
+// instead expire objects by themselves with the expiration timer wheel
+// fed by replicated data, and sweep objects made stale by `flush_all`
+// incrementally.  This runs in the reactor thread, which is also the
+// only thread that applies replicated data on a slave.
+class slave_gc {
+public:
+    explicit slave_gc(cybozu::hash_map<object>& m): m_hash(m) {}
+    slave_gc(const slave_gc&) = delete;
+    slave_gc& operator=(const slave_gc&) = delete;
+
+    // Called every second.
+    void run();
 
-    int m_objects_in_bucket = 0;
-    std::vector<file_flusher> m_flushers;
+private:
+    cybozu::hash_map<object>& m_hash;
+    std::size_t m_cursor = 0;
+    std::size_t m_sweep_remaining = 0;
+    std::uint32_t m_generation = 0;
 };
 
 }} // namespace yrmcds::memcache
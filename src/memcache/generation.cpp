@@ -0,0 +1,9 @@
+// (C) 2026 Cybozu.
+
+#include "generation.hpp"
+
+namespace yrmcds { namespace memcache {
+
+generation_counter g_generation;
+
+}} // namespace yrmcds::memcache
@@ -0,0 +1,85 @@
+// Object generations for flush_all.
+// (C) 2026 Cybozu.
+
+#ifndef YRMCDS_MEMCACHE_GENERATION_HPP
+#define YRMCDS_MEMCACHE_GENERATION_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+namespace yrmcds { namespace memcache {
+
+// The generation of objects.
+//
+// Objects record the generation in which they were stored.  `flush_all`
+// advances the generation, possibly at a later time, so that objects
+// of older generations become invisible at once.  They are reclaimed
+// lazily by GC.
+//
+// The generation and the time of a pending flush are packed in a
+// single atomic variable so that readers always see a consistent pair.
+class generation_counter {
+public:
+    // Return the current generation.
+    // @now  The current time.
+    //
+    // This commits a pending flush whose time has come.
+    std::uint32_t current(std::time_t now) noexcept {
+        std::uint64_t s = m_state.load(std::memory_order_relaxed);
+        if( ! due(s, now) )
+            return generation(s);
+        std::uint32_t g = generation(s) + 1;
+        // failure means another thread has committed or replaced it.
+        m_state.compare_exchange_strong(s, g, std::memory_order_relaxed);
+        return g;
+    }
+
+    // Flush objects.
+    // @at   The time to flush objects.
+    // @now  The current time.
+    //
+    // If `at` is not later than `now`, the generation is advanced
+    // immediately.  Otherwise, the flush is pending until `at`.
+    // A pending flush is replaced by a new one.
+    void flush(std::time_t at, std::time_t now) noexcept {
+        std::uint64_t s = m_state.load(std::memory_order_relaxed);
+        std::uint64_t next;
+        do {
+            std::uint32_t g = generation(s) + (due(s, now) ? 1 : 0);
+            if( at <= now ) {
+                next = g + 1;
+            } else {
+                next = (static_cast<std::uint64_t>(at) << 32) | g;
+            }
+        } while( ! m_state.compare_exchange_weak(s, next,
+                                                 std::memory_order_relaxed) );
+    }
+
+    // Return the time of the pending flush, or 0 if none.
+    std::time_t pending() const noexcept {
+        return static_cast<std::time_t>(
+            m_state.load(std::memory_order_relaxed) >> 32);
+    }
+
+    void reset() noexcept {
+        m_state.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> m_state{0};
+
+    static std::uint32_t generation(std::uint64_t s) noexcept {
+        return static_cast<std::uint32_t>(s);
+    }
+    static bool due(std::uint64_t s, std::time_t now) noexcept {
+        std::time_t t = static_cast<std::time_t>(s >> 32);
+        return t != 0 && t <= now;
+    }
+};
+
+extern generation_counter g_generation;
+
+}} // namespace yrmcds::memcache
+
+#endif // YRMCDS_MEMCACHE_GENERATION_HPP
@@ -1,6 +1,8 @@
 // (C) 2014 Cybozu.
 
 #include "handler.hpp"
+#include "evict.hpp"
+#include "replication.hpp"
 #include "../constants.hpp"
 #include "../global.hpp"
 
@@ -16,97 +18,76 @@ const enum std::memory_order relaxed = std::memory_order_relaxed;
 namespace yrmcds { namespace memcache {
 
 handler::handler(const std::function<cybozu::worker*()>& finder,
-                 cybozu::reactor& reactor, syncer& sync)
+                 cybozu::reactor& reactor, reclaimer& rc)
     : m_finder(finder),
       m_reactor(reactor),
-      m_syncer(sync),
-      m_hash(g_config.buckets()) {
+      m_reclaimer(rc),
+      m_hash(g_config.buckets()),
+      m_gc_state(m_hash.bucket_count(), g_config.gc_threads()),
+      m_slave_gc(m_hash) {
     m_slaves.reserve(MAX_SLAVES);
     m_new_slaves.reserve(MAX_SLAVES);
 }
 
-bool handler::gc_ready(std::time_t now) {
-    if( m_gc_thread.get() != nullptr ) {
-        if( ! m_gc_thread->done() )
-            return false;
-        m_last_gc = now;
-        m_gc_thread = nullptr;
-    }
-
-    std::time_t t = g_stats.flush_time.load(relaxed);
-    if( t != 0 && now >= t )
+bool handler::gc_ready() {
+    if( m_gc_thread.get() == nullptr )
         return true;
+    if( ! m_gc_thread->done() )
+        return false;
+    m_gc_thread = nullptr;
 
-    // run GC immediately if the heap is over used.
-    if( g_stats.used_memory.load(relaxed) >
-        g_config.memory_limit() ) return true;
+    // give the reactor a chance to reclaim resources before
+    // the next GC run.
+    if( m_new_slaves.empty() && ! m_gc_state.replicating() ) {
+        m_consecutive_gcs = 0;
+        return false;
+    }
 
-    // Run GC when there are new slaves.
+    // new slaves cannot wait.
     // In case there are unstable slaves that try to connect to
     // the master too frequently, the number of consecutive GCs is limited.
     if( ! m_new_slaves.empty() && m_consecutive_gcs < MAX_CONSECUTIVE_GCS ) {
-        ++m_consecutive_gcs;
+        ++ m_consecutive_gcs;
         return true;
     }
-
-    if( now > (m_last_gc + g_config.gc_interval()) ) {
-        m_consecutive_gcs = 0;
-        return true;
-    }
-
     return false;
 }
 
 bool handler::reactor_gc_ready() const {
     if( m_gc_thread.get() != nullptr ) return false;
-    return m_new_slaves.empty();
+    return m_new_slaves.empty() && ! m_gc_state.replicating();
 }
 
 void handler::on_start() {
-    using cybozu::make_server_socket;
     cybozu::tcp_server_socket::wrapper w =
         [this](int s, const cybozu::ip_address&) {
-        return make_memcache_socket(s);
+        return make_memcache_socket(s, m_finder);
     };
-    if( g_config.bind_ip().empty() ) {
-        m_reactor.add_resource(
-            make_server_socket(nullptr, g_config.port(), w),
-            cybozu::reactor::EVENT_IN);
-    } else {
-        m_reactor.add_resource(
-            make_server_socket(g_config.vip(), g_config.port(), w, true),
-            cybozu::reactor::EVENT_IN);
-        for( auto& s: g_config.bind_ip() ) {
-            m_reactor.add_resource(
-                make_server_socket(s, g_config.port(), w),
-                cybozu::reactor::EVENT_IN);
-        }
-    }
+    add_listeners(m_reactor, g_config.port(), w, g_config.reactors() > 1);
+}
+
+void handler::on_reactor_start(cybozu::reactor& r,
+                               const std::function<cybozu::worker*()>& finder) {
+    cybozu::tcp_server_socket::wrapper w =
+        [this,&finder](int s, const cybozu::ip_address&) {
+        return make_memcache_socket(s, finder);
+    };
+    add_listeners(r, g_config.port(), w, true);
 }
 
 void handler::on_master_start() {
     m_is_slave = false;
+    m_flusher = std::unique_ptr<page_flusher>(new page_flusher);
+    m_flusher->start();
     cybozu::tcp_server_socket::wrapper w =
         [this](int s, const cybozu::ip_address&) {
         return make_repl_socket(s);
     };
-    if( g_config.bind_ip().empty() ) {
-        m_reactor.add_resource(
-            make_server_socket(nullptr, g_config.repl_port(), w),
-            cybozu::reactor::EVENT_IN);
-    } else {
-        m_reactor.add_resource(
-            make_server_socket(g_config.vip(), g_config.repl_port(), w, true),
-            cybozu::reactor::EVENT_IN);
-        for( auto& s: g_config.bind_ip() ) {
-            m_reactor.add_resource(
-                make_server_socket(s, g_config.repl_port(), w),
-                cybozu::reactor::EVENT_IN);
-        }
-    }
+    add_listeners(m_reactor, g_config.repl_port(), w);
 }
 
 void handler::on_master_interval() {
+    std::size_t n_slaves = m_slaves.size();
     for( auto it = m_slaves.begin(); it != m_slaves.end(); ) {
         repl_socket* slave = *it;
         if( ! slave->valid() ) {
@@ -124,13 +105,31 @@ void handler::on_master_interval() {
             it = m_slaves.erase(it);
             continue;
         }
+        if( slave->lagging() ) {
+            cybozu::logger::warning()
+                << "Replication to a slave (" << slave->peer_ip()
+                << ") lags by " << slave->queued_bytes()
+                << " bytes. Close the socket to let the slave resync.";
+            g_stats.repl_cutoffs.fetch_add(1, relaxed);
+            if( ! slave->invalidate() )
+                m_reactor.remove_resource(*slave);
+            it = m_slaves.erase(it);
+            continue;
+        }
         ++it;
     }
-
-    if( gc_ready(g_current_time.load(relaxed)) ) {
-        m_gc_thread = std::unique_ptr<gc_thread>(
-            new gc_thread(m_hash, m_slaves, m_new_slaves));
+    if( m_slaves.size() != n_slaves )
+        m_shared_slaves.set(m_slaves);
+
+    if( gc_ready() ) {
+        // new slaves must know a delayed flush before receiving objects.
+        repl_pending_flush(m_new_slaves);
+        for( repl_socket* s: m_new_slaves )
+            m_gc_state.add_new_slave(s);
         m_new_slaves.clear();
+        m_gc_state.retain_slaves(m_slaves);
+        m_gc_thread = std::unique_ptr<gc_thread>(
+            new gc_thread(m_hash, m_tier, *m_flusher, m_gc_state, m_slaves));
         m_gc_thread->start();
     }
 }
@@ -138,6 +137,7 @@ void handler::on_master_interval() {
 void handler::on_master_end() {
     if( m_gc_thread.get() != nullptr )
         m_gc_thread = nullptr; // join
+    m_flusher = nullptr; // join
 }
 
 bool handler::on_slave_start() {
@@ -172,6 +172,8 @@ void handler::on_slave_interval() {
     // ping to the master
     char c = '\0';
     m_repl_client_socket->send(&c, sizeof(c), true);
+
+    m_slave_gc.run();
 }
 
 void handler::on_slave_end() {
@@ -186,7 +188,8 @@ void handler::dump_stats() {
         logger::info() << "memcache replication stats: "
                        << g_stats.repl_created << " created, "
                        << g_stats.repl_updated << " updated, "
-                       << g_stats.repl_removed << " removed.";
+                       << g_stats.repl_removed << " removed, "
+                       << g_stats.repl_expired << " expired.";
         return;
     }
 
@@ -212,9 +215,12 @@ void handler::clear() {
     g_stats.repl_created = 0;
     g_stats.repl_updated = 0;
     g_stats.repl_removed = 0;
+    g_stats.repl_expired = 0;
 }
 
-std::unique_ptr<cybozu::tcp_socket> handler::make_memcache_socket(int s) {
+std::unique_ptr<cybozu::tcp_socket>
+handler::make_memcache_socket(int s,
+                              const std::function<cybozu::worker*()>& finder) {
     if( m_is_slave )
         return nullptr;
 
@@ -224,20 +230,22 @@ std::unique_ptr<cybozu::tcp_socket> handler::make_memcache_socket(int s) {
         return nullptr;
 
     return std::unique_ptr<cybozu::tcp_socket>(
-        new memcache_socket(s, m_finder, m_hash, m_slaves) );
+        new memcache_socket(s, finder, m_hash, m_shared_slaves) );
 }
 
 std::unique_ptr<cybozu::tcp_socket> handler::make_repl_socket(int s) {
     if( m_slaves.size() == MAX_SLAVES )
         return nullptr;
+    // refuse slaves until the reactor has had a chance to reclaim
+    // resources, or they would keep GC running.
+    if( m_consecutive_gcs >= MAX_CONSECUTIVE_GCS )
+        return nullptr;
     std::unique_ptr<repl_socket> t(
         new repl_socket(s, g_config.repl_bufsize(), m_finder) );
     repl_socket* pt = t.get();
     m_slaves.push_back(pt);
-    m_syncer.add_request(
-        std::unique_ptr<sync_request>(
-            new sync_request([this,pt]{ m_new_slaves.push_back(pt); })
-            ));
+    m_shared_slaves.set(m_slaves);
+    m_reclaimer.defer([this,pt]{ m_new_slaves.push_back(pt); });
 
     std::string addr = "unknown address";
     try {
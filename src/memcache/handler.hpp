@@ -5,7 +5,7 @@
 #define YRMCDS_MEMCACHE_HANDLER_HPP
 
 #include "../handler.hpp"
-#include "../sync.hpp"
+#include "../reclaimer.hpp"
 #include "gc.hpp"
 #include "object.hpp"
 #include "sockets.hpp"
@@ -22,11 +22,13 @@ class handler: public protocol_handler {
 public:
     handler(const std::function<cybozu::worker*()>& finder,
             cybozu::reactor& reactor,
-            syncer& syncer);
+            reclaimer& reclaimer);
     virtual void on_start() override;
     virtual void on_master_start() override;
     virtual void on_master_interval() override;
     virtual void on_master_end() override;
+    virtual void on_reactor_start(cybozu::reactor& r,
+                                  const std::function<cybozu::worker*()>& finder) override;
     virtual bool on_slave_start() override;
     virtual void on_slave_end() override;
     virtual void on_slave_interval() override;
@@ -35,19 +37,24 @@ public:
 
 private:
     void clear();
-    bool gc_ready(std::time_t now);
-    std::unique_ptr<cybozu::tcp_socket> make_memcache_socket(int s);
+    bool gc_ready();
+    std::unique_ptr<cybozu::tcp_socket>
+    make_memcache_socket(int s, const std::function<cybozu::worker*()>& finder);
     std::unique_ptr<cybozu::tcp_socket> make_repl_socket(int s);
 
     std::function<cybozu::worker*()> m_finder;
     cybozu::reactor& m_reactor;
-    syncer& m_syncer;
+    reclaimer& m_reclaimer;
     bool m_is_slave = true;
     cybozu::hash_map<object> m_hash;
-    std::time_t m_last_gc = 0;
+    tier_store m_tier;
+    std::unique_ptr<page_flusher> m_flusher = nullptr;
+    gc_state m_gc_state;
     std::unique_ptr<gc_thread> m_gc_thread = nullptr;
     int m_consecutive_gcs = 0;
+    slave_gc m_slave_gc;
     std::vector<repl_socket*> m_slaves;
+    slave_list m_shared_slaves; // a copy of m_slaves for client sockets
     std::vector<repl_socket*> m_new_slaves;
     repl_client_socket* m_repl_client_socket = nullptr;
 };
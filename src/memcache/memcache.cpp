@@ -3,9 +3,12 @@
 #include "../config.hpp"
 #include "../global.hpp"
 #include "memcache.hpp"
+#include "policy.hpp"
 #include "stats.hpp"
 
+#include <cybozu/segment_pool.hpp>
 #include <cybozu/util.hpp>
+#include <cybozu/worker.hpp>
 
 #include <algorithm>
 #include <cerrno>
@@ -29,6 +32,13 @@ const char LF = '\x0a';
 const char SP = '\x20';
 const char VALUE[] = "VALUE ";
 
+// Labels of size classes in "stats sizes".
+const char* const SIZE_CLASS_NAMES[] = {
+    "1024", "4096", "16384", "65536", "262144", "1048576", "4194304", "huge"
+};
+static_assert( sizeof(SIZE_CLASS_NAMES) / sizeof(SIZE_CLASS_NAMES[0]) ==
+               memcache::SIZE_CLASSES, "size class names mismatch" );
+
 const char STATUS_NOT_FOUND[] = "Not found";
 const char STATUS_EXISTS[] = "Exists";
 const char STATUS_TOO_LARGE[] = "Too large value";
@@ -76,6 +86,16 @@ inline std::time_t binary_exptime(const char* p) noexcept {
     return g_current_time.load(relaxed) + t;
 }
 
+// Return the ratio of get hits to all gets.
+std::string hit_rate() {
+    std::uint64_t hits = memcache::g_stats.get_hits.load(relaxed);
+    std::uint64_t total = hits + memcache::g_stats.get_misses.load(relaxed);
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(4)
+       << ((total == 0) ? 0.0 : static_cast<double>(hits) / total);
+    return os.str();
+}
+
 } // anonymous namespace
 
 namespace yrmcds { namespace memcache {
@@ -223,6 +243,7 @@ text_request::parse_storage(const char* b, const char* e, bool is_cas) noexcept
     b += 2; // CRLF
     m_request_len = (b - m_p) + nbytes + 2;
     if( m_len < m_request_len ) {
+        m_required_len = m_request_len;
         m_request_len = 0;
         return;
     }
@@ -553,40 +574,49 @@ void text_request::parse() noexcept {
 }
 
 void text_response::value(const cybozu::hash_key& key, std::uint32_t flags,
-                          const cybozu::dynbuf& data) {
+                          const cybozu::dynbuf& data, cybozu::dynbuf& buf) {
     if( key.length() > MAX_KEY_LENGTH )
         throw std::logic_error("MAX_KEY_LENGTH over bug");
     m_iov[0] = {VALUE, sizeof(VALUE) - 1};
     m_iov[1] = {key.data(), key.length()};
-    char buf[MAX_KEY_LENGTH + 100];
+    char line[MAX_KEY_LENGTH + 100];
     static_assert( sizeof(unsigned int) >= sizeof(std::uint32_t),
                    "unsigned int is smaller than std::uint32_t" );
-    int length = snprintf(buf, sizeof(buf), " %u %llu\x0d\x0a",
+    int length = snprintf(line, sizeof(line), " %u %llu\x0d\x0a",
                           (unsigned int)flags,
                           (long long unsigned int)data.size());
-    m_iov[2] = {buf, (std::size_t)length};
+    m_iov[2] = {line, (std::size_t)length};
     m_iov[3] = {data.data(), data.size()};
     m_iov[4] = {CRLF, sizeof(CRLF) - 1};
-    m_socket.sendv(m_iov, 5, false);
+    if( &data == &buf ) {
+        m_socket.sendv(m_iov, 5, buf, false);
+    } else {
+        m_socket.sendv(m_iov, 5, false);
+    }
 }
 
 void text_response::value(const cybozu::hash_key& key, std::uint32_t flags,
-                          const cybozu::dynbuf& data, std::uint64_t cas) {
+                          const cybozu::dynbuf& data, cybozu::dynbuf& buf,
+                          std::uint64_t cas) {
     if( key.length() > MAX_KEY_LENGTH )
         throw std::logic_error("MAX_KEY_LENGTH over bug");
     m_iov[0] = {VALUE, sizeof(VALUE) - 1};
     m_iov[1] = {key.data(), key.length()};
-    char buf[MAX_KEY_LENGTH + 100];
+    char line[MAX_KEY_LENGTH + 100];
     static_assert( sizeof(unsigned int) >= sizeof(std::uint32_t),
                    "unsigned int is smaller than std::uint32_t" );
-    int length = snprintf(buf, sizeof(buf), " %u %llu %llu\x0d\x0a",
+    int length = snprintf(line, sizeof(line), " %u %llu %llu\x0d\x0a",
                           (unsigned int)flags,
                           (long long unsigned int)data.size(),
                           (long long unsigned int)cas);
-    m_iov[2] = {buf, (std::size_t)length};
+    m_iov[2] = {line, (std::size_t)length};
     m_iov[3] = {data.data(), data.size()};
     m_iov[4] = {CRLF, sizeof(CRLF) - 1};
-    m_socket.sendv(m_iov, 5, false);
+    if( &data == &buf ) {
+        m_socket.sendv(m_iov, 5, buf, false);
+    } else {
+        m_socket.sendv(m_iov, 5, false);
+    }
 }
 
 void text_response::value(const cybozu::hash_key& key) {
@@ -614,8 +644,11 @@ void text_response::stats_settings() {
     os << "STAT tmp_dir " << g_config.tempdir() << CRLF;
     os << "STAT buckets " << g_config.buckets() << CRLF;
     os << "STAT item_size_max " << g_config.max_data_size() << CRLF;
+    os << "STAT compression_threshold "
+       << g_config.compression_threshold() << CRLF;
     os << "STAT num_threads " << g_config.workers() << CRLF;
     os << "STAT gc_interval " << g_config.gc_interval() << CRLF;
+    os << "STAT eviction_policy " << current_policy().name() << CRLF;
     std::string s = os.str();
     m_socket.send(s.data(), s.size());
 }
@@ -654,6 +687,12 @@ void text_response::stats_sizes() {
        << g_stats.objects_under_4m.load(relaxed) << CRLF;
     os << "STAT huge "
        << g_stats.objects_huge.load(relaxed) << CRLF;
+    for( std::size_t i = 0; i < SIZE_CLASSES; ++i ) {
+        os << "STAT " << SIZE_CLASS_NAMES[i] << ":bytes "
+           << g_stats.size_class_bytes[i].load(relaxed) << CRLF;
+        os << "STAT " << SIZE_CLASS_NAMES[i] << ":stored "
+           << g_stats.size_class_stored[i].load(relaxed) << CRLF;
+    }
     std::string s = os.str();
     m_socket.send(s.data(), s.size());
 }
@@ -765,17 +804,64 @@ void text_response::stats_general(std::size_t n_slaves) {
     os << "STAT cas_hits " << g_stats.cas_hits.load(relaxed) << CRLF;
     os << "STAT cas_misses " << g_stats.cas_misses.load(relaxed) << CRLF;
     os << "STAT cas_badval " << g_stats.cas_badval.load(relaxed) << CRLF;
-    os << "STAT bytes " << g_stats.used_memory.load(relaxed) << CRLF;
+    os << "STAT bytes " << g_stats.used_memory.sum() << CRLF;
+#ifdef USE_TCMALLOC
+    os << "STAT allocated_bytes "
+       << g_stats.allocated_bytes.load(relaxed) << CRLF;
+#endif
+    os << "STAT compressed_items "
+       << g_stats.compressed_objects.load(relaxed) << CRLF;
     os << "STAT limit_maxbytes " << g_config.memory_limit() << CRLF;
     os << "STAT threads " << g_config.workers() << CRLF;
+    os << "STAT worker_jobs " << cybozu::worker::total_jobs() << CRLF;
+    os << "STAT worker_wakeups " << cybozu::worker::total_wakeups() << CRLF;
+    os << "STAT send_buffer_bytes "
+       << cybozu::segment_pool::used() * cybozu::segment_pool::SEGMENT_SIZE
+       << CRLF;
+    os << "STAT send_buffer_limit "
+       << cybozu::segment_pool::limit() * cybozu::segment_pool::SEGMENT_SIZE
+       << CRLF;
+    os << "STAT send_buffer_exhausted "
+       << cybozu::segment_pool::exhausted() << CRLF;
+    os << "STAT zerocopy_sends "
+       << cybozu::tcp_socket::zerocopy_sends() << CRLF;
+    os << "STAT zerocopy_copied "
+       << cybozu::tcp_socket::zerocopy_copied() << CRLF;
     os << "STAT gc_count " << g_stats.gc_count.load(relaxed) << CRLF;
     os << "STAT slaves " << n_slaves << CRLF;
+    os << "STAT repl_spills " << g_stats.repl_spills.load(relaxed) << CRLF;
+    os << "STAT repl_cutoffs " << g_stats.repl_cutoffs.load(relaxed) << CRLF;
     os << "STAT last_expirations "
        << g_stats.last_expirations.load(relaxed) << CRLF;
     os << "STAT last_evictions "
        << g_stats.last_evictions.load(relaxed) << CRLF;
     os << "STAT evictions "
        << g_stats.total_evictions.load(relaxed) << CRLF;
+    os << "STAT write_evictions "
+       << g_stats.write_evictions.load(relaxed) << CRLF;
+    os << "STAT evicted_bytes "
+       << g_stats.evicted_bytes.load(relaxed) << CRLF;
+    os << "STAT hit_rate " << hit_rate() << CRLF;
+    os << "STAT last_demotions "
+       << g_stats.last_demotions.load(relaxed) << CRLF;
+    os << "STAT demotions "
+       << g_stats.total_demotions.load(relaxed) << CRLF;
+    os << "STAT promotions "
+       << g_stats.total_promotions.load(relaxed) << CRLF;
+    os << "STAT tier_items "
+       << g_stats.tier_objects.load(relaxed) << CRLF;
+    os << "STAT tier_bytes "
+       << g_stats.tier_bytes.load(relaxed) << CRLF;
+    os << "STAT tier_disk_bytes "
+       << g_stats.tier_disk_bytes.load(relaxed) << CRLF;
+    os << "STAT flushed_files "
+       << g_stats.flushed_files.load(relaxed) << CRLF;
+    os << "STAT dropped_pages "
+       << g_stats.dropped_pages.load(relaxed) << CRLF;
+    os << "STAT last_flush_elapsed "
+       << g_stats.last_flush_elapsed.load(relaxed) << CRLF;
+    os << "STAT total_flush_elapsed "
+       << g_stats.total_flush_elapsed.load(relaxed) << CRLF;
     os << "STAT last_gc_elapsed "
        << g_stats.last_gc_elapsed.load(relaxed) << CRLF;
     os << "STAT total_gc_elapsed "
@@ -799,7 +885,11 @@ void binary_request::parse() noexcept {
     if( m_len < BINARY_HEADER_SIZE ) return; // incomplete
     std::uint32_t total_len;
     cybozu::ntoh(m_p + 8, total_len);
-    if( m_len < (BINARY_HEADER_SIZE + total_len) ) return; // incomplete
+    if( m_len < (BINARY_HEADER_SIZE + total_len) ) {
+        // incomplete
+        m_required_len = BINARY_HEADER_SIZE + total_len;
+        return;
+    }
     m_request_len = BINARY_HEADER_SIZE + total_len;
 
     // Opcode parsing
@@ -1016,7 +1106,7 @@ binary_response::success() {
 
 void
 binary_response::get(std::uint32_t flags, const cybozu::dynbuf& data,
-                     std::uint64_t cas, bool flush,
+                     cybozu::dynbuf& buf, std::uint64_t cas, bool flush,
                      const char* key, std::size_t key_len) {
     char header[BINARY_HEADER_SIZE];
     fill_header(header, key_len, sizeof(flags), data.size(), cas);
@@ -1024,13 +1114,18 @@ binary_response::get(std::uint32_t flags, const cybozu::dynbuf& data,
     cybozu::hton(flags, b_flags);
     m_iov[0] = {header, BINARY_HEADER_SIZE};
     m_iov[1] = {b_flags, sizeof(b_flags)};
+    int iovcnt = 3;
     if( key == nullptr ) {
         m_iov[2] = {data.data(), data.size()};
-        m_socket.sendv(m_iov, 3, flush);
     } else {
         m_iov[2] = {key, key_len};
         m_iov[3] = {data.data(), data.size()};
-        m_socket.sendv(m_iov, 4, flush);
+        iovcnt = 4;
+    }
+    if( &data == &buf ) {
+        m_socket.sendv(m_iov, iovcnt, buf, flush);
+    } else {
+        m_socket.sendv(m_iov, iovcnt, flush);
     }
 }
 
@@ -1089,8 +1184,11 @@ binary_response::stats_settings() {
     send_stat("tmp_dir", g_config.tempdir());
     send_stat("buckets", std::to_string(g_config.buckets()));
     send_stat("item_size_max", std::to_string(g_config.max_data_size()));
+    send_stat("compression_threshold",
+              std::to_string(g_config.compression_threshold()));
     send_stat("num_threads", std::to_string(g_config.workers()));
     send_stat("gc_interval", std::to_string(g_config.gc_interval()));
+    send_stat("eviction_policy", current_policy().name());
     success();
 }
 
@@ -1127,6 +1225,12 @@ binary_response::stats_sizes() {
               std::to_string(g_stats.objects_under_4m.load(relaxed)));
     send_stat("huge",
               std::to_string(g_stats.objects_huge.load(relaxed)));
+    for( std::size_t i = 0; i < SIZE_CLASSES; ++i ) {
+        send_stat(std::string(SIZE_CLASS_NAMES[i]) + ":bytes",
+                  std::to_string(g_stats.size_class_bytes[i].load(relaxed)));
+        send_stat(std::string(SIZE_CLASS_NAMES[i]) + ":stored",
+                  std::to_string(g_stats.size_class_stored[i].load(relaxed)));
+    }
     success();
 }
 
@@ -1243,17 +1347,67 @@ binary_response::stats_general(std::size_t n_slaves) {
     send_stat("cas_hits", std::to_string(g_stats.cas_hits.load(relaxed)));
     send_stat("cas_misses", std::to_string(g_stats.cas_misses.load(relaxed)));
     send_stat("cas_badval", std::to_string(g_stats.cas_badval.load(relaxed)));
-    send_stat("bytes", std::to_string(g_stats.used_memory.load(relaxed)));
+    send_stat("bytes", std::to_string(g_stats.used_memory.sum()));
+#ifdef USE_TCMALLOC
+    send_stat("allocated_bytes",
+              std::to_string(g_stats.allocated_bytes.load(relaxed)));
+#endif
+    send_stat("compressed_items",
+              std::to_string(g_stats.compressed_objects.load(relaxed)));
     send_stat("limit_maxbytes", std::to_string(g_config.memory_limit()));
     send_stat("threads", std::to_string(g_config.workers()));
+    send_stat("worker_jobs", std::to_string(cybozu::worker::total_jobs()));
+    send_stat("worker_wakeups",
+              std::to_string(cybozu::worker::total_wakeups()));
+    send_stat("send_buffer_bytes",
+              std::to_string(cybozu::segment_pool::used() *
+                             cybozu::segment_pool::SEGMENT_SIZE));
+    send_stat("send_buffer_limit",
+              std::to_string(cybozu::segment_pool::limit() *
+                             cybozu::segment_pool::SEGMENT_SIZE));
+    send_stat("send_buffer_exhausted",
+              std::to_string(cybozu::segment_pool::exhausted()));
+    send_stat("zerocopy_sends",
+              std::to_string(cybozu::tcp_socket::zerocopy_sends()));
+    send_stat("zerocopy_copied",
+              std::to_string(cybozu::tcp_socket::zerocopy_copied()));
     send_stat("gc_count", std::to_string(g_stats.gc_count.load(relaxed)));
     send_stat("slaves", std::to_string(n_slaves));
+    send_stat("repl_spills",
+              std::to_string(g_stats.repl_spills.load(relaxed)));
+    send_stat("repl_cutoffs",
+              std::to_string(g_stats.repl_cutoffs.load(relaxed)));
     send_stat("last_expirations",
               std::to_string(g_stats.last_expirations.load(relaxed)));
     send_stat("last_evictions",
               std::to_string(g_stats.last_evictions.load(relaxed)));
     send_stat("evictions",
               std::to_string(g_stats.total_evictions.load(relaxed)));
+    send_stat("write_evictions",
+              std::to_string(g_stats.write_evictions.load(relaxed)));
+    send_stat("evicted_bytes",
+              std::to_string(g_stats.evicted_bytes.load(relaxed)));
+    send_stat("hit_rate", hit_rate());
+    send_stat("last_demotions",
+              std::to_string(g_stats.last_demotions.load(relaxed)));
+    send_stat("demotions",
+              std::to_string(g_stats.total_demotions.load(relaxed)));
+    send_stat("promotions",
+              std::to_string(g_stats.total_promotions.load(relaxed)));
+    send_stat("tier_items",
+              std::to_string(g_stats.tier_objects.load(relaxed)));
+    send_stat("tier_bytes",
+              std::to_string(g_stats.tier_bytes.load(relaxed)));
+    send_stat("tier_disk_bytes",
+              std::to_string(g_stats.tier_disk_bytes.load(relaxed)));
+    send_stat("flushed_files",
+              std::to_string(g_stats.flushed_files.load(relaxed)));
+    send_stat("dropped_pages",
+              std::to_string(g_stats.dropped_pages.load(relaxed)));
+    send_stat("last_flush_elapsed",
+              std::to_string(g_stats.last_flush_elapsed.load(relaxed)));
+    send_stat("total_flush_elapsed",
+              std::to_string(g_stats.total_flush_elapsed.load(relaxed)));
     send_stat("last_gc_elapsed",
               std::to_string(g_stats.last_gc_elapsed.load(relaxed)));
     send_stat("total_gc_elapsed",
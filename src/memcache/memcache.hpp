@@ -61,6 +61,13 @@ public:
     // If the request is incomplete, zero is returned.
     std::size_t length() const noexcept { return m_request_len; }
 
+    // Return the length needed to complete an incomplete request.
+    //
+    // This returns zero if the request is complete, or if the length
+    // cannot be determined yet.  Callers can wait for this many bytes
+    // before parsing the request again.
+    std::size_t required() const noexcept { return m_required_len; }
+
     // Return the command type.
     text_command command() const noexcept { return m_command; }
 
@@ -118,6 +125,7 @@ private:
     const char* const m_p;
     const std::size_t m_len;
     std::size_t m_request_len = 0;
+    std::size_t m_required_len = 0;
     text_command m_command = text_command::UNKNOWN;
     bool m_valid = false;
     bool m_no_reply = false;
@@ -194,10 +202,13 @@ public:
         m_socket.send(TEXT_LOCKED, sizeof(TEXT_LOCKED) - 1, true);
     }
 
+    // `buf` is the buffer passed to <object::data>.  If `data` is
+    // `buf`, the socket may take over its contents.
     void value(const cybozu::hash_key& key, std::uint32_t flags,
-               const cybozu::dynbuf& data);
+               const cybozu::dynbuf& data, cybozu::dynbuf& buf);
     void value(const cybozu::hash_key& key, std::uint32_t flags,
-               const cybozu::dynbuf& data, std::uint64_t cas);
+               const cybozu::dynbuf& data, cybozu::dynbuf& buf,
+               std::uint64_t cas);
     void value(const cybozu::hash_key& key);
 
     void send(const char* p, std::size_t len, bool flush) {
@@ -305,6 +316,13 @@ public:
     // If the request is incomplete, zero is returned.
     std::size_t length() const noexcept { return m_request_len; }
 
+    // Return the length needed to complete an incomplete request.
+    //
+    // This returns zero if the request is complete, or if the length
+    // cannot be determined yet.  Callers can wait for this many bytes
+    // before parsing the request again.
+    std::size_t required() const noexcept { return m_required_len; }
+
     // Response status, if determined by the request.
     binary_status status() const noexcept { return m_status; }
 
@@ -348,6 +366,7 @@ private:
     const char* const m_p;
     const std::size_t m_len;
     std::size_t m_request_len = 0;
+    std::size_t m_required_len = 0;
     binary_status m_status = binary_status::Invalid;
     binary_command m_command;
     bool m_quiet;
@@ -372,8 +391,10 @@ public:
 
     void error(binary_status status);
     void success();
+    // `buf` is the buffer passed to <object::data>.  If `data` is
+    // `buf`, the socket may take over its contents.
     void get(std::uint32_t flags, const cybozu::dynbuf& data,
-             std::uint64_t cas, bool flush,
+             cybozu::dynbuf& buf, std::uint64_t cas, bool flush,
              const char* key = nullptr, std::size_t key_len = 0);
     void key(const char* key, std::size_t key_len);
     void set(std::uint64_t cas);
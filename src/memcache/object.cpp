@@ -4,68 +4,108 @@
 #include "object.hpp"
 #include "stats.hpp"
 
+#include <cybozu/lz4.hpp>
+
+#include <algorithm>
 #include <cstdint>
-#include <fcntl.h>
 #include <limits>
-#include <stdio.h>
-#include <string>
 #include <unistd.h>
 
 namespace {
 
-std::uint64_t to_uint64(const char* p, std::size_t len) {
-    unsigned long long ull = std::stoull( std::string(p, len) );
-    if( ull > std::numeric_limits<std::uint64_t>::max() )
-        throw std::out_of_range("out of range for uint64");
-    return static_cast<std::uint64_t>(ull);
+// Parse a decimal number as `std::stoull` does, without allocations.
+//
+// Leading white spaces and a sign are allowed, and trailing garbage
+// is ignored.  A negative number is negated in unsigned arithmetic.
+//
+// @return  `false` if no digits are found or the value is too large.
+bool to_uint64(const char* p, std::size_t len, std::uint64_t& n) {
+    const char* end = p + len;
+    while( p != end && (*p == ' ' || (*p >= '\t' && *p <= '\r')) )
+        ++p;
+    bool negative = false;
+    if( p != end && (*p == '+' || *p == '-') ) {
+        negative = (*p == '-');
+        ++p;
+    }
+    if( p == end || *p < '0' || *p > '9' )
+        return false;
+
+    const std::uint64_t max = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t v = 0;
+    for( ; p != end && *p >= '0' && *p <= '9'; ++p ) {
+        std::uint64_t d = static_cast<std::uint64_t>(*p - '0');
+        if( v > (max - d) / 10 )
+            return false;
+        v = v * 10 + d;
+    }
+    n = negative ? (0 - v) : v;
+    return true;
+}
+
+// Return the number of decimal digits of `n`.
+std::size_t decimal_length(std::uint64_t n) noexcept {
+    std::size_t len = 1;
+    for( ; n >= 10; n /= 10 )
+        ++len;
+    return len;
 }
 
+// Scratch space for compression.
+thread_local std::vector<char> compress_buffer;
+
 } // anonymous namespace
 
 namespace yrmcds { namespace memcache {
 
 thread_local int g_context = -1;
 
-file_flusher::~file_flusher() {
-    if( m_fd == -1 ) return;
-    if( ::fdatasync(m_fd) == 0 )
-        ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_DONTNEED);
-    ::close(m_fd);
-}
-
 object::object(const char* p, std::size_t len,
-               std::uint32_t flags_, std::time_t exptime)
-    : m_length(len), m_data(0, g_config.secure_erase()), m_file(nullptr),
+               std::uint32_t flags_, std::time_t exptime,
+               std::size_t key_len)
+    : m_charge(sizeof(cybozu::hash_key) + key_len + sizeof(object)),
+      m_length(len), m_data(0, g_config.secure_erase()), m_file(nullptr),
       m_flags(flags_), m_exptime(exptime) {
-    if( len > g_config.heap_data_limit() ) {
-        m_file = std::unique_ptr<tempfile>(new tempfile);
-        m_file->write(p, len);
-    } else {
-        if( len > 0 )
-            m_data.append(p, len);
-    }
+    store(p, len);
+    m_charge += heap_bytes();
+    g_stats.used_memory.add(static_cast<std::int64_t>(m_charge));
     g_stats.total_objects.fetch_add(1, std::memory_order_relaxed);
 }
 
-object::object(std::uint64_t initial, std::time_t exptime)
-    : m_length(0), m_data(24, g_config.secure_erase()),
-      m_file(nullptr), m_flags(0), m_exptime(exptime) {
-    char s_value[24]; // uint64 can be as large as 20 byte decimal string.
-    m_length = ::snprintf(s_value, sizeof(s_value),
-                          "%llu", (unsigned long long)initial);
-    m_data.append(s_value, m_length);
+object::object(std::uint64_t initial, std::time_t exptime,
+               std::size_t key_len)
+    : m_charge(sizeof(cybozu::hash_key) + key_len + sizeof(object)),
+      m_length(decimal_length(initial)), m_data(0, g_config.secure_erase()),
+      m_file(nullptr), m_numeric(true), m_number(initial),
+      m_flags(0), m_exptime(exptime) {
+    g_stats.used_memory.add(static_cast<std::int64_t>(m_charge));
     g_stats.total_objects.fetch_add(1, std::memory_order_relaxed);
 }
 
 void object::set(const char* p, std::size_t len,
                  std::uint32_t flags_, std::time_t exptime) {
+    std::size_t old_bytes = heap_bytes();
     m_flags = flags_;
     m_exptime = exptime;
+    m_generation = g_generation.current(
+        g_current_time.load(std::memory_order_relaxed));
     ++ m_cas;
-    m_gc_old = 0;
+    accessed();
     m_data.reset();
+    store(p, len);
+    m_length = len;
+    recharge(old_bytes);
+}
 
+void object::store(const char* p, std::size_t len) {
+    m_tier = nullptr;
+    m_compressed = false;
+    m_numeric = false;
     if( len > g_config.heap_data_limit() ) {
+        if( g_config.compression_threshold() != 0 && compress(p, len) ) {
+            m_file = nullptr;
+            return;
+        }
         if( m_file.get() == nullptr ) {
             m_file = std::unique_ptr<tempfile>(new tempfile);
         } else {
@@ -77,13 +117,114 @@ void object::set(const char* p, std::size_t len,
         if( len > 0 )
             m_data.append(p, len);
     }
-    m_length = len;
+}
+
+bool object::compress(const char* p, std::size_t len) {
+    // Not worth it unless it saves 1/8 and fits in the heap.
+    std::size_t capacity = std::min(len - len / 8,
+                                    g_config.heap_data_limit());
+    if( compress_buffer.size() < capacity )
+        compress_buffer.resize(capacity);
+    std::size_t n = cybozu::lz4_compress(p, len,
+                                         compress_buffer.data(), capacity);
+    if( n == 0 )
+        return false;
+
+    m_data.reset();
+    m_data.append(compress_buffer.data(), n);
+    if( g_config.secure_erase() )
+        cybozu::clear_memory(compress_buffer.data(), n);
+    m_compressed = true;
+    return true;
+}
+
+void object::decompress(const char* p, std::size_t len,
+                        cybozu::dynbuf& buf) const {
+    char* q = buf.prepare(m_length);
+    if( ! cybozu::lz4_decompress(p, len, q, m_length) )
+        throw std::runtime_error("<object::decompress> broken data.");
+    buf.consume(m_length);
+}
+
+void object::promote() {
+    if( m_tier.get() == nullptr ) return;
+
+    std::size_t old_bytes = heap_bytes();
+    m_data.reset();
+    m_tier->read(m_data);
+    m_tier = nullptr;
+    recharge(old_bytes);
+    g_stats.total_promotions.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool object::demote(tier_store& store) {
+    if( m_tier.get() != nullptr ) {
+        if( ! m_tier->sparse() || store.current(m_tier->segment()) )
+            return true;
+        cybozu::dynbuf buf(0);
+        m_tier->read(buf);
+        std::unique_ptr<tier_ref> ref = store.put(buf.data(), buf.size());
+        if( ref.get() != nullptr )
+            m_tier = std::move(ref);
+        return true;
+    }
+
+    if( m_file.get() != nullptr || m_data.empty() || locked() )
+        return false;
+    std::size_t old_bytes = heap_bytes();
+    if( ! m_compressed && g_config.compression_threshold() != 0 &&
+        m_length >= g_config.compression_threshold() )
+        compress(m_data.data(), m_length);
+    m_tier = store.put(m_data.data(), m_data.size());
+    if( m_tier.get() != nullptr )
+        m_data.reset();
+    recharge(old_bytes);
+    return m_tier.get() != nullptr;
+}
+
+void object::drop_cache(page_flusher& flusher, std::size_t& budget) {
+    if( m_file.get() == nullptr || m_file->flushed() ||
+        m_gc_old < static_cast<unsigned int>(FLUSH_AGE) ||
+        m_file->length() > budget )
+        return;
+
+    int new_fd = ::dup(m_file->fileno());
+    if( new_fd == -1 ) {
+        cybozu::logger::warning() << "Failed to dup a file descriptor";
+        return;
+    }
+    flusher.add(new_fd, m_file->length());
+    m_file->set_flushed();
+    budget -= m_file->length();
+}
+
+void object::inflate() {
+    if( m_numeric ) {
+        render(m_data);
+        m_numeric = false;
+        return;
+    }
+    promote();
+    if( ! m_compressed ) return;
+
+    cybozu::dynbuf buf(0, g_config.secure_erase());
+    decompress(m_data.data(), m_data.size(), buf);
+    m_compressed = false;
+    m_data.reset();
+    if( m_length > g_config.heap_data_limit() ) {
+        m_file = std::unique_ptr<tempfile>(new tempfile);
+        m_file->write(buf.data(), m_length);
+    } else {
+        m_data.swap(buf);
+    }
 }
 
 void object::append(const char* p, std::size_t len) {
     ++ m_cas;
-    m_gc_old = 0;
+    accessed();
     if( len == 0 ) return;
+    std::size_t old_bytes = heap_bytes();
+    inflate();
 
     std::size_t new_size = m_length + len;
     if( new_size > g_config.heap_data_limit() ) {
@@ -100,12 +241,15 @@ void object::append(const char* p, std::size_t len) {
         m_data.append(p, len);
     }
     m_length = new_size;
+    recharge(old_bytes);
 }
 
 void object::prepend(const char* p, std::size_t len) {
     ++ m_cas;
-    m_gc_old = 0;
+    accessed();
     if( len == 0 ) return;
+    std::size_t old_bytes = heap_bytes();
+    inflate();
 
     std::size_t new_size = m_length + len;
     if( new_size > g_config.heap_data_limit() ) {
@@ -129,46 +273,54 @@ void object::prepend(const char* p, std::size_t len) {
         m_data.swap(buf);
     }
     m_length = new_size;
+    recharge(old_bytes);
 }
 
-std::uint64_t object::incr(std::uint64_t n) {
-    if( m_file.get() != nullptr )
-        throw not_a_number{};
-    std::uint64_t u64_value;
-    try {
-        u64_value = to_uint64(m_data.data(), m_length);
-    } catch( const std::logic_error& ) {
+std::uint64_t object::to_number() {
+    if( m_numeric )
+        return m_number;
+
+    std::size_t old_bytes = heap_bytes();
+    inflate();
+    std::uint64_t n;
+    if( m_file.get() != nullptr ||
+        ! to_uint64(m_data.data(), m_length, n) ) {
+        recharge(old_bytes);
         throw not_a_number{};
     }
-    u64_value += n;
-    char s_value[24]; // uint64 can be as large as 20 byte decimal string.
-    m_length = ::snprintf(s_value, sizeof(s_value),
-                          "%llu", (unsigned long long)u64_value);
     m_data.reset();
-    m_data.append(s_value, m_length);
+    m_numeric = true;
+    m_number = n;
+    recharge(old_bytes);
+    return n;
+}
+
+void object::render(cybozu::dynbuf& buf) const {
+    buf.reset();
+    char* p = buf.prepare(m_length);
+    std::uint64_t n = m_number;
+    for( std::size_t i = m_length; i != 0; --i ) {
+        p[i - 1] = static_cast<char>('0' + n % 10);
+        n /= 10;
+    }
+    buf.consume(m_length);
+}
+
+std::uint64_t object::incr(std::uint64_t n) {
+    m_number = to_number() + n;
+    m_length = decimal_length(m_number);
     ++ m_cas;
-    m_gc_old = 0;
-    return u64_value;
+    accessed();
+    return m_number;
 }
 
 std::uint64_t object::decr(std::uint64_t n) {
-    if( m_file.get() != nullptr )
-        throw not_a_number{};
-    std::uint64_t u64_value;
-    try {
-        u64_value = to_uint64(m_data.data(), m_length);
-    } catch( const std::logic_error& ) {
-        throw not_a_number{};
-    }
-    u64_value = (u64_value < n) ? 0 : (u64_value - n);
-    char s_value[24]; // uint64 can be as large as 20 byte decimal string.
-    m_length = ::snprintf(s_value, sizeof(s_value),
-                          "%llu", (unsigned long long)u64_value);
-    m_data.reset();
-    m_data.append(s_value, m_length);
+    std::uint64_t u64_value = to_number();
+    m_number = (u64_value < n) ? 0 : (u64_value - n);
+    m_length = decimal_length(m_number);
     ++ m_cas;
-    m_gc_old = 0;
-    return u64_value;
+    accessed();
+    return m_number;
 }
 
 }} // namespace yrmcds::memcache
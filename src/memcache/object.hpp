@@ -4,7 +4,10 @@
 #ifndef YRMCDS_MEMCACHE_OBJECT_HPP
 #define YRMCDS_MEMCACHE_OBJECT_HPP
 
+#include "flusher.hpp"
+#include "generation.hpp"
 #include "stats.hpp"
+#include "tier.hpp"
 #include "../global.hpp"
 #include "../tempfile.hpp"
 
@@ -29,39 +32,55 @@ namespace yrmcds { namespace memcache {
 extern thread_local int g_context;
 
 
-// Purge temporary file contents from the page cache at dtor.
-class file_flusher final {
-public:
-    explicit file_flusher(int fd): m_fd(fd) {}
-    file_flusher(file_flusher&& rhs) {
-        std::swap(m_fd, rhs.m_fd);
-    }
-    file_flusher(const file_flusher&) = delete;
-    file_flusher& operator=(file_flusher&&) = delete;
-    file_flusher& operator=(const file_flusher&) = delete;
-    ~file_flusher();
-
-private:
-    int m_fd = -1;
-};
-
-
 // Object in the hash table.
 //
 // This class represents an object in the hash table.
 // Large objects are stored in temporary files.
+//
+// If `compression_threshold` is configured, objects larger than
+// `heap_data_limit` are kept in memory LZ4-compressed as long as the
+// compressed data fits in `heap_data_limit`.  Smaller objects above the
+// threshold are compressed by the GC when they become cold.
+//
+// If `tier_storage_limit` is configured, the GC may demote cold objects
+// to the second storage tier instead of evicting them.  Demoted objects
+// are promoted back to the heap when they are read by clients.
+//
+// Objects created by increment/decrement with an initial value, or
+// modified by <incr> or <decr>, hold the value as a native integer.
+// The decimal representation is rendered only when the data are read.
+//
+// Each object charges the memory for itself, its key, and its data in
+// the heap to `g_stats.used_memory` as long as it lives.
+//
+// Objects stored before the last `flush_all` are _stale_; they are
+// treated as expired until GC removes them.  See <generation_counter>.
 class object final {
 public:
+    // @key_len  Length of the key, to account the memory of the key.
     object(const char* p, std::size_t len,
-           std::uint32_t flags_, std::time_t exptime);
-    object(std::uint64_t initial, std::time_t exptime);
+           std::uint32_t flags_, std::time_t exptime,
+           std::size_t key_len = 0);
+    object(std::uint64_t initial, std::time_t exptime,
+           std::size_t key_len = 0);
     object(const object&) = delete;
     object(object&& rhs) noexcept:
+        m_charge(rhs.m_charge),
         m_length(rhs.m_length), m_data(std::move(rhs.m_data)),
-        m_file(std::move(rhs.m_file)), m_flags(rhs.m_flags),
-        m_exptime(rhs.m_exptime), m_cas(rhs.m_cas) {}
+        m_file(std::move(rhs.m_file)), m_tier(std::move(rhs.m_tier)),
+        m_compressed(rhs.m_compressed),
+        m_numeric(rhs.m_numeric), m_number(rhs.m_number),
+        m_flags(rhs.m_flags), m_exptime(rhs.m_exptime), m_cas(rhs.m_cas),
+        m_gc_old(rhs.m_gc_old), m_atime(rhs.m_atime),
+        m_scheduled(rhs.m_scheduled), m_generation(rhs.m_generation) {
+        rhs.m_charge = 0;
+    }
     object& operator=(const object&) = delete;
     object& operator=(object&&) = delete;
+    ~object() {
+        if( m_charge != 0 )
+            g_stats.used_memory.sub(static_cast<std::int64_t>(m_charge));
+    }
 
     // Exception thrown by <incr> or <decr>.
     struct not_a_number: public std::runtime_error {
@@ -76,22 +95,81 @@ public:
     std::uint64_t decr(std::uint64_t n);
     void touch(std::time_t exptime) {
         m_exptime = exptime;
-        m_gc_old = 0;
+        accessed();
     }
 
     const cybozu::dynbuf& data(cybozu::dynbuf& buf) const {
-        m_gc_old = 0;
+        accessed();
+        if( m_numeric ) {
+            render(buf);
+            return buf;
+        }
+        if( m_tier.get() != nullptr ) {
+            buf.reset();
+            if( ! m_compressed ) {
+                m_tier->read(buf);
+                return buf;
+            }
+            cybozu::dynbuf cbuf(0);
+            m_tier->read(cbuf);
+            decompress(cbuf.data(), cbuf.size(), buf);
+            return buf;
+        }
+        if( m_compressed ) {
+            buf.reset();
+            decompress(m_data.data(), m_data.size(), buf);
+            return buf;
+        }
         if( m_file.get() == nullptr ) return m_data;
         buf.reset();
         m_file->read_contents(buf);
         return buf;
     }
 
+    // Move demoted data back to the heap.
+    void promote();
+
+    // Demote the data to the second storage tier.
+    // @store  The second storage tier.
+    //
+    // If the object has already been demoted to a mostly unused
+    // segment, the data are moved to the current segment.
+    //
+    // @return  `true` if the object is (or has already been) demoted.
+    bool demote(tier_store& store);
+
+    // Return the logical size of the data.
     std::size_t size() const noexcept {
+        return m_length;
+    }
+
+    // Return the size of the data as stored in memory or in a file.
+    std::size_t stored_size() const noexcept {
+        if( m_tier.get() != nullptr ) return m_tier->length();
         if( m_file.get() == nullptr ) return m_data.size();
         return m_file->length();
     }
 
+    // Return `true` if the data is demoted to the second storage tier.
+    bool demoted() const noexcept {
+        return m_tier.get() != nullptr;
+    }
+
+    // Return `true` if the data is stored in a temporary file.
+    bool on_file() const noexcept {
+        return m_file.get() != nullptr;
+    }
+
+    // Return `true` if the data is stored LZ4-compressed.
+    bool compressed() const noexcept {
+        return m_compressed;
+    }
+
+    // Return `true` if the data is stored as a native integer.
+    bool numeric() const noexcept {
+        return m_numeric;
+    }
+
     std::uint32_t flags() const noexcept {
         return m_flags;
     }
@@ -104,30 +182,60 @@ public:
         return (std::uint32_t)m_exptime;
     }
 
+    // Return the expiration time registered to the expiration timer
+    // wheel, or 0 if not registered.
+    std::uint32_t scheduled() const noexcept {
+        return m_scheduled;
+    }
+    void set_scheduled(std::uint32_t t) noexcept {
+        m_scheduled = t;
+    }
+
     bool expired() const noexcept {
         if( locked() ) return false;
-        std::time_t t = g_stats.flush_time.load(std::memory_order_relaxed);
         std::time_t now = g_current_time.load(std::memory_order_relaxed);
-        if( t != 0 && t <= now ) return true;
+        if( m_generation != g_generation.current(now) ) return true;
         if( m_exptime == 0 ) return false;
         return m_exptime <= now;
     }
 
+    // Return `true` if the object was stored before the last flush.
+    bool stale() const noexcept {
+        if( locked() ) return false;
+        return m_generation != g_generation.current(
+            g_current_time.load(std::memory_order_relaxed));
+    }
+
     unsigned int age() const noexcept { return m_gc_old; }
 
-    void survive(std::vector<file_flusher>& flushers) const {
-        ++ m_gc_old;
-        if( m_gc_old != FLUSH_AGE || m_file.get() == nullptr )
-            return;
+    // Return the time of the last access in seconds.
+    std::uint32_t atime() const noexcept { return m_atime; }
 
-        int new_fd = ::dup(m_file->fileno());
-        if( new_fd == -1 ) {
-            cybozu::logger::warning() << "Failed to dup a file descriptor";
-            return;
+    void survive() {
+        ++ m_gc_old;
+        if( m_gc_old == COMPRESS_AGE && m_file.get() == nullptr &&
+            m_tier.get() == nullptr && ! m_compressed && ! m_numeric &&
+            g_config.compression_threshold() != 0 &&
+            m_length >= g_config.compression_threshold() ) {
+            std::size_t old_bytes = heap_bytes();
+            compress(m_data.data(), m_length);
+            recharge(old_bytes);
         }
-        flushers.emplace_back(new_fd);
     }
 
+    // Return the memory charged for this object.
+    std::size_t charge() const noexcept {
+        return m_charge;
+    }
+
+    // Purge the temporary file of a cold object from the page cache.
+    // @flusher  The page cache flusher.
+    // @budget   Bytes that may still be flushed in this GC.
+    //
+    // If the file is queued to `flusher`, `budget` is decreased by
+    // the file length.  Files larger than `budget` are left for later.
+    void drop_cache(page_flusher& flusher, std::size_t& budget);
+
     void lock() {
         if( locked() )
             throw std::logic_error("object::lock bug");
@@ -164,13 +272,65 @@ public:
     }
 
 private:
+    // Try to store `p` compressed in `m_data`.
+    // @return  `true` if compressed, `false` if not worth it.
+    bool compress(const char* p, std::size_t len);
+
+    // Append the decompressed data to `buf`.
+    void decompress(const char* p, std::size_t len,
+                    cybozu::dynbuf& buf) const;
+
+    // Store the data uncompressed to modify it.
+    void inflate();
+
+    // Convert the data to a native integer.
+    // @return  The current value.
+    std::uint64_t to_number();
+
+    // Render the native integer in decimal to `buf`.
+    void render(cybozu::dynbuf& buf) const;
+
+    // Reset the LRU counter and the access time.
+    void accessed() const noexcept {
+        m_gc_old = 0;
+        m_atime = static_cast<std::uint32_t>(
+            g_current_time.load(std::memory_order_relaxed));
+    }
+
+    // Return the size of the data in the heap.
+    std::size_t heap_bytes() const noexcept {
+        return m_data.size();
+    }
+
+    // Update the memory charge after the heap data changed.
+    // @old_bytes  The value of <heap_bytes> before the change.
+    void recharge(std::size_t old_bytes) noexcept {
+        std::size_t new_bytes = heap_bytes();
+        if( new_bytes == old_bytes ) return;
+        m_charge = m_charge + new_bytes - old_bytes;
+        g_stats.used_memory.add(static_cast<std::int64_t>(new_bytes) -
+                                static_cast<std::int64_t>(old_bytes));
+    }
+
+    void store(const char* p, std::size_t len);
+
+    std::size_t m_charge;
     std::size_t m_length;
     cybozu::dynbuf m_data;
     std::unique_ptr<tempfile> m_file;
+    std::unique_ptr<tier_ref> m_tier;
+    bool m_compressed = false;
+    bool m_numeric = false;
+    std::uint64_t m_number = 0;
     std::uint32_t m_flags;
     std::time_t m_exptime;
     std::uint64_t m_cas = 1;
     mutable unsigned int m_gc_old = 0;
+    mutable std::uint32_t m_atime = static_cast<std::uint32_t>(
+        g_current_time.load(std::memory_order_relaxed));
+    std::uint32_t m_scheduled = 0;
+    std::uint32_t m_generation = g_generation.current(
+        g_current_time.load(std::memory_order_relaxed));
     int m_lock = -1;
     std::thread::id m_unlocker;
 };
@@ -0,0 +1,100 @@
+// (C) 2026 Cybozu.
+
+#include "policy.hpp"
+
+#include <cybozu/frequency_sketch.hpp>
+
+namespace {
+
+using yrmcds::memcache::object;
+
+inline std::uint64_t idle_time(const object& obj, std::uint32_t now) noexcept {
+    return (now > obj.atime()) ? (now - obj.atime()) : 0;
+}
+
+// Sampled LRU.
+class lru_policy: public yrmcds::memcache::policy {
+public:
+    virtual const char* name() const noexcept override {
+        return "lru";
+    }
+
+    virtual std::uint64_t score(const cybozu::hash_key&, const object& obj,
+                                std::uint32_t now) const noexcept override {
+        return (idle_time(obj, now) << 32) | obj.age();
+    }
+};
+
+// Evict large and cold objects first.
+//
+// The score is the idle time weighted by the memory charged to the
+// object, so that one large object is evicted instead of many small
+// objects accessed as recently.
+class size_policy: public yrmcds::memcache::policy {
+public:
+    virtual const char* name() const noexcept override {
+        return "size";
+    }
+
+    virtual std::uint64_t score(const cybozu::hash_key&, const object& obj,
+                                std::uint32_t now) const noexcept override {
+        return (idle_time(obj, now) + 1) * obj.charge();
+    }
+};
+
+// W-TinyLFU.
+//
+// Objects accessed within the last second form the admission window
+// and are evicted only if all sampled objects are in the window.
+// Other objects are ordered by their frequencies estimated by a
+// count-min sketch, and then by their idle time.  New objects thus
+// cannot push out frequently accessed ones.
+class tinylfu_policy: public yrmcds::memcache::policy {
+public:
+    explicit tinylfu_policy(std::size_t capacity): m_sketch(capacity) {}
+
+    virtual const char* name() const noexcept override {
+        return "tinylfu";
+    }
+
+    virtual void record(const cybozu::hash_key& key) noexcept override {
+        m_sketch.increment(key.hash());
+    }
+
+    virtual std::uint64_t score(const cybozu::hash_key& key, const object& obj,
+                                std::uint32_t now) const noexcept override {
+        std::uint64_t idle = idle_time(obj, now);
+        if( idle > 0xffffffffULL ) idle = 0xffffffffULL;
+        std::uint64_t cold = cybozu::frequency_sketch::MAX_FREQUENCY -
+            m_sketch.estimate(key.hash());
+        std::uint64_t main = (idle > 0) ? 1 : 0;
+        return (main << 63) | (cold << 48) | idle;
+    }
+
+private:
+    cybozu::frequency_sketch m_sketch;
+};
+
+} // anonymous namespace
+
+namespace yrmcds { namespace memcache {
+
+std::unique_ptr<policy> make_policy(eviction_policy type,
+                                    std::size_t capacity) {
+    switch( type ) {
+    case eviction_policy::tinylfu:
+        return std::unique_ptr<policy>(new tinylfu_policy(capacity));
+    case eviction_policy::size:
+        return std::unique_ptr<policy>(new size_policy);
+    default:
+        return std::unique_ptr<policy>(new lru_policy);
+    }
+}
+
+policy& current_policy() {
+    static std::unique_ptr<policy> p =
+        make_policy(g_config.eviction_policy(), g_config.buckets());
+    return *p;
+}
+
+}} // namespace yrmcds::memcache
@@ -0,0 +1,55 @@
+// Eviction policies.
+// (C) 2026 Cybozu.
+
+#ifndef YRMCDS_MEMCACHE_POLICY_HPP
+#define YRMCDS_MEMCACHE_POLICY_HPP
+
+#include "../config.hpp"
+#include "object.hpp"
+
+#include <cybozu/hash_map.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace yrmcds { namespace memcache {
+
+// The interface of eviction policies.
+//
+// <evict_objects> samples objects and evicts the one with the highest
+// <score>.  Worker threads call <record> for every key looked up so
+// that policies can track access frequencies.
+class policy {
+public:
+    virtual ~policy() {}
+
+    // Return the name of the policy.
+    virtual const char* name() const noexcept = 0;
+
+    // Record an access to `key`.
+    virtual void record(const cybozu::hash_key& key) noexcept {}
+
+    // Return how eagerly `obj` should be evicted.
+    // @key  The key of the object.
+    // @obj  The object.
+    // @now  The current time.
+    //
+    // @return  A larger value to evict the object earlier.
+    virtual std::uint64_t score(const cybozu::hash_key& key,
+                                const object& obj,
+                                std::uint32_t now) const noexcept = 0;
+};
+
+// Create a policy.
+// @type      The policy type.
+// @capacity  The expected number of objects.
+std::unique_ptr<policy> make_policy(eviction_policy type,
+                                    std::size_t capacity);
+
+// Return the policy configured by `eviction_policy`.
+policy& current_policy();
+
+}} // namespace yrmcds::memcache
+
+#endif // YRMCDS_MEMCACHE_POLICY_HPP
@@ -1,5 +1,6 @@
 // (C) 2013-2014 Cybozu.
 
+#include "expiry.hpp"
 #include "memcache.hpp"
 #include "replication.hpp"
 #include "stats.hpp"
@@ -50,8 +51,16 @@ void repl_object(const std::vector<repl_socket*>& slaves,
         {key.data(), key.length()},
         {data.data(), data.size()}
     };
-    for( cybozu::tcp_socket* s: slaves )
-        s->sendv(iov, 4, flush);
+    if( slaves.empty() )
+        return;
+    // only the last slave may take over `buf` as the others share it.
+    for( std::size_t i = 0; i + 1 < slaves.size(); ++i )
+        slaves[i]->sendv(iov, 4, flush);
+    if( &data == &buf ) {
+        slaves.back()->sendv(iov, 4, buf, flush);
+    } else {
+        slaves.back()->sendv(iov, 4, flush);
+    }
 }
 
 void repl_touch(const std::vector<repl_socket*>& slaves,
@@ -81,6 +90,31 @@ void repl_delete(const std::vector<repl_socket*>& slaves,
         s->sendv(iov, 2, false);
 }
 
+void repl_flush(const std::vector<repl_socket*>& slaves, std::time_t at) {
+    char header[BINARY_HEADER_SIZE];
+    fill_header(header, 0, 4, 0, binary_command::FlushQ);
+    char extras[4];
+    cybozu::hton(static_cast<std::uint32_t>(at), extras);
+    cybozu::tcp_socket::iovec iov[2] = {
+        {header, sizeof(header)},
+        {extras, sizeof(extras)}
+    };
+    for( cybozu::tcp_socket* s: slaves )
+        s->sendv(iov, 2, true);
+}
+
+void repl_pending_flush(const std::vector<repl_socket*>& slaves) {
+    // Workers replicate later flushes to the slaves by themselves, but
+    // one may race with this.  Send again until the pending flush stays
+    // the same so that the last one sent is not older than theirs.
+    std::time_t sent = 0;
+    for( std::time_t at = g_generation.pending(); at != 0 && at != sent;
+         at = g_generation.pending() ) {
+        repl_flush(slaves, at);
+        sent = at;
+    }
+}
+
 std::size_t repl_recv(const char* p, std::size_t len,
                       cybozu::hash_map<object>& hash) {
     std::size_t consumed = 0;
@@ -102,20 +136,24 @@ std::size_t repl_recv(const char* p, std::size_t len,
 
         switch( parser.command() ) {
         case binary_command::SetQ:
-            h = [&parser](const cybozu::hash_key&, object& obj) -> bool {
+            h = [&parser](const cybozu::hash_key& k, object& obj) -> bool {
                 const char* p2;
                 std::size_t len2;
                 std::tie(p2, len2) = parser.data();
                 ++ g_stats.repl_updated;
                 obj.set(p2, len2, parser.flags(), parser.exptime());
+                schedule_expiry(k, obj);
                 return true;
             };
-            c = [&parser](const cybozu::hash_key&) -> object {
+            c = [&parser](const cybozu::hash_key& k) -> object {
                 const char* p2;
                 std::size_t len2;
                 std::tie(p2, len2) = parser.data();
                 ++ g_stats.repl_created;
-                return object(p2, len2, parser.flags(), parser.exptime());
+                object o(p2, len2, parser.flags(), parser.exptime(),
+                         k.length());
+                schedule_expiry(k, o);
+                return o;
             };
             std::tie(key_data, key_len) = parser.key();
             cybozu::logger::debug() << "repl: set "
@@ -123,9 +161,10 @@ std::size_t repl_recv(const char* p, std::size_t len,
             hash.apply_nolock(cybozu::hash_key(key_data, key_len), h, c);
             break;
         case binary_command::Touch:
-            h = [&parser](const cybozu::hash_key&, object& obj) -> bool {
+            h = [&parser](const cybozu::hash_key& k, object& obj) -> bool {
                 ++ g_stats.repl_updated;
                 obj.touch( parser.exptime() );
+                schedule_expiry(k, obj);
                 return true;
             };
             std::tie(key_data, key_len) = parser.key();
@@ -140,6 +179,11 @@ std::size_t repl_recv(const char* p, std::size_t len,
             ++ g_stats.repl_removed;
             hash.remove_nolock(cybozu::hash_key(key_data, key_len), nullptr);
             break;
+        case binary_command::FlushQ:
+            cybozu::logger::debug() << "repl: flush at " << parser.exptime();
+            g_generation.flush(parser.exptime(),
+                               g_current_time.load(std::memory_order_relaxed));
+            break;
         default:
             cybozu::logger::error() << "Unknown replication command"
                                     << std::hex
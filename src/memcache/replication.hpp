@@ -9,6 +9,7 @@
 
 #include <cybozu/hash_map.hpp>
 
+#include <ctime>
 #include <vector>
 
 namespace yrmcds { namespace memcache {
@@ -23,6 +24,15 @@ void repl_touch(const std::vector<repl_socket*>& slaves,
 void repl_delete(const std::vector<repl_socket*>& slaves,
                  const cybozu::hash_key& key);
 
+// Replicate `flush_all` to take effect at `at`.
+void repl_flush(const std::vector<repl_socket*>& slaves, std::time_t at);
+
+// Replicate a pending `flush_all`, if any, to new slaves.
+//
+// Slaves joining after a delayed `flush_all` need this before the
+// initial replication, or they would keep flushed objects.
+void repl_pending_flush(const std::vector<repl_socket*>& slaves);
+
 std::size_t repl_recv(const char* p, std::size_t len,
                       cybozu::hash_map<object>& hash);
 
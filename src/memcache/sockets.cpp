@@ -1,5 +1,8 @@
 // (C) 2013 Cybozu.
 
+#include "evict.hpp"
+#include "expiry.hpp"
+#include "policy.hpp"
 #include "replication.hpp"
 #include "sockets.hpp"
 
@@ -31,74 +34,119 @@ using hash_map = cybozu::hash_map<object>;
 memcache_socket::memcache_socket(int fd,
                                  const std::function<cybozu::worker*()>& finder,
                                  cybozu::hash_map<object>& hash,
-                                 const std::vector<repl_socket*>& slaves)
+                                 const slave_list& slaves)
     : cybozu::tcp_socket(fd),
       m_busy(false),
       m_finder(finder),
       m_hash(hash),
       m_pending(0),
       m_slaves_origin(slaves) {
+    enable_zerocopy(g_config.zerocopy_threshold());
     m_slaves.reserve(MAX_SLAVES);
     g_stats.curr_connections.fetch_add(1, relaxed);
     g_stats.total_connections.fetch_add(1, relaxed);
 
     m_recvjob = [this](cybozu::dynbuf& buf) {
+        g_stats.busy_workers.add(1);
+
         // set lock context for objects.
         with_fd([](int fd) -> bool {
             g_context = fd;
             return true;
         });
 
-        // load pending data
-        if( ! m_pending.empty() ) {
-            buf.append(m_pending.data(), m_pending.size());
-            m_pending.reset();
-        }
-
+        cybozu::dynbuf* in = &buf;
         while( true ) {
-            auto res = receive(buf, MAX_RECVSIZE);
+            // receive data directly into the pending buffer if a request
+            // is left incomplete so that data are never copied back.
+            // As the buffer is kept between jobs, read only as much as
+            // the request needs.  The buffer is released once drained.
+            in = m_pending.empty() ? &buf : &m_pending;
+            std::size_t recvsize = MAX_RECVSIZE;
+            if( in == &m_pending ) {
+                std::size_t len = m_pending.size() - m_consumed;
+                std::size_t missing = (m_required > len) ? m_required - len : 0;
+                recvsize = std::min(std::max(missing, PENDING_RECVSIZE),
+                                    MAX_RECVSIZE);
+            }
+            auto res = receive(*in, recvsize);
             if( res == recv_result::AGAIN )
                 break;
             if( res == recv_result::RESET || res == recv_result::NONE ) {
-                buf.reset();
+                in->reset();
+                m_consumed = 0;
+                m_required = 0;
                 unlock_all();
                 break;
             }
 
-            const char* head = buf.data();
-            std::size_t len = buf.size();
-            while( len > 0 ) {
-                if( mc::is_binary_request(head) ) {
-                    mc::binary_request parser(head, len);
-                    std::size_t c = parser.length();
-                    if( c == 0 ) break;
-                    head += c;
-                    len -= c;
-                    cmd_bin(parser);
-                } else {
-                    mc::text_request parser(head, len);
-                    std::size_t c = parser.length();
-                    if( c == 0 ) break;
-                    head += c;
-                    len -= c;
-                    cmd_text(parser);
+            const char* head = in->data() + m_consumed;
+            std::size_t len = in->size() - m_consumed;
+            // skip parsing until an incomplete request can be completed.
+            if( len >= m_required ) {
+                m_required = 0;
+                // replies to pipelined requests are sent at once.
+                begin_batch();
+                while( len > 0 ) {
+                    if( mc::is_binary_request(head) ) {
+                        mc::binary_request parser(head, len);
+                        std::size_t c = parser.length();
+                        if( c == 0 ) {
+                            m_required = parser.required();
+                            break;
+                        }
+                        head += c;
+                        len -= c;
+                        cmd_bin(parser);
+                    } else {
+                        mc::text_request parser(head, len);
+                        std::size_t c = parser.length();
+                        if( c == 0 ) {
+                            m_required = parser.required();
+                            break;
+                        }
+                        head += c;
+                        len -= c;
+                        cmd_text(parser);
+                    }
                 }
+                end_batch();
+                if( memory_exceeded() )
+                    g_stats.write_evictions.fetch_add(
+                        evict_some(m_hash, m_slaves), relaxed);
             }
             if( len > MAX_REQUEST_LENGTH ) {
                 cybozu::logger::warning() << "denied too large request of "
                                           << len << " bytes.";
-                buf.reset();
+                in->reset();
+                m_consumed = 0;
+                m_required = 0;
                 unlock_all();
                 invalidate_and_close();
                 break;
             }
-            buf.erase(head - buf.data());
+
+            // compact the buffer only when it costs less than parsing
+            // the consumed data did.
+            m_consumed = head - in->data();
+            if( len == 0 ) {
+                in->reset();
+                m_consumed = 0;
+            } else if( len <= m_consumed ) {
+                in->erase(m_consumed);
+                m_consumed = 0;
+            }
         }
 
         // recv returns EAGAIN, or some error happens.
-        if( buf.size() > 0 )
-            m_pending.append(buf.data(), buf.size());
+        if( in == &buf ) {
+            if( buf.size() > m_consumed )
+                m_pending.append(buf.data() + m_consumed,
+                                 buf.size() - m_consumed);
+            m_consumed = 0;
+        }
 
+        g_stats.busy_workers.sub(1);
         m_busy.store(false, std::memory_order_release);
     };
 
@@ -126,7 +174,7 @@ bool memcache_socket::on_readable(int) {
         return true;
     }
 
-    // find an idle worker.
+    // find a worker to run the job.
     cybozu::worker* w = m_finder();
     if( w == nullptr ) {
         m_reactor->add_readable(*this);
@@ -134,7 +182,7 @@ bool memcache_socket::on_readable(int) {
     }
 
     // copy the current list of slaves
-    m_slaves = m_slaves_origin;
+    m_slaves_origin.copy_to(m_slaves);
 
     m_busy.store(true, std::memory_order_release);
     w->post_job(m_recvjob);
@@ -144,7 +192,7 @@ bool memcache_socket::on_readable(int) {
 bool memcache_socket::on_writable(int fd) {
     cybozu::worker* w = m_finder();
     if( w == nullptr ) {
-        // if there is no idle worker, fallback to the default.
+        // if all job queues are full, fallback to the default.
         return cybozu::tcp_socket::on_writable(fd);
     }
 
@@ -152,6 +200,12 @@ bool memcache_socket::on_writable(int fd) {
     return true;
 }
 
+void memcache_socket::flush_all(std::time_t at) {
+    g_generation.flush(at, g_current_time.load(relaxed));
+    if( ! m_slaves.empty() )
+        repl_flush(m_slaves, at);
+}
+
 void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
     mc::binary_response r(*this, cmd);
 
@@ -196,9 +250,11 @@ void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
             if( obj.expired() ) return false;
             if( cmd.exptime() != mc::binary_request::EXPTIME_NONE ) {
                 obj.touch( cmd.exptime() );
+                schedule_expiry(k, obj);
                 if( ! m_slaves.empty() )
                     repl_touch(m_slaves, k, obj);
             }
+            obj.promote();
             cybozu::dynbuf buf(0);
             const cybozu::dynbuf& data = obj.data(buf);
             if( cmd.command() == binary_command::Get ||
@@ -207,20 +263,25 @@ void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
                 cmd.command() == binary_command::GaTQ ||
                 cmd.command() == binary_command::LaG ||
                 cmd.command() == binary_command::LaGQ ) {
-                r.get(obj.flags(), data, obj.cas_unique(), ! cmd.quiet());
+                r.get(obj.flags(), data, buf, obj.cas_unique(),
+                      ! cmd.quiet());
             } else {
-                r.get(obj.flags(), data, obj.cas_unique(), ! cmd.quiet(),
+                r.get(obj.flags(), data, buf, obj.cas_unique(), ! cmd.quiet(),
                       k.data(), k.length());
             }
             return true;
         };
         std::tie(p, len) = cmd.key();
-        if( ! m_hash.apply(cybozu::hash_key(p, len), h, c) ) {
-            g_stats.get_misses.fetch_add(1, relaxed);
-            if( ! cmd.quiet() || cmd.command() == binary_command::LaGQ )
-                r.error( binary_status::NotFound );
-        } else {
-            g_stats.get_hits.fetch_add(1, relaxed);
+        {
+            cybozu::hash_key key(p, len);
+            current_policy().record(key);
+            if( ! m_hash.apply(key, h, c) ) {
+                g_stats.get_misses.fetch_add(1, relaxed);
+                if( ! cmd.quiet() || cmd.command() == binary_command::LaGQ )
+                    r.error( binary_status::NotFound );
+            } else {
+                g_stats.get_hits.fetch_add(1, relaxed);
+            }
         }
         break;
     case binary_command::Set:
@@ -267,6 +328,7 @@ void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
             std::size_t len2;
             std::tie(p2, len2) = cmd.data();
             obj.set(p2, len2, cmd.flags(), cmd.exptime());
+            schedule_expiry(k, obj);
             if( ! cmd.quiet() )
                 r.set( obj.cas_unique() );
             if( cmd.cas_unique() != 0 )
@@ -282,7 +344,8 @@ void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
                 const char* p2;
                 std::size_t len2;
                 std::tie(p2, len2) = cmd.data();
-                object o(p2, len2, cmd.flags(), cmd.exptime());
+                object o(p2, len2, cmd.flags(), cmd.exptime(), k.length());
+                schedule_expiry(k, o);
                 if( ! cmd.quiet() )
                     r.set( o.cas_unique() );
                 if( ! m_slaves.empty() )
@@ -321,6 +384,7 @@ void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
             std::size_t len2;
             std::tie(p2, len2) = cmd.data();
             obj.set(p2, len2, cmd.flags(), cmd.exptime());
+            schedule_expiry(k, obj);
             obj.unlock();
             remove_lock(k);
             if( ! cmd.quiet() )
@@ -438,7 +502,8 @@ void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
         };
         if( cmd.exptime() != mc::binary_request::EXPTIME_NONE ) {
             c = [this,&cmd,&r](const cybozu::hash_key& k) -> object {
-                object o(cmd.initial(), cmd.exptime());
+                object o(cmd.initial(), cmd.exptime(), k.length());
+                schedule_expiry(k, o);
                 if( ! cmd.quiet() )
                     r.incdec( cmd.initial(), o.cas_unique() );
                 if( ! m_slaves.empty() )
@@ -476,7 +541,8 @@ void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
         };
         if( cmd.exptime() != mc::binary_request::EXPTIME_NONE ) {
             c = [this,&cmd,&r](const cybozu::hash_key& k) -> object {
-                object o(cmd.initial(), cmd.exptime());
+                object o(cmd.initial(), cmd.exptime(), k.length());
+                schedule_expiry(k, o);
                 if( ! cmd.quiet() )
                     r.incdec( cmd.initial(), o.cas_unique() );
                 if( ! m_slaves.empty() )
@@ -492,6 +558,7 @@ void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
         h = [this,&cmd,&r](const cybozu::hash_key& k, object& obj) -> bool {
             if( obj.expired() ) return false;
             obj.touch( cmd.exptime() );
+            schedule_expiry(k, obj);
             if( ! m_slaves.empty() )
                 repl_touch(m_slaves, k, obj);
             r.set( obj.cas_unique() );
@@ -545,6 +612,7 @@ void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
     case binary_command::QuitQ:
         unlock_all();
         if( cmd.quiet() ) {
+            end_batch();
             invalidate_and_close();
         } else {
             r.quit();
@@ -552,7 +620,7 @@ void memcache_socket::cmd_bin(const memcache::binary_request& cmd) {
         break;
     case binary_command::Flush:
     case binary_command::FlushQ:
-        g_stats.flush_time.store( cmd.exptime() );
+        flush_all(cmd.exptime());
         if( ! cmd.quiet() )
             r.success();
         break;
@@ -642,6 +710,7 @@ void memcache_socket::cmd_text(const memcache::text_request& cmd) {
             std::size_t len2;
             std::tie(p2, len2) = cmd.data();
             obj.set(p2, len2, cmd.flags(), cmd.exptime());
+            schedule_expiry(k, obj);
             if( ! cmd.no_reply() )
                 r.stored();
             if( ! m_slaves.empty() )
@@ -653,7 +722,8 @@ void memcache_socket::cmd_text(const memcache::text_request& cmd) {
                 const char* p2;
                 std::size_t len2;
                 std::tie(p2, len2) = cmd.data();
-                object o(p2, len2, cmd.flags(), cmd.exptime());
+                object o(p2, len2, cmd.flags(), cmd.exptime(), k.length());
+                schedule_expiry(k, o);
                 if( ! cmd.no_reply() )
                     r.stored();
                 if( ! m_slaves.empty() )
@@ -727,6 +797,7 @@ void memcache_socket::cmd_text(const memcache::text_request& cmd) {
             std::size_t len2;
             std::tie(p2, len2) = cmd.data();
             obj.set(p2, len2, cmd.flags(), cmd.exptime());
+            schedule_expiry(k, obj);
             if( ! cmd.no_reply() )
                 r.stored();
             if( ! m_slaves.empty() )
@@ -801,6 +872,7 @@ void memcache_socket::cmd_text(const memcache::text_request& cmd) {
         h = [this,&cmd](const cybozu::hash_key& k, object& obj) -> bool {
             if( obj.expired() ) return false;
             obj.touch( cmd.exptime() );
+            schedule_expiry(k, obj);
             if( ! m_slaves.empty() )
                 repl_touch(m_slaves, k, obj);
             return true;
@@ -869,19 +941,22 @@ void memcache_socket::cmd_text(const memcache::text_request& cmd) {
     case text_command::GETS:
         h = [&cmd,&r](const cybozu::hash_key& k, object& obj) -> bool {
             if( obj.expired() ) return false;
+            obj.promote();
             cybozu::dynbuf buf(0);
             const cybozu::dynbuf& data = obj.data(buf);
             if( cmd.command() == text_command::GETS ) {
-                r.value(k, obj.flags(), data, obj.cas_unique());
+                r.value(k, obj.flags(), data, buf, obj.cas_unique());
             } else {
-                r.value(k, obj.flags(), data);
+                r.value(k, obj.flags(), data, buf);
             }
             return true;
         };
         for( mc::item it = cmd.first_key();
              it != mc::text_request::eos; it = cmd.next_key(it) ) {
             std::tie(p, len) = it;
-            if( m_hash.apply(cybozu::hash_key(p, len), h, nullptr) ) {
+            cybozu::hash_key key(p, len);
+            current_policy().record(key);
+            if( m_hash.apply(key, h, nullptr) ) {
                 g_stats.get_hits.fetch_add(1, relaxed);
             } else {
                 g_stats.get_misses.fetch_add(1, relaxed);
@@ -922,7 +997,7 @@ void memcache_socket::cmd_text(const memcache::text_request& cmd) {
         r.end();
         break;
     case text_command::FLUSH_ALL:
-        g_stats.flush_time.store( cmd.exptime() );
+        flush_all(cmd.exptime());
         if( ! cmd.no_reply() )
             r.ok();
         break;
@@ -936,6 +1011,7 @@ void memcache_socket::cmd_text(const memcache::text_request& cmd) {
         break;
     case text_command::QUIT:
         unlock_all();
+        end_batch();
         invalidate_and_close();
         break;
     default:
@@ -983,7 +1059,7 @@ bool repl_socket::on_readable(int fd) {
 bool repl_socket::on_writable(int fd) {
     cybozu::worker* w = m_finder();
     if( w == nullptr ) {
-        // if there is no idle worker, fallback to the default.
+        // if all job queues are full, fallback to the default.
         return cybozu::tcp_socket::on_writable(fd);
     }
 
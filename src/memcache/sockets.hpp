@@ -5,29 +5,54 @@
 #define YRMCDS_MEMCACHE_SOCKETS_HPP
 
 #include "../constants.hpp"
+#include "../tempfile.hpp"
 #include "memcache.hpp"
 #include "object.hpp"
 #include "stats.hpp"
 
 #include <cybozu/dynbuf.hpp>
 #include <cybozu/hash_map.hpp>
+#include <cybozu/spinlock.hpp>
 #include <cybozu/tcp.hpp>
 #include <cybozu/util.hpp>
 #include <cybozu/worker.hpp>
 
+#include <exception>
 #include <functional>
+#include <mutex>
 #include <vector>
 
 namespace yrmcds { namespace memcache {
 
 class repl_socket;
 
+// The list of slaves shared by reactor threads.
+//
+// The reactor thread in the master mode updates the list, and client
+// sockets copy it in any reactor thread.
+class slave_list {
+public:
+    void set(const std::vector<repl_socket*>& slaves) {
+        std::lock_guard<cybozu::spinlock> g(m_lock);
+        m_slaves = slaves;
+    }
+
+    void copy_to(std::vector<repl_socket*>& slaves) const {
+        std::lock_guard<cybozu::spinlock> g(m_lock);
+        slaves = m_slaves;
+    }
+
+private:
+    mutable cybozu::spinlock m_lock;
+    std::vector<repl_socket*> m_slaves;
+};
+
 class memcache_socket: public cybozu::tcp_socket {
 public:
     memcache_socket(int fd,
                     const std::function<cybozu::worker*()>& finder,
                     cybozu::hash_map<object>& hash,
-                    const std::vector<repl_socket*>& slaves);
+                    const slave_list& slaves);
     virtual ~memcache_socket();
 
     void add_lock(const cybozu::hash_key& k) {
@@ -58,6 +83,9 @@ public:
         m_locks.clear();
     }
 
+    // Flush all objects at `at`, and replicate it to slaves.
+    void flush_all(std::time_t at);
+
     // Process a binary request command.
     // @cmd     A binary request.
     void cmd_bin(const memcache::binary_request& cmd);
@@ -71,8 +99,13 @@ private:
     std::atomic<bool> m_busy;
     const std::function<cybozu::worker*()>& m_finder;
     cybozu::hash_map<object>& m_hash;
+    // data of incomplete requests.  <m_consumed> bytes at the head
+    // have been processed, and <m_required> bytes after them are
+    // needed to complete the next request, if known.
     cybozu::dynbuf m_pending;
-    const std::vector<repl_socket*>& m_slaves_origin;
+    std::size_t m_consumed = 0;
+    std::size_t m_required = 0;
+    const slave_list& m_slaves_origin;
     std::vector<repl_socket*> m_slaves;
     cybozu::worker::job m_recvjob;
     cybozu::worker::job m_sendjob;
@@ -87,6 +120,9 @@ private:
     }
     virtual bool on_readable(int) override final;
     virtual bool on_writable(int) override final;
+    virtual io_mode preferred_mode() const override final {
+        return io_mode::RECV;
+    }
 };
 
 
@@ -96,11 +132,15 @@ class repl_socket: public cybozu::tcp_socket {
 public:
     repl_socket(int fd, unsigned int bufcnt,
                 const std::function<cybozu::worker*()>& finder)
-        : cybozu::tcp_socket(fd, bufcnt),
+        : cybozu::tcp_socket(fd),
           m_finder(finder),
           m_recvbuf(MAX_RECVSIZE),
           m_last_heartbeat(g_current_time.load(std::memory_order_relaxed))
     {
+        // workers replicating objects concurrently never wait
+        // for each other nor for the slave.
+        enable_send_queue(static_cast<std::size_t>(bufcnt) << 20);
+        enable_zerocopy(g_config.zerocopy_threshold());
         m_sendjob = [this](cybozu::dynbuf&) {
             with_fd([=](int fd) -> bool {
                 return write_pending_data(fd);
@@ -126,10 +166,27 @@ public:
         return addr;
     }
     
+    // `true` if too much data are waiting to be sent to the slave.
+    bool lagging() const {
+        std::size_t limit = g_config.repl_lag_limit();
+        return limit != 0 && queued_bytes() > limit;
+    }
+
     virtual void on_buffer_full() override {
+        g_stats.repl_spills.fetch_add(1, std::memory_order_relaxed);
         cybozu::logger::warning()
-            << "Replication buffer is full. "
-            << "Please enlarge \"repl_buffer_size\" to avoid the hang up of yrmcds.";
+            << "Replication to " << peer_ip() << " is lagging; "
+            << "data beyond \"repl_buffer_size\" are kept in a temporary file.";
+    }
+
+    virtual int create_spill_file() override {
+        try {
+            return mkstemp_wrap(g_config.tempdir());
+        } catch( const std::exception& e ) {
+            cybozu::logger::error() << "Failed to create a file for replication: "
+                                    << e.what();
+            return -1;
+        }
     }
 
 private:
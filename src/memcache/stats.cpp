@@ -16,10 +16,15 @@ void statistics::reset() noexcept {
     objects_under_1m = 0;
     objects_under_4m = 0;
     objects_huge = 0;
+    compressed_objects = 0;
+    for( auto& v: size_class_bytes )
+        v = 0;
+    for( auto& v: size_class_stored )
+        v = 0;
 
     /* bucket statistics.  Updated at every GC. */
-    used_memory = 0;
     conflicts = 0;
+    allocated_bytes = 0;
 
     /* GC statistics. Updated at every GC, of course. */
     gc_count = 0;
@@ -28,6 +33,9 @@ void statistics::reset() noexcept {
     last_expirations = 0;
     last_evictions = 0;
     total_evictions = 0;
+    write_evictions = 0;
+    evicted_bytes = 0;
+    last_demotions = 0;
     last_gc_elapsed = 0;
     total_gc_elapsed = 0;
 
@@ -35,12 +43,23 @@ void statistics::reset() noexcept {
     repl_created = 0;
     repl_updated = 0;
     repl_removed = 0;
+    repl_expired = 0;
 
     /* Realtime staticstics. */
     total_objects = 0;
-    flush_time = 0;
+    tier_objects = 0;
+    tier_bytes = 0;
+    tier_disk_bytes = 0;
+    total_demotions = 0;
+    total_promotions = 0;
+    flushed_files = 0;
+    dropped_pages = 0;
+    last_flush_elapsed = 0;
+    total_flush_elapsed = 0;
     curr_connections = 0;
     total_connections = 0;
+    repl_spills = 0;
+    repl_cutoffs = 0;
     for( auto& v: text_ops )
         v = 0;
     for( auto& v: bin_ops )
@@ -6,6 +6,8 @@
 
 #include "memcache.hpp"
 
+#include <cybozu/sharded_counter.hpp>
+
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
@@ -13,6 +15,21 @@
 
 namespace yrmcds { namespace memcache {
 
+// The number of object size classes in "stats sizes".
+const std::size_t SIZE_CLASSES = 8;
+
+// Return the size class of an object of `size` bytes.
+inline std::size_t size_class(std::size_t size) noexcept {
+    if( size < 1024 ) return 0;
+    if( size < 4096 ) return 1;
+    if( size < (16 <<10) ) return 2;
+    if( size < (64 <<10) ) return 3;
+    if( size < (256 <<10) ) return 4;
+    if( size < (1 <<20) ) return 5;
+    if( size < (4 <<20) ) return 6;
+    return 7;
+}
+
 // statistics counters.
 struct statistics {
     statistics() {
@@ -33,10 +50,15 @@ struct statistics {
     std::atomic<std::uint32_t> objects_under_1m;
     std::atomic<std::uint32_t> objects_under_4m;
     std::atomic<std::uint32_t> objects_huge;
+    std::atomic<std::uint32_t> compressed_objects;
+
+    /* logical and stored object bytes by size class.  Updated at every GC. */
+    std::atomic<std::uint64_t> size_class_bytes[SIZE_CLASSES];
+    std::atomic<std::uint64_t> size_class_stored[SIZE_CLASSES];
 
     /* bucket statistics.  Updated at every GC. */
-    std::atomic<std::size_t> used_memory;
     std::atomic<std::uint32_t> conflicts;
+    std::atomic<std::size_t> allocated_bytes; // only with tcmalloc
 
     /* GC statistics. Updated at every GC, of course. */
     std::atomic<std::uint32_t> gc_count;
@@ -45,6 +67,9 @@ struct statistics {
     std::atomic<std::uint32_t> last_expirations;
     std::atomic<std::uint32_t> last_evictions;
     std::atomic<std::uint64_t> total_evictions;
+    std::atomic<std::uint64_t> write_evictions;
+    std::atomic<std::uint64_t> evicted_bytes;
+    std::atomic<std::uint32_t> last_demotions;
     std::atomic<std::uint64_t> last_gc_elapsed;  // micro seconds
     std::atomic<std::uint64_t> total_gc_elapsed; // micro seconds
 
@@ -52,15 +77,32 @@ struct statistics {
     std::uint64_t repl_created;
     std::uint64_t repl_updated;
     std::uint64_t repl_removed;
+    std::uint64_t repl_expired; // expired locally on a slave
 
     /* Realtime staticstics. */
+    // Memory used by objects, updated whenever objects change.
+    // This is not cleared by <reset> as it reflects live objects.
+    cybozu::sharded_counter used_memory;
+    // Worker threads executing receive jobs, to pace GC.
+    cybozu::sharded_counter busy_workers;
     alignas(CACHELINE_SIZE)
     std::atomic<std::uint64_t> total_objects;
     alignas(CACHELINE_SIZE)
-    std::atomic<std::time_t> flush_time; // abused by "flush_all"
+    std::atomic<std::uint64_t> tier_objects;
+    std::atomic<std::uint64_t> tier_bytes;
+    std::atomic<std::uint64_t> tier_disk_bytes;
+    std::atomic<std::uint64_t> total_demotions;
+    std::atomic<std::uint64_t> total_promotions;
+    alignas(CACHELINE_SIZE)
+    std::atomic<std::uint64_t> flushed_files;
+    std::atomic<std::uint64_t> dropped_pages;
+    std::atomic<std::uint64_t> last_flush_elapsed;  // micro seconds
+    std::atomic<std::uint64_t> total_flush_elapsed; // micro seconds
     alignas(CACHELINE_SIZE)
     std::atomic<std::uint64_t> curr_connections;
     std::atomic<std::uint64_t> total_connections;
+    std::atomic<std::uint64_t> repl_spills;  // slaves lagging beyond memory
+    std::atomic<std::uint64_t> repl_cutoffs; // slaves closed for lagging
     alignas(CACHELINE_SIZE)
     std::atomic<std::uint64_t> text_ops[(std::size_t)memcache::text_command::END_OF_COMMAND];
     std::atomic<std::uint64_t> bin_ops[(std::size_t)memcache::binary_command::END_OF_COMMAND];
@@ -0,0 +1,136 @@
+// (C) 2026 Cybozu.
+
+#include "../config.hpp"
+#include "../tempfile.hpp"
+#include "stats.hpp"
+#include "tier.hpp"
+
+#include <cybozu/util.hpp>
+
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+const std::memory_order relaxed = std::memory_order_relaxed;
+
+} // anonymous namespace
+
+namespace yrmcds { namespace memcache {
+
+tier_segment::tier_segment():
+    m_fd(mkstemp_wrap(g_config.tempdir())), m_live_bytes(0), m_pending(0) {}
+
+tier_segment::~tier_segment() {
+    ::close(m_fd);
+    g_stats.tier_disk_bytes.fetch_sub(m_size, relaxed);
+}
+
+std::uint64_t tier_segment::append(const char* p, std::size_t len) {
+    std::uint64_t offset = m_size;
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        m_pending.append(p, len);
+    }
+    m_size += len;
+    g_stats.tier_disk_bytes.fetch_add(len, relaxed);
+    return offset;
+}
+
+void tier_segment::flush() {
+    std::lock_guard<std::mutex> g(m_lock);
+    const char* p = m_pending.data();
+    std::size_t len = m_pending.size();
+    std::uint64_t offset = m_flushed;
+    while( len != 0 ) {
+        ssize_t n = ::pwrite(m_fd, p, len, offset);
+        if( n == -1 ) {
+            if( errno == EINTR ) continue;
+            cybozu::throw_unix_error(errno, "pwrite");
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    m_flushed = offset;
+    m_pending.reset();
+}
+
+void tier_segment::read(std::uint64_t offset, std::size_t len,
+                        cybozu::dynbuf& buf) const {
+    char* p = buf.prepare(len);
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        if( offset >= m_flushed ) {
+            std::memcpy(p, m_pending.data() + (offset - m_flushed), len);
+            buf.consume(len);
+            return;
+        }
+    }
+
+    // flushed data are never modified.
+    while( len != 0 ) {
+        ssize_t n = ::pread(m_fd, p, len, offset);
+        if( n == -1 ) {
+            if( errno == EINTR ) continue;
+            cybozu::throw_unix_error(errno, "pread");
+        }
+        if( n == 0 )
+            throw std::runtime_error("<tier_segment::read> unexpected EOF.");
+        p += n;
+        len -= n;
+        offset += n;
+        buf.consume(n);
+    }
+}
+
+tier_ref::tier_ref(const std::shared_ptr<tier_segment>& segment,
+                   std::uint64_t offset, std::size_t length):
+    m_segment(segment), m_offset(offset), m_length(length) {
+    m_segment->m_live_bytes.fetch_add(length, relaxed);
+    g_stats.tier_objects.fetch_add(1, relaxed);
+    g_stats.tier_bytes.fetch_add(length, relaxed);
+}
+
+tier_ref::~tier_ref() {
+    m_segment->m_live_bytes.fetch_sub(m_length, relaxed);
+    g_stats.tier_objects.fetch_sub(1, relaxed);
+    g_stats.tier_bytes.fetch_sub(m_length, relaxed);
+}
+
+bool tier_store::enabled() noexcept {
+    return g_config.tier_storage_limit() != 0;
+}
+
+bool tier_store::full(std::size_t len) noexcept {
+    return g_stats.tier_disk_bytes.load(relaxed) + len >
+        g_config.tier_storage_limit();
+}
+
+std::unique_ptr<tier_ref> tier_store::put(const char* p, std::size_t len) {
+    if( full(len) )
+        return nullptr;
+
+    if( m_segment.get() == nullptr || m_segment->size() >= TIER_SEGMENT_SIZE ) {
+        if( m_segment.get() != nullptr )
+            m_retired.push_back(std::move(m_segment));
+        m_segment = std::make_shared<tier_segment>();
+    }
+    std::uint64_t offset = m_segment->append(p, len);
+    m_buffered += len;
+    g_stats.total_demotions.fetch_add(1, relaxed);
+    return std::unique_ptr<tier_ref>(new tier_ref(m_segment, offset, len));
+}
+
+void tier_store::flush(bool force) {
+    if( ! force && m_buffered < TIER_BATCH_SIZE )
+        return;
+    for( auto& s: m_retired )
+        s->flush();
+    m_retired.clear();
+    if( m_segment.get() != nullptr )
+        m_segment->flush();
+    m_buffered = 0;
+}
+
+}} // namespace yrmcds::memcache
@@ -0,0 +1,145 @@
+// Second storage tier for cold objects.
+// (C) 2026 Cybozu.
+
+#ifndef YRMCDS_MEMCACHE_TIER_HPP
+#define YRMCDS_MEMCACHE_TIER_HPP
+
+#include <cybozu/dynbuf.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace yrmcds { namespace memcache {
+
+// An append-only file to store data of demoted objects.
+//
+// Data appended to a segment are buffered in memory until <flush>
+// writes them out.  A segment is removed when the last <tier_ref>
+// referencing it is destroyed.
+class tier_segment {
+public:
+    tier_segment();
+    tier_segment(const tier_segment&) = delete;
+    tier_segment& operator=(const tier_segment&) = delete;
+    ~tier_segment();
+
+    // Append data.
+    // @p    Pointer to the data.
+    // @len  Length of the data.
+    //
+    // This may be called only by a single thread.
+    //
+    // @return  The offset of the data in the segment.
+    std::uint64_t append(const char* p, std::size_t len);
+
+    // Write buffered data to the file.
+    void flush();
+
+    // Read data.
+    // @offset  The offset returned by <append>.
+    // @len     The length of the data.
+    // @buf     Storage for the data.
+    //
+    // Read data and append them to `buf`.
+    void read(std::uint64_t offset, std::size_t len,
+              cybozu::dynbuf& buf) const;
+
+    // Return the total size of appended data.
+    std::uint64_t size() const noexcept {
+        return m_size;
+    }
+
+    // Return the size of data still referenced.
+    std::uint64_t live_bytes() const noexcept {
+        return m_live_bytes.load(std::memory_order_relaxed);
+    }
+
+private:
+    const int m_fd;
+    std::uint64_t m_size = 0;
+    std::atomic<std::uint64_t> m_live_bytes;
+    mutable std::mutex m_lock;
+    // the following members are guarded by m_lock.
+    cybozu::dynbuf m_pending;
+    std::uint64_t m_flushed = 0;
+
+    friend class tier_ref;
+};
+
+
+// Reference to data demoted to a <tier_segment>.
+class tier_ref {
+public:
+    tier_ref(const std::shared_ptr<tier_segment>& segment,
+             std::uint64_t offset, std::size_t length);
+    tier_ref(const tier_ref&) = delete;
+    tier_ref& operator=(const tier_ref&) = delete;
+    ~tier_ref();
+
+    // Read the data and append them to `buf`.
+    void read(cybozu::dynbuf& buf) const {
+        m_segment->read(m_offset, m_length, buf);
+    }
+
+    std::size_t length() const noexcept {
+        return m_length;
+    }
+
+    // Return `true` if most of the segment is no longer referenced.
+    bool sparse() const noexcept {
+        return m_segment->live_bytes() < (m_segment->size() / 4);
+    }
+
+    const tier_segment* segment() const noexcept {
+        return m_segment.get();
+    }
+
+private:
+    const std::shared_ptr<tier_segment> m_segment;
+    const std::uint64_t m_offset;
+    const std::size_t m_length;
+};
+
+
+// The second storage tier under `temp_dir`.
+//
+// Objects are demoted by the GC thread.  Data are written in batches
+// to the current segment, which is rotated when it grows large.
+class tier_store {
+public:
+    // Return `true` if demotion of objects is enabled.
+    static bool enabled() noexcept;
+
+    // Return `true` if there is no room for `len` bytes of data.
+    static bool full(std::size_t len = 0) noexcept;
+
+    // Demote data.
+    // @p    Pointer to the data.
+    // @len  Length of the data.
+    //
+    // @return  A reference to the demoted data, or `nullptr` if the
+    //          tier is full.
+    std::unique_ptr<tier_ref> put(const char* p, std::size_t len);
+
+    // Return `true` if `segment` is the current segment.
+    bool current(const tier_segment* segment) const noexcept {
+        return m_segment.get() == segment;
+    }
+
+    // Write buffered data to segments if there are enough.
+    // @force  If `true`, write all buffered data.
+    void flush(bool force = false);
+
+private:
+    std::shared_ptr<tier_segment> m_segment;
+    std::vector<std::shared_ptr<tier_segment>> m_retired;
+    std::size_t m_buffered = 0;
+};
+
+}} // namespace yrmcds::memcache
+
+#endif // YRMCDS_MEMCACHE_TIER_HPP
@@ -0,0 +1,46 @@
+// (C) 2026 Cybozu.
+
+#include "reactor_thread.hpp"
+#include "handler.hpp"
+
+#include <cybozu/logger.hpp>
+
+namespace yrmcds {
+
+reactor_thread::reactor_thread(
+    const std::vector<std::unique_ptr<cybozu::worker>>& workers,
+    std::size_t first, std::size_t last):
+    m_workers(workers), m_first(first), m_last(last),
+    m_worker_index(first), m_reactor(reactor_backend()),
+    m_reclaimer(workers, first, last), m_stop(false) {
+    m_finder = [this]() -> cybozu::worker* {
+        return cybozu::choose_worker(m_workers, m_first, m_last,
+                                     m_worker_index);
+    };
+}
+
+reactor_thread::~reactor_thread() {
+    quit();
+    join();
+}
+
+void reactor_thread::run() {
+    cybozu::logger::info() << "Reactor thread id="
+                           << std::this_thread::get_id();
+    m_reactor.run([this](cybozu::reactor& r) {
+            if( m_stop.load(std::memory_order_relaxed) ) {
+                r.invalidate();
+                r.quit();
+                return;
+            }
+
+            if( ! m_reclaimer.empty() )
+                m_reclaimer.check();
+            if( r.has_garbage() && m_reclaimer.empty() ) {
+                r.fix_garbage();
+                m_reclaimer.defer([&r]{ r.gc(); });
+            }
+        });
+}
+
+} // namespace yrmcds
@@ -0,0 +1,76 @@
+// Additional reactor threads.
+// (C) 2026 Cybozu.
+
+#ifndef YRMCDS_REACTOR_THREAD_HPP
+#define YRMCDS_REACTOR_THREAD_HPP
+
+#include "reclaimer.hpp"
+
+#include <cybozu/reactor.hpp>
+#include <cybozu/thread.hpp>
+#include <cybozu/worker.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace yrmcds {
+
+// An additional reactor thread with its own share of workers.
+//
+// In the master mode, client connections are distributed among
+// reactors by `SO_REUSEPORT` listening sockets.  Each additional
+// reactor polls the connections accepted by its own listening sockets,
+// and dispatches them to the workers in [`first`, `last`) of the
+// worker list.  Those workers steal jobs only from each other, so
+// closed connections are reclaimed once the jobs posted to them have
+// finished, as the main reactor does with its reclaimer.
+class reactor_thread final: public cybozu::thread_base<reactor_thread> {
+public:
+    reactor_thread(const std::vector<std::unique_ptr<cybozu::worker>>& workers,
+                   std::size_t first, std::size_t last);
+    reactor_thread(const reactor_thread&) = delete;
+    reactor_thread& operator=(const reactor_thread&) = delete;
+    ~reactor_thread();
+
+    cybozu::reactor& get_reactor() noexcept {
+        return m_reactor;
+    }
+
+    // Return a function to find a worker of this reactor.
+    const std::function<cybozu::worker*()>& finder() const noexcept {
+        return m_finder;
+    }
+
+    // Ask the thread to invalidate all resources and quit the loop.
+    //
+    // The thread quits within the interval of the reactor loop.
+    void quit() noexcept {
+        m_stop.store(true, std::memory_order_relaxed);
+    }
+
+    // Wait for the thread to quit.
+    void join() {
+        if( m_thread.joinable() )
+            m_thread.join();
+    }
+
+    // CRTP method for <cybozu::thread_base>.
+    void run();
+
+private:
+    const std::vector<std::unique_ptr<cybozu::worker>>& m_workers;
+    const std::size_t m_first;
+    const std::size_t m_last;
+    std::size_t m_worker_index;
+    std::function<cybozu::worker*()> m_finder;
+    cybozu::reactor m_reactor;
+    reclaimer m_reclaimer;
+    std::atomic<bool> m_stop;
+};
+
+} // namespace yrmcds
+
+#endif // YRMCDS_REACTOR_THREAD_HPP
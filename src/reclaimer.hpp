@@ -0,0 +1,132 @@
+// Reclamation of resources shared with workers.
+// (C) 2013 Cybozu.
+
+#ifndef YRMCDS_RECLAIMER_HPP
+#define YRMCDS_RECLAIMER_HPP
+
+#include <cybozu/epoch.hpp>
+#include <cybozu/worker.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace yrmcds {
+
+// Epoch-based reclamation for resources shared with workers.
+//
+// An action deferred by <defer> runs after every job posted to the
+// workers in the range [`first`, `last`) of `workers` before the
+// deferral has finished.  Typically, the action destructs resources
+// that have been unlinked before the deferral.
+//
+// As workers steal jobs from each other, this is checked in two steps.
+// First, wait until all the jobs queued at the time of the deferral
+// have been taken by some workers.  Then, advance the global epoch,
+// and wait until every worker has passed it.  A worker announces
+// a quiescent state after every job and before taking a job, so
+// a worker that has passed the epoch has finished the jobs it took.
+//
+// Actions run in the order of deferral.  Actions whose jobs have been
+// taken by the same <check> share an epoch.
+class reclaimer {
+public:
+    explicit reclaimer(const std::vector<std::unique_ptr<cybozu::worker>>& workers,
+                       std::size_t first = 0, std::size_t last = SIZE_MAX):
+        m_workers(workers), m_first(first), m_last(last) {}
+
+    bool empty() const noexcept {
+        return m_actions.empty();
+    }
+
+    // Defer an action.
+    // @action  A function to be called by <check>.
+    void defer(std::function<void()> action) {
+        m_actions.emplace_back();
+        deferred& d = m_actions.back();
+        d.action = std::move(action);
+        const std::size_t n = last();
+        d.posted.reserve(n - m_first);
+        for( std::size_t i = m_first; i < n; ++i )
+            d.posted.push_back(m_workers[i]->posted_jobs());
+        check();
+    }
+
+    // Run deferred actions that are ready.
+    //
+    // Only the thread calling <defer> can call this.
+    void check() {
+        const std::size_t n = last();
+
+        // assign a new epoch to actions whose jobs have been taken.
+        bool advance = false;
+        for( auto& d: m_actions ) {
+            if( d.epoch != 0 )
+                continue;
+            if( ! drained(d, n) )
+                break;
+            advance = true;
+            d.epoch = UINT64_MAX;
+        }
+        if( advance ) {
+            // the loads in <drained> synchronize with the taking,
+            // which follows a quiescent state of the taker.
+            const std::uint64_t e = cybozu::epoch_record::advance();
+            for( auto& d: m_actions ) {
+                if( d.epoch == UINT64_MAX )
+                    d.epoch = e;
+            }
+        }
+
+        while( ! m_actions.empty() ) {
+            deferred& d = m_actions.front();
+            if( d.epoch == 0 || ! passed(d.epoch, n) )
+                break;
+            std::function<void()> action = std::move(d.action);
+            m_actions.pop_front();
+            action();
+        }
+    }
+
+private:
+    struct deferred {
+        std::function<void()> action;
+        // jobs posted to each worker when the action was deferred.
+        std::vector<std::uint64_t> posted;
+        // the epoch to be passed, or 0 if jobs are still queued.
+        std::uint64_t epoch = 0;
+    };
+
+    const std::vector<std::unique_ptr<cybozu::worker>>& m_workers;
+    const std::size_t m_first;
+    const std::size_t m_last;
+    std::deque<deferred> m_actions;
+
+    std::size_t last() const noexcept {
+        return std::max(m_first, std::min(m_last, m_workers.size()));
+    }
+
+    bool drained(const deferred& d, std::size_t n) const noexcept {
+        for( std::size_t i = m_first; i < n; ++i ) {
+            if( m_workers[i]->taken_jobs() < d.posted[i - m_first] )
+                return false;
+        }
+        return true;
+    }
+
+    bool passed(std::uint64_t e, std::size_t n) const noexcept {
+        for( std::size_t i = m_first; i < n; ++i ) {
+            if( ! m_workers[i]->epoch().passed(e) )
+                return false;
+        }
+        return true;
+    }
+};
+
+} // namespace yrmcds
+
+#endif // YRMCDS_RECLAIMER_HPP
@@ -17,26 +17,20 @@
 
 namespace yrmcds {
 
-server::server(): m_syncer(m_workers) {
+server::server(): m_reactor(reactor_backend()), m_reclaimer(m_workers) {
     auto finder = [this]() ->cybozu::worker* {
-        std::size_t n_workers = m_workers.size();
-        for( std::size_t i = 0; i < n_workers; ++i ) {
-            cybozu::worker* pw = m_workers[m_worker_index].get();
-            m_worker_index = (m_worker_index + 1) % n_workers;
-            if( ! pw->is_running() )
-                return pw;
-        }
-        return nullptr;
+        return cybozu::choose_worker(m_workers, 0, m_main_workers,
+                                     m_worker_index);
     };
 
-    m_handlers.emplace_back(new memcache::handler(finder, m_reactor, m_syncer));
+    m_handlers.emplace_back(new memcache::handler(finder, m_reactor, m_reclaimer));
     if( g_config.counter().enable() )
         m_handlers.emplace_back(new counter::handler(finder, m_reactor));
 }
 
 inline bool server::reactor_gc_ready() {
     if( ! m_reactor.has_garbage() ) return false;
-    if( ! m_syncer.empty() ) return false;
+    if( ! m_reclaimer.empty() ) return false;
     auto ready = [](const std::unique_ptr<protocol_handler>& p) {
         return p->reactor_gc_ready();
     };
@@ -135,26 +129,51 @@ void server::serve_master() {
         std::time_t now = std::time(nullptr);
         g_current_time.store(now, std::memory_order_relaxed);
 
-        if( ! m_syncer.empty() )
-            m_syncer.check();
+        if( ! m_reclaimer.empty() )
+            m_reclaimer.check();
         for( auto& handler: m_handlers )
             handler->on_master_interval();
 
         if( reactor_gc_ready() ) {
             m_reactor.fix_garbage();
-            m_syncer.add_request(
-                std::unique_ptr<sync_request>(
-                    new sync_request([this]{ m_reactor.gc(); })
-                    ));
+            m_reclaimer.defer([this]{ m_reactor.gc(); });
         }
     };
 
     for( unsigned int i = 0; i < g_config.workers(); ++i )
         m_workers.emplace_back(new cybozu::worker(WORKER_BUFSIZE));
+
+    // workers are divided among reactors, and steal jobs only from
+    // workers of the same reactor.
+    const std::size_t n_workers = m_workers.size();
+    const std::size_t n_reactors = std::min<std::size_t>(g_config.reactors(),
+                                                         n_workers);
+    m_main_workers = n_workers / n_reactors;
+    for( std::size_t i = 0; i < n_reactors; ++i ) {
+        std::size_t first = n_workers * i / n_reactors;
+        std::size_t last = n_workers * (i + 1) / n_reactors;
+        for( std::size_t j = first; j < last; ++j )
+            m_workers[j]->set_peers(m_workers, first, last);
+    }
     for( auto& w: m_workers )
         w->start();
 
+    for( std::size_t i = 1; i < n_reactors; ++i ) {
+        m_reactor_threads.emplace_back(
+            new reactor_thread(m_workers, n_workers * i / n_reactors,
+                               n_workers * (i + 1) / n_reactors));
+        reactor_thread& t = *m_reactor_threads.back();
+        for( auto& handler: m_handlers )
+            handler->on_reactor_start(t.get_reactor(), t.finder());
+    }
+    for( auto& t: m_reactor_threads )
+        t->start();
+
     auto stop = [this] {
+        for( auto& t: m_reactor_threads )
+            t->quit();
+        for( auto& t: m_reactor_threads )
+            t->join();
         m_reactor.invalidate();
         for( auto& w: m_workers )
             w->stop();
@@ -6,7 +6,8 @@
 
 #include "config.hpp"
 #include "handler.hpp"
-#include "sync.hpp"
+#include "reactor_thread.hpp"
+#include "reclaimer.hpp"
 
 #include <cybozu/hash_map.hpp>
 #include <cybozu/ip_address.hpp>
@@ -33,8 +34,10 @@ private:
     bool m_signaled = false;
     cybozu::reactor m_reactor;
     std::vector<std::unique_ptr<cybozu::worker>> m_workers;
-    int m_worker_index = 0;
-    syncer m_syncer;
+    std::size_t m_main_workers = 0; // workers of the main reactor
+    std::size_t m_worker_index = 0;
+    std::vector<std::unique_ptr<reactor_thread>> m_reactor_threads;
+    reclaimer m_reclaimer;
     std::vector<std::unique_ptr<protocol_handler>> m_handlers;
 
     bool reactor_gc_ready();
@@ -9,6 +9,7 @@
 namespace yrmcds {
 
 void tempfile::write(const char* p, std::size_t len) {
+    m_flushed = false;
     while( len != 0 ) {
         ssize_t n = ::write(m_fd, p, len);
         if( n == -1 )
@@ -25,6 +26,7 @@ void tempfile::clear() {
     if( ftruncate(m_fd, 0) == -1 )
         cybozu::throw_unix_error(errno, "ftruncate");
     m_length = 0;
+    m_flushed = false;
 }
 
 void tempfile::read_contents(cybozu::dynbuf& buf) const {
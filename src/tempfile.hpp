@@ -62,9 +62,20 @@ public:
         return m_length;
     }
 
+    // Return `true` if the contents have been flushed from the page
+    // cache since the last modification.
+    bool flushed() const noexcept {
+        return m_flushed;
+    }
+
+    void set_flushed() noexcept {
+        m_flushed = true;
+    }
+
 private:
     const int m_fd;
     std::size_t m_length = 0;
+    bool m_flushed = false;
 };
 
 } // namespace yrmcds
@@ -14,7 +14,16 @@ AUTOTEST(config) {
     cybozu_assert(g_config.user() == "nobody");
     cybozu_assert(g_config.group() == "nogroup");
     cybozu_assert(g_config.memory_limit() == (1024 << 20));
+    cybozu_assert(g_config.compression_threshold() == (2 << 10));
+    cybozu_assert(g_config.tier_storage_limit() == (std::size_t(4) << 30));
+    cybozu_assert(g_config.page_flush_budget() == (64 << 20));
+    cybozu_assert(g_config.eviction_policy() ==
+                  yrmcds::eviction_policy::tinylfu);
     cybozu_assert(g_config.repl_bufsize() == 100);
+    cybozu_assert(g_config.repl_lag_limit() ==
+                  (static_cast<std::size_t>(2) << 30));
+    cybozu_assert(g_config.send_buffer_limit() == (64 << 20));
+    cybozu_assert(g_config.zerocopy_threshold() == (128 << 10));
     cybozu_assert(g_config.initial_repl_sleep_delay_usec() == 40);
     cybozu_assert(g_config.secure_erase() == true);
     cybozu_assert(g_config.lock_memory() == true);
@@ -22,7 +31,10 @@ AUTOTEST(config) {
     cybozu_assert(g_config.max_data_size() == (5 << 20));
     cybozu_assert(g_config.heap_data_limit() == (16 << 10));
     cybozu_assert(g_config.workers() == 10);
+    cybozu_assert(g_config.reactors() == 2);
+    cybozu_assert(g_config.io_uring() == false);
     cybozu_assert(g_config.gc_interval() == 20);
+    cybozu_assert(g_config.gc_threads() == 4);
     cybozu_assert(g_config.slave_timeout() == 15);
     cybozu_assert(g_config.counter().enable() == true);
     cybozu_assert(g_config.counter().port() == 11216);
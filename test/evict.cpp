@@ -0,0 +1,254 @@
+#include "../src/config.hpp"
+#include "../src/global.hpp"
+#include "../src/memcache/evict.hpp"
+#include "../src/memcache/policy.hpp"
+#include "../src/memcache/replication.hpp"
+
+#include <cybozu/hash_map.hpp>
+#include <cybozu/test.hpp>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+using yrmcds::memcache::object;
+using yrmcds::memcache::g_stats;
+using yrmcds::memcache::repl_socket;
+
+namespace {
+
+// Connect a pair of TCP sockets.  `s` is set non-blocking.
+void connect_pair(int& c, int& s) {
+    int l = ::socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    cybozu_assert(::bind(l, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    cybozu_assert(::listen(l, 1) == 0);
+    cybozu_assert(::getsockname(l, (struct sockaddr*)&addr, &addrlen) == 0);
+    c = ::socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    cybozu_assert(::connect(c, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    s = ::accept4(l, nullptr, nullptr, SOCK_NONBLOCK|SOCK_CLOEXEC);
+    cybozu_assert(s != -1);
+    ::close(l);
+}
+
+// A replication socket without a reactor.
+struct fake_slave: public repl_socket {
+    fake_slave(int fd, const std::function<cybozu::worker*()>& finder):
+        repl_socket(fd, 1, finder) {}
+    bool drain() {
+        return with_fd([this](int fd) -> bool {
+            return write_pending_data(fd);
+        });
+    }
+};
+
+} // anonymous namespace
+
+AUTOTEST(sampled_lru) {
+    cybozu::hash_map<object> hash(101);
+    std::vector<yrmcds::memcache::repl_socket*> slaves;
+    std::string value(10000, 'x');
+    std::time_t now = yrmcds::g_current_time.load();
+
+    for( int i = 0; i < 100; ++i ) {
+        std::string key = "key" + std::to_string(i);
+        hash.apply(cybozu::hash_key(key.data(), key.size()), nullptr,
+                   [&value](const cybozu::hash_key& k) -> object {
+                       return object(value.data(), value.size(), 0, 0,
+                                     k.length());
+                   });
+    }
+
+    // access even keys later.
+    yrmcds::g_current_time.store(now + 10);
+    cybozu::dynbuf buf(0);
+    for( int i = 0; i < 100; i += 2 ) {
+        std::string key = "key" + std::to_string(i);
+        hash.apply(cybozu::hash_key(key.data(), key.size()),
+                   [&buf](const cybozu::hash_key&, object& obj) -> bool {
+                       obj.data(buf);
+                       return true;
+                   }, nullptr);
+    }
+
+    std::int64_t used = g_stats.used_memory.sum();
+    yrmcds::g_config.set_memory_limit(used * 3 / 4);
+    cybozu_assert( yrmcds::memcache::memory_exceeded() );
+    std::uint32_t n = yrmcds::memcache::evict_objects(hash, slaves);
+    cybozu_assert( n > 0 );
+    cybozu_assert( ! yrmcds::memcache::memory_above_low_watermark() );
+    cybozu_assert( g_stats.total_evictions.load() == n );
+
+    int hot = 0, cold = 0;
+    for( int i = 0; i < 100; ++i ) {
+        std::string key = "key" + std::to_string(i);
+        bool found = hash.apply(cybozu::hash_key(key.data(), key.size()),
+                                [](const cybozu::hash_key&, object&) -> bool {
+                                    return true;
+                                }, nullptr);
+        if( found )
+            ++ ((i % 2 == 0) ? hot : cold);
+    }
+    cybozu_assert( hot + cold == 100 - static_cast<int>(n) );
+    cybozu_assert( hot >= 40 );
+    cybozu_assert( hot > cold );
+}
+
+AUTOTEST(step) {
+    cybozu::hash_map<object> hash(101);
+    std::vector<yrmcds::memcache::repl_socket*> slaves;
+    // large enough for the approximate usage of memory_exceeded.
+    std::string value(100000, 'x');
+
+    for( int i = 0; i < 100; ++i ) {
+        std::string key = "step" + std::to_string(i);
+        hash.apply(cybozu::hash_key(key.data(), key.size()), nullptr,
+                   [&value](const cybozu::hash_key& k) -> object {
+                       return object(value.data(), value.size(), 0, 0,
+                                     k.length());
+                   });
+    }
+
+    // a step stops as soon as the usage falls under the limit.
+    std::int64_t used = g_stats.used_memory.sum();
+    yrmcds::g_config.set_memory_limit(used - 250000);
+    std::uint32_t n = yrmcds::memcache::evict_some(hash, slaves);
+    cybozu_assert( n >= 3 );
+    cybozu_assert( n <= yrmcds::EVICT_STEP_ROUNDS );
+    cybozu_assert( ! yrmcds::memcache::memory_exceeded() );
+    cybozu_assert( yrmcds::memcache::memory_above_low_watermark() );
+
+    // a step is bounded, and leaves the rest to evict_objects.
+    used = g_stats.used_memory.sum();
+    yrmcds::g_config.set_memory_limit(used / 2);
+    n = yrmcds::memcache::evict_some(hash, slaves);
+    cybozu_assert( n == yrmcds::EVICT_STEP_ROUNDS );
+    cybozu_assert( yrmcds::memcache::memory_exceeded() );
+    yrmcds::memcache::evict_objects(hash, slaves);
+    cybozu_assert( ! yrmcds::memcache::memory_above_low_watermark() );
+}
+
+AUTOTEST(policies) {
+    using yrmcds::memcache::make_policy;
+    std::string small(100, 'x');
+    std::string large(100000, 'x');
+    object a(small.data(), small.size(), 0, 0);
+    object b(large.data(), large.size(), 0, 0);
+    cybozu::hash_key ka("a", 1);
+    cybozu::hash_key kb("b", 1);
+    std::uint32_t now = static_cast<std::uint32_t>(a.atime());
+
+    auto lru = make_policy(yrmcds::eviction_policy::lru, 100);
+    cybozu_assert( std::string(lru->name()) == "lru" );
+    cybozu_assert( lru->score(ka, a, now + 10) > lru->score(kb, b, now) );
+
+    // size-aware eviction prefers a large object accessed as recently.
+    auto size = make_policy(yrmcds::eviction_policy::size, 100);
+    cybozu_assert( size->score(kb, b, now + 10) > size->score(ka, a, now + 10) );
+
+    // TinyLFU keeps frequently accessed objects out of the window.
+    auto lfu = make_policy(yrmcds::eviction_policy::tinylfu, 100);
+    for( int i = 0; i < 10; ++i )
+        lfu->record(ka);
+    lfu->record(kb);
+    cybozu_assert( lfu->score(kb, b, now + 1) > lfu->score(ka, a, now + 10) );
+    // objects in the window are evicted last.
+    cybozu_assert( lfu->score(ka, a, now + 10) > lfu->score(kb, b, now) );
+}
+
+AUTOTEST(repl_order) {
+    int c, s;
+    connect_pair(c, s);
+    std::function<cybozu::worker*()> finder = []{ return nullptr; };
+    fake_slave slave(s, finder);
+    std::vector<repl_socket*> slaves = {&slave};
+
+    // read until the slave socket is shut down.
+    std::string received;
+    std::thread reader([c, &received] {
+        char buf[65536];
+        while( true ) {
+            ssize_t n = ::recv(c, buf, sizeof(buf), 0);
+            if( n <= 0 ) return;
+            received.append(buf, n);
+        }
+    });
+
+    cybozu::hash_map<object> hash(10007);
+    // store an object and replicate it, as workers do.
+    auto set = [&hash,&slaves](const std::string& key,
+                               const std::string& value, bool update) {
+        cybozu::hash_map<object>::handler h = nullptr;
+        if( update ) {
+            h = [&value,&slaves](const cybozu::hash_key& k,
+                                 object& obj) -> bool {
+                obj.set(value.data(), value.size(), 0, 0);
+                yrmcds::memcache::repl_object(slaves, k, obj);
+                return true;
+            };
+        }
+        hash.apply(cybozu::hash_key(key.data(), key.size()), h,
+                   [&value,&slaves](const cybozu::hash_key& k) -> object {
+                       object o(value.data(), value.size(), 0, 0,
+                                k.length());
+                       yrmcds::memcache::repl_object(slaves, k, o);
+                       return o;
+                   });
+    };
+
+    // long enough for the setter to run in the middle of eviction.
+    std::string value(1000, 'x');
+    std::time_t now = yrmcds::g_current_time.load();
+    for( int i = 0; i < 20000; ++i )
+        set("order" + std::to_string(i), value, true);
+
+    // keys are stored again as soon as they are evicted.
+    yrmcds::g_current_time.store(now + 10);
+    std::atomic<bool> evicted(false);
+    std::atomic<int> loops(0);
+    std::thread setter([&set, &evicted, &loops] {
+        for( int i = 0; ! evicted.load(); ++i ) {
+            set("order" + std::to_string(i % 20000), "v", false);
+            ++ loops;
+        }
+    });
+    while( loops.load() == 0 )
+        std::this_thread::yield();
+
+    std::int64_t used = g_stats.used_memory.sum();
+    yrmcds::g_config.set_memory_limit(used / 2);
+    std::uint32_t n = yrmcds::memcache::evict_objects(hash, slaves);
+    evicted.store(true);
+    setter.join();
+    cybozu_assert( n > 0 );
+
+    while( slave.queued_bytes() != 0 )
+        cybozu_assert( slave.drain() );
+    ::shutdown(s, SHUT_WR); // flush corked data
+    reader.join();
+    ::close(c);
+
+    // the slave must end up with the same keys as the master.
+    cybozu::hash_map<object> replica(10007);
+    std::size_t consumed = yrmcds::memcache::repl_recv(
+        received.data(), received.size(), replica);
+    cybozu_assert( consumed == received.size() );
+    int diffs = 0;
+    for( int i = 0; i < 20000; ++i ) {
+        std::string key = "order" + std::to_string(i);
+        cybozu::hash_key k(key.data(), key.size());
+        auto found = [](const cybozu::hash_key&, object&) -> bool {
+            return true;
+        };
+        if( hash.apply(k, found, nullptr) != replica.apply(k, found, nullptr) )
+            ++ diffs;
+    }
+    cybozu_assert( diffs == 0 );
+}
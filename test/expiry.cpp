@@ -0,0 +1,134 @@
+#include "../src/memcache/expiry.hpp"
+
+#include <cybozu/test.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using yrmcds::memcache::expiry_wheel;
+
+AUTOTEST(expire) {
+    expiry_wheel wheel;
+    std::vector<std::uint64_t> hashes;
+    const std::time_t now = 1000000;
+
+    // entries registered before the first collection.
+    wheel.add(1, now + 5);
+    wheel.expire(now, hashes);
+    cybozu_assert( hashes.empty() );
+    cybozu_assert( wheel.size() == 1 );
+
+    wheel.add(2, now - 1);
+    wheel.add(3, now + 5);
+    wheel.add(4, now + 100);
+    wheel.expire(now + 1, hashes);
+    cybozu_assert( hashes.size() == 1 );
+    cybozu_assert( hashes[0] == 2 );
+
+    hashes.clear();
+    wheel.expire(now + 10, hashes);
+    std::sort(hashes.begin(), hashes.end());
+    cybozu_assert( hashes.size() == 2 );
+    cybozu_assert( hashes[0] == 1 );
+    cybozu_assert( hashes[1] == 3 );
+    cybozu_assert( wheel.size() == 1 );
+
+    hashes.clear();
+    wheel.expire(now + 100, hashes);
+    cybozu_assert( hashes.size() == 1 );
+    cybozu_assert( hashes[0] == 4 );
+    cybozu_assert( wheel.size() == 0 );
+}
+
+AUTOTEST(cascade) {
+    expiry_wheel wheel;
+    std::vector<std::uint64_t> hashes;
+    std::time_t now = 1000000;
+    wheel.expire(now, hashes);
+
+    const std::time_t far = expiry_wheel::L0_SLOTS * 10 + 7;
+    const std::time_t very_far =
+        expiry_wheel::L0_SLOTS * expiry_wheel::L1_SLOTS + 3;
+    wheel.add(10, now + far);
+    wheel.add(11, now + very_far);
+    wheel.add(12, now + expiry_wheel::L0_SLOTS); // same slot as now
+
+    wheel.expire(now + far - 1, hashes);
+    cybozu_assert( hashes.size() == 1 );
+    cybozu_assert( hashes[0] == 12 );
+
+    hashes.clear();
+    wheel.expire(now + far, hashes);
+    cybozu_assert( hashes.size() == 1 );
+    cybozu_assert( hashes[0] == 10 );
+
+    hashes.clear();
+    wheel.expire(now + very_far - 1, hashes);
+    cybozu_assert( hashes.empty() );
+    wheel.expire(now + very_far, hashes);
+    cybozu_assert( hashes.size() == 1 );
+    cybozu_assert( hashes[0] == 11 );
+}
+
+AUTOTEST(cascade_boundary) {
+    expiry_wheel wheel;
+    std::vector<std::uint64_t> hashes;
+    const std::time_t L0 = expiry_wheel::L0_SLOTS;
+    const std::time_t now = 1000000;
+    wheel.expire(now, hashes);
+
+    // `t` is where the second level slot holding entries is cascaded.
+    const std::time_t t = (now / L0 + 2) * L0;
+    const std::time_t exptimes[] = {
+        t - 1, t, t + 1, t + L0 - 2, t + L0 - 1, t + L0, t + L0 + 1,
+    };
+    for( std::time_t e: exptimes )
+        wheel.add(static_cast<std::uint64_t>(e), e);
+
+    // every entry is collected exactly at its expiration time.
+    bool exact = true;
+    for( std::time_t s = now + 1; s <= t + 2 * L0; ++s ) {
+        hashes.clear();
+        wheel.expire(s, hashes);
+        for( std::uint64_t h: hashes ) {
+            if( static_cast<std::time_t>(h) != s )
+                exact = false;
+        }
+    }
+    cybozu_assert( exact );
+    cybozu_assert( wheel.size() == 0 );
+}
+
+AUTOTEST(concurrent_add) {
+    expiry_wheel wheel;
+    std::vector<std::uint64_t> hashes;
+    std::time_t now = 1000000;
+    wheel.expire(now, hashes);
+
+    // entries due at the time being collected are not left behind.
+    std::atomic<std::time_t> current(now);
+    std::atomic<bool> stop(false);
+    std::atomic<std::size_t> added(0);
+    std::thread adder([&wheel, &current, &stop, &added] {
+        for( std::uint64_t i = 0; ! stop.load(); ++i ) {
+            wheel.add(i, current.load() + (i % 2));
+            ++ added;
+        }
+    });
+    while( added.load() == 0 )
+        std::this_thread::yield();
+    // less than a revolution of the first level so that entries
+    // left in a drained slot are never collected.
+    for( int i = 0; i < 1000; ++i ) {
+        current.store(++now);
+        wheel.expire(now, hashes);
+        std::this_thread::yield();
+    }
+    stop.store(true);
+    adder.join();
+
+    wheel.expire(now + 1, hashes);
+    cybozu_assert( hashes.size() == added.load() );
+    cybozu_assert( wheel.size() == 0 );
+}
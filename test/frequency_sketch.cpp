@@ -0,0 +1,41 @@
+#include <cybozu/frequency_sketch.hpp>
+#include <cybozu/siphash.hpp>
+#include <cybozu/test.hpp>
+
+#include <string>
+
+std::uint64_t hash_of(int i) {
+    std::string s = "key" + std::to_string(i);
+    return cybozu::siphash24(s.data(), s.size());
+}
+
+AUTOTEST(estimate) {
+    cybozu::frequency_sketch sketch(1000);
+    cybozu_assert( sketch.width() == 1024 );
+    cybozu_assert( sketch.estimate(hash_of(1)) == 0 );
+
+    for( int i = 0; i < 5; ++i )
+        sketch.increment(hash_of(1));
+    for( int i = 0; i < 100; ++i )
+        sketch.increment(hash_of(2));
+    cybozu_assert( sketch.estimate(hash_of(1)) >= 5 );
+    cybozu_assert( sketch.estimate(hash_of(2)) ==
+                   cybozu::frequency_sketch::MAX_FREQUENCY );
+
+    int zeros = 0;
+    for( int i = 10; i < 110; ++i )
+        if( sketch.estimate(hash_of(i)) == 0 ) ++zeros;
+    cybozu_assert( zeros > 90 );
+}
+
+AUTOTEST(aging) {
+    cybozu::frequency_sketch sketch(1000);
+    for( int i = 0; i < 15; ++i )
+        sketch.increment(hash_of(1));
+    cybozu_assert( sketch.estimate(hash_of(1)) == 15 );
+
+    // 10 * width increments halve all counters.
+    for( int i = 0; i < 10 * 1024; ++i )
+        sketch.increment(hash_of(1000 + i));
+    cybozu_assert( sketch.estimate(hash_of(1)) <= 8 );
+}
@@ -0,0 +1,123 @@
+#include "../src/global.hpp"
+#include "../src/memcache/generation.hpp"
+#include "../src/memcache/replication.hpp"
+
+#include <cybozu/test.hpp>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+using yrmcds::memcache::generation_counter;
+using yrmcds::memcache::g_generation;
+using yrmcds::memcache::repl_socket;
+
+namespace {
+
+// Connect a pair of TCP sockets.  `s` is set non-blocking.
+void connect_pair(int& c, int& s) {
+    int l = ::socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    cybozu_assert(::bind(l, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    cybozu_assert(::listen(l, 1) == 0);
+    cybozu_assert(::getsockname(l, (struct sockaddr*)&addr, &addrlen) == 0);
+    c = ::socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    cybozu_assert(::connect(c, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    s = ::accept4(l, nullptr, nullptr, SOCK_NONBLOCK|SOCK_CLOEXEC);
+    cybozu_assert(s != -1);
+    ::close(l);
+}
+
+// Return data sent to `c` until the other end is shut down.
+std::string receive_all(int c) {
+    std::string received;
+    char buf[4096];
+    while( true ) {
+        ssize_t n = ::recv(c, buf, sizeof(buf), 0);
+        if( n <= 0 ) return received;
+        received.append(buf, n);
+    }
+}
+
+} // anonymous namespace
+
+AUTOTEST(flush) {
+    generation_counter g;
+    const std::time_t now = 1000000;
+    cybozu_assert( g.current(now) == 0 );
+    cybozu_assert( g.pending() == 0 );
+
+    g.flush(now, now);
+    cybozu_assert( g.current(now) == 1 );
+    cybozu_assert( g.pending() == 0 );
+
+    g.flush(now - 10, now);
+    cybozu_assert( g.current(now) == 2 );
+}
+
+AUTOTEST(delayed_flush) {
+    generation_counter g;
+    const std::time_t now = 1000000;
+
+    g.flush(now + 10, now);
+    cybozu_assert( g.pending() == now + 10 );
+    cybozu_assert( g.current(now) == 0 );
+    cybozu_assert( g.current(now + 9) == 0 );
+    cybozu_assert( g.current(now + 10) == 1 );
+    cybozu_assert( g.pending() == 0 );
+    cybozu_assert( g.current(now + 20) == 1 );
+
+    // a pending flush is replaced by a new one.
+    g.flush(now + 30, now + 20);
+    g.flush(now + 40, now + 20);
+    cybozu_assert( g.current(now + 35) == 1 );
+    cybozu_assert( g.current(now + 40) == 2 );
+
+    // a due flush is committed before a new one is scheduled.
+    g.flush(now + 50, now + 40);
+    g.flush(now + 60, now + 55);
+    cybozu_assert( g.current(now + 55) == 3 );
+    cybozu_assert( g.current(now + 60) == 4 );
+
+    g.flush(now + 70, now + 60);
+    g.flush(now + 60, now + 60);
+    cybozu_assert( g.current(now + 60) == 5 );
+    cybozu_assert( g.pending() == 0 );
+}
+
+AUTOTEST(pending_flush_to_new_slave) {
+    int c, s;
+    connect_pair(c, s);
+    std::function<cybozu::worker*()> finder = []{ return nullptr; };
+    repl_socket slave(s, 1, finder);
+    std::vector<repl_socket*> slaves = {&slave};
+    const std::time_t now = yrmcds::g_current_time.load();
+
+    // nothing is sent without a pending flush.
+    g_generation.reset();
+    yrmcds::memcache::repl_pending_flush(slaves);
+    g_generation.flush(now, now);
+    yrmcds::memcache::repl_pending_flush(slaves);
+
+    // a slave joining after a delayed flush receives it.
+    g_generation.flush(now + 100, now);
+    yrmcds::memcache::repl_pending_flush(slaves);
+    ::shutdown(s, SHUT_WR);
+    std::string received = receive_all(c);
+    ::close(c);
+    cybozu_assert( received.size() == 28 );
+
+    // the slave flushes its objects at the same time.
+    g_generation.reset();
+    cybozu::hash_map<yrmcds::memcache::object> replica(11);
+    cybozu_assert( yrmcds::memcache::repl_recv(received.data(),
+                                               received.size(),
+                                               replica) == 28 );
+    cybozu_assert( g_generation.pending() == now + 100 );
+    g_generation.reset();
+}
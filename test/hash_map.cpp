@@ -45,3 +45,34 @@ AUTOTEST(t) {
     cybozu_assert( m.apply(hkey1, updater, nullptr) == true );
     cybozu_assert( m.apply(hkey2, updater, nullptr) == false );
 }
+
+AUTOTEST(occupancy) {
+    hash_map m(8);
+    const std::size_t n = m.bucket_count();
+    cybozu_assert( m.next_occupied(0, n) == n );
+
+    std::size_t i1 = hkey1.hash() % n;
+    cybozu_assert( m.apply(hkey1, nullptr, creator) == true );
+    cybozu_assert( m.occupied(i1) );
+    cybozu_assert( m.next_occupied(0, n) == i1 );
+    cybozu_assert( m.next_occupied(i1 + 1, n) == n );
+
+    cybozu_assert( m.apply(hkey2, nullptr, creator) == true );
+    std::size_t i2 = hkey2.hash() % n;
+    cybozu_assert( m.occupied(i2) );
+
+    cybozu_assert( m.remove(hkey1, nullptr) == true );
+    cybozu_assert( m.occupied(i1) == (i1 == i2) );
+    cybozu_assert( m.remove_if(hkey2, [](const cybozu::hash_key&,
+                                         std::string&) { return false; }) );
+    cybozu_assert( m.occupied(i2) );
+    for( hash_map::bucket& b: m )
+        b.gc([](const cybozu::hash_key&, std::string&) { return true; });
+    cybozu_assert( ! m.occupied(i2) );
+    cybozu_assert( m.next_occupied(0, n) == n );
+
+    cybozu_assert( m.apply(hkey1, nullptr, creator) == true );
+    cybozu_assert( m.remove_if(hkey1, [](const cybozu::hash_key&,
+                                         std::string&) { return true; }) );
+    cybozu_assert( ! m.occupied(i1) );
+}
@@ -0,0 +1,54 @@
+#include "../src/config.hpp"
+#include "../src/memcache/object.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdio.h>
+#include <string>
+
+using yrmcds::memcache::object;
+
+typedef std::chrono::nanoseconds ns_t;
+
+const int LOOPS = 1000000;
+
+// The former implementation of increment on decimal strings.
+std::uint64_t incr_string(cybozu::dynbuf& data, std::uint64_t n) {
+    std::uint64_t v = std::stoull( std::string(data.data(), data.size()) );
+    v += n;
+    char s_value[24];
+    int len = ::snprintf(s_value, sizeof(s_value),
+                         "%llu", (unsigned long long)v);
+    data.reset();
+    data.append(s_value, len);
+    return v;
+}
+
+template<typename F>
+void bench(const char* name, F f) {
+    auto t1 = std::chrono::steady_clock::now();
+    std::uint64_t v = 0;
+    for( int i = 0; i < LOOPS; ++i )
+        v = f();
+    auto t2 = std::chrono::steady_clock::now();
+    auto ns = std::chrono::duration_cast<ns_t>(t2 - t1).count();
+    std::cout << name << ": " << (ns / LOOPS) << " ns/op"
+              << " (value=" << v << ")" << std::endl;
+}
+
+int main() {
+    cybozu::dynbuf data(0);
+    data.append("1000000000", 10);
+    bench("string incr", [&data]{ return incr_string(data, 3); });
+
+    object o(1000000000, 0);
+    bench("native incr", [&o]{ return o.incr(3); });
+
+    cybozu::dynbuf buf(0);
+    bench("native incr + get", [&o,&buf]{
+            o.incr(3);
+            return static_cast<std::uint64_t>(o.data(buf).size());
+        });
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <cybozu/lz4.hpp>
+#include <cybozu/test.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool round_trip(const std::string& s) {
+    std::vector<char> c(cybozu::lz4_compress_bound(s.size()));
+    std::size_t n = cybozu::lz4_compress(s.data(), s.size(), c.data(), c.size());
+    if( n == 0 ) return false;
+    std::vector<char> d(s.size() + 1);
+    if( ! cybozu::lz4_decompress(c.data(), n, d.data(), s.size()) )
+        return false;
+    return std::string(d.data(), s.size()) == s;
+}
+
+std::string random_string(std::size_t len) {
+    std::string s;
+    std::uint32_t x = 1;
+    while( s.size() < len ) {
+        x = x * 1103515245 + 12345;
+        s += (char)(x >> 16);
+    }
+    return s;
+}
+
+} // anonymous namespace
+
+AUTOTEST(lz4_round_trip) {
+    cybozu_assert( round_trip("") );
+    cybozu_assert( round_trip("a") );
+    cybozu_assert( round_trip("abcdefghijklm") );
+    cybozu_assert( round_trip(std::string(100000, 'x')) );
+    cybozu_assert( round_trip(random_string(70000)) );
+
+    std::string s;
+    for( int i = 0; i < 5000; ++i )
+        s += "<li class=\"item\">" + std::to_string(i % 77) + "</li>";
+    cybozu_assert( round_trip(s) );
+    for( std::size_t i = 0; i < 300; ++i )
+        cybozu_assert( round_trip(s.substr(i, i * 7)) );
+}
+
+AUTOTEST(lz4_ratio) {
+    std::string s;
+    for( int i = 0; s.size() < 65536; ++i )
+        s += "{\"id\":" + std::to_string(i) + ",\"name\":\"yrmcds\"},";
+    std::vector<char> c(s.size());
+    std::size_t n = cybozu::lz4_compress(s.data(), s.size(), c.data(), c.size());
+    cybozu_assert( n != 0 );
+    cybozu_assert( n < s.size() / 3 );
+
+    // give up when the output does not fit.
+    std::string r = random_string(10000);
+    cybozu_assert( cybozu::lz4_compress(r.data(), r.size(), c.data(), 9000) == 0 );
+}
+
+AUTOTEST(lz4_broken) {
+    std::string s(1000, 'a');
+    std::vector<char> c(cybozu::lz4_compress_bound(s.size()));
+    std::size_t n = cybozu::lz4_compress(s.data(), s.size(), c.data(), c.size());
+    cybozu_assert( n != 0 );
+    std::vector<char> d(s.size());
+    cybozu_assert( ! cybozu::lz4_decompress(c.data(), n, d.data(), s.size() - 1) );
+    cybozu_assert( ! cybozu::lz4_decompress(c.data(), n - 1, d.data(), s.size()) );
+    // offset beyond the output head.
+    const char bad[] = { 0x10, 'a', 0x05, 0x00, 0x00 };
+    cybozu_assert( ! cybozu::lz4_decompress(bad, sizeof(bad), d.data(), 5) );
+}
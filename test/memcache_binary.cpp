@@ -17,6 +17,7 @@ using namespace yrmcds::memcache;
 AUTOTEST(get) {
     REQ(1, "\x80\x00\x00\x00");
     cybozu_assert( r1.length() == 0 );
+    cybozu_assert( r1.required() == 0 );
     REQ(2, "\x80\x00\x00\x05\x00\x00\x00\x00"
         "\x00\x00\x00\x05" // total body
         "\x12\x34\x56\x78" // opaque
@@ -24,6 +25,7 @@ AUTOTEST(get) {
         "Hello" // key
         );
     cybozu_assert( r2.length() == (24 + 5) );
+    cybozu_assert( r2.required() == 0 );
     cybozu_assert( r2.status() == binary_status::OK );
     cybozu_assert( r2.command() == binary_command::Get );
     cybozu_assert( ! r2.quiet() );
@@ -39,6 +41,7 @@ AUTOTEST(get) {
         "Hell" // key
         );
     cybozu_assert( r3.length() == 0 );
+    cybozu_assert( r3.required() == (24 + 5) );
     REQ(4, "\x80\x00\x00\x06\x00\x00\x00\x00"
         "\x00\x00\x00\x05" // total body
         "\x12\x34\x56\x78" // opaque
@@ -159,9 +159,11 @@ AUTOTEST(set) {
 
     MEMCACHE_TEST(12, "set aaa 100 0 10\r\nabcdefghij\r");
     cybozu_assert( t12.length() == 0 );
+    cybozu_assert( t12.required() == 30 );
 
     MEMCACHE_TEST(13, "set aaa 100 0 10\r\nabcdefghij");
     cybozu_assert( t13.length() == 0 );
+    cybozu_assert( t13.required() == 30 );
 
     MEMCACHE_TEST(14, "set aaa 100 0 10 \r\nabcdefghij\r\naaa");
     cybozu_assert( t14.valid() );
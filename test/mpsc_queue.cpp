@@ -0,0 +1,67 @@
+#include <cybozu/mpsc_queue.hpp>
+#include <cybozu/test.hpp>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+AUTOTEST(order) {
+    cybozu::mpsc_queue<std::string> q;
+    cybozu_assert( q.front() == nullptr );
+    q.push("a");
+    q.push("b");
+    cybozu_assert( *q.front() == "a" );
+    q.pop();
+    q.push("c");
+    cybozu_assert( *q.front() == "b" );
+    q.pop();
+    cybozu_assert( *q.front() == "c" );
+    q.pop();
+    cybozu_assert( q.front() == nullptr );
+
+    // remaining elements are destructed with the queue.
+    std::shared_ptr<int> p = std::make_shared<int>(0);
+    {
+        cybozu::mpsc_queue<std::shared_ptr<int>> q2;
+        q2.push(std::shared_ptr<int>(p));
+        q2.push(std::shared_ptr<int>(p));
+        q2.pop();
+        cybozu_assert( p.use_count() == 2 );
+    }
+    cybozu_assert( p.use_count() == 1 );
+}
+
+AUTOTEST(producers) {
+    const int THREADS = 4;
+    const int COUNT = 100000;
+    cybozu::mpsc_queue<std::pair<int, int>> q;
+    std::vector<std::thread> producers;
+    for( int t = 0; t < THREADS; ++t ) {
+        producers.emplace_back([t, &q]() {
+            for( int i = 0; i < COUNT; ++i )
+                q.push(std::make_pair(t, i));
+        });
+    }
+
+    // elements from each producer come in order.
+    std::vector<int> next(THREADS, 0);
+    int received = 0;
+    bool ordered = true;
+    while( received < THREADS * COUNT ) {
+        auto p = q.front();
+        if( p == nullptr ) {
+            std::this_thread::yield();
+            continue;
+        }
+        if( p->second != next[p->first] )
+            ordered = false;
+        ++next[p->first];
+        q.pop();
+        ++received;
+    }
+    for( auto& t: producers )
+        t.join();
+    cybozu_assert( ordered );
+    cybozu_assert( q.front() == nullptr );
+}
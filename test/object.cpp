@@ -99,3 +99,183 @@ AUTOTEST(incr_decr) {
     dynbuf d3_(0);
     cybozu_assert( o3.data(d3_) == d3 );
 }
+
+AUTOTEST(numeric) {
+    reset_heap_limit();
+    object o1(12345, 0);
+    cybozu_assert( o1.numeric() );
+    cybozu_assert( o1.size() == 5 );
+    dynbuf d1(0); d1.append("12345", 5);
+    dynbuf d1_(0);
+    cybozu_assert( o1.data(d1_) == d1 );
+    cybozu_assert( o1.incr(99999) == 112344 );
+    cybozu_assert( o1.size() == 6 );
+    d1.reset(); d1.append("112344", 6);
+    cybozu_assert( o1.data(d1_) == d1 );
+    o1.append("x", 1);
+    cybozu_assert( ! o1.numeric() );
+    d1.append("x", 1);
+    cybozu_assert( o1.data(d1_) == d1 );
+
+    object o2("-1", 2, 0, 0);
+    cybozu_assert( ! o2.numeric() );
+    cybozu_assert( o2.incr(1) == 0 );
+    cybozu_assert( o2.numeric() );
+    d1.reset(); d1.append("0", 1);
+    cybozu_assert( o2.data(d1_) == d1 );
+
+    object o3("18446744073709551616", 20, 0, 0);
+    cybozu_test_exception( o3.incr(1), object::not_a_number );
+    object o4(" +", 2, 0, 0);
+    cybozu_test_exception( o4.decr(1), object::not_a_number );
+    cybozu_assert( ! o4.numeric() );
+}
+
+AUTOTEST(compression) {
+    yrmcds::g_config.set_heap_data_limit(4096);
+    yrmcds::g_config.set_compression_threshold(1024);
+
+    std::string s;
+    for( int i = 0; s.size() < 20000; ++i )
+        s += "{\"id\":" + std::to_string(i) + ",\"name\":\"yrmcds\"},";
+    dynbuf d1(0); d1.append(s.data(), s.size());
+    dynbuf d1_(0);
+    object o1(s.data(), s.size(), 0, 0);
+    cybozu_assert( o1.compressed() );
+    cybozu_assert( ! o1.on_file() );
+    cybozu_assert( o1.size() == s.size() );
+    cybozu_assert( o1.stored_size() < 4096 );
+    cybozu_assert( o1.data(d1_) == d1 );
+
+    o1.append("abc", 3);
+    cybozu_assert( ! o1.compressed() );
+    cybozu_assert( o1.on_file() );
+    d1.append("abc", 3);
+    cybozu_assert( o1.data(d1_) == d1 );
+
+    // incompressible data goes to a file.
+    std::string r;
+    std::uint32_t x = 12345;
+    for( int i = 0; i < 10000; ++i ) {
+        x = x * 1103515245 + 12345;
+        r += (char)(x >> 16);
+    }
+    o1.set(r.data(), r.size(), 0, 0);
+    cybozu_assert( ! o1.compressed() );
+    cybozu_assert( o1.on_file() );
+    d1.reset(); d1.append(r.data(), r.size());
+    cybozu_assert( o1.data(d1_) == d1 );
+
+    // smaller objects are compressed when they become cold.
+    object o2(s.data(), 2048, 0, 0);
+    cybozu_assert( ! o2.compressed() );
+    for( unsigned int i = 0; i < yrmcds::COMPRESS_AGE; ++i )
+        o2.survive();
+    cybozu_assert( o2.compressed() );
+    cybozu_assert( o2.stored_size() < 2048 );
+    d1.reset(); d1.append(s.data(), 2048);
+    cybozu_assert( o2.data(d1_) == d1 );
+    o2.prepend("xyz", 3);
+    cybozu_assert( ! o2.compressed() );
+    d1.reset(); d1.append("xyz", 3); d1.append(s.data(), 2048);
+    cybozu_assert( o2.data(d1_) == d1 );
+
+    yrmcds::g_config.set_compression_threshold(0);
+}
+
+AUTOTEST(tier) {
+    using yrmcds::memcache::tier_store;
+    reset_heap_limit();
+    yrmcds::g_config.set_tier_storage_limit(100);
+    tier_store store;
+
+    object o1("abcde", 5, 100, 0);
+    cybozu_assert( o1.demote(store) );
+    cybozu_assert( o1.demoted() );
+    cybozu_assert( o1.size() == 5 );
+    cybozu_assert( o1.stored_size() == 5 );
+    dynbuf d1(0); d1.append("abcde", 5);
+    dynbuf d1_(0);
+    cybozu_assert( o1.data(d1_) == d1 );
+    store.flush(true);
+    cybozu_assert( o1.data(d1_) == d1 );
+
+    object o2("12345", 5, 100, 0);
+    cybozu_assert( o2.demote(store) );
+    o2.append("678", 3);
+    cybozu_assert( ! o2.demoted() );
+    d1.reset(); d1.append("12345678", 8);
+    cybozu_assert( o2.data(d1_) == d1 );
+
+    object o3(std::string(100, 'x').data(), 100, 0, 0);
+    cybozu_assert( ! o3.demote(store) );
+    cybozu_assert( ! o3.demoted() );
+
+    o1.promote();
+    cybozu_assert( ! o1.demoted() );
+    d1.reset(); d1.append("abcde", 5);
+    cybozu_assert( o1.data(d1_) == d1 );
+
+    yrmcds::g_config.set_tier_storage_limit(0);
+}
+
+AUTOTEST(drop_cache) {
+    using yrmcds::memcache::g_stats;
+    using yrmcds::memcache::page_flusher;
+    reset_heap_limit();
+    std::string s(yrmcds::g_config.heap_data_limit() + 1, 'a');
+    object o1(s.data(), s.size(), 0, 0);
+    object o2(s.data(), s.size(), 0, 0);
+    cybozu_assert( o1.on_file() );
+
+    g_stats.reset();
+    std::size_t budget = s.size() + s.size() / 2;
+    {
+        page_flusher flusher;
+        flusher.start();
+        o1.drop_cache(flusher, budget);
+        cybozu_assert( budget == s.size() + s.size() / 2 );
+        for( int i = 0; i < yrmcds::FLUSH_AGE; ++i ) {
+            o1.survive();
+            o2.survive();
+        }
+        o1.drop_cache(flusher, budget);
+        cybozu_assert( budget == s.size() / 2 );
+        o1.drop_cache(flusher, budget);
+        o2.drop_cache(flusher, budget);
+        cybozu_assert( budget == s.size() / 2 );
+    }
+    cybozu_assert( g_stats.flushed_files.load() == 1 );
+
+    // modified files are flushed again.
+    o1.append("b", 1);
+    budget = s.size() * 2;
+    for( int i = 0; i < yrmcds::FLUSH_AGE; ++i )
+        o1.survive();
+    page_flusher flusher;
+    o1.drop_cache(flusher, budget);
+    cybozu_assert( budget == s.size() * 2 - o1.size() );
+}
+
+AUTOTEST(charge) {
+    using yrmcds::memcache::g_stats;
+    reset_heap_limit();
+    const std::size_t base = sizeof(cybozu::hash_key) + 3 + sizeof(object);
+    std::int64_t before = g_stats.used_memory.sum();
+    {
+        object o1("abcde", 5, 0, 0, 3);
+        cybozu_assert( o1.charge() == base + 5 );
+        o1.append("fgh", 3);
+        cybozu_assert( o1.charge() == base + 8 );
+        o1.set("1", 1, 0, 0);
+        cybozu_assert( o1.charge() == base + 1 );
+        o1.incr(1);
+        cybozu_assert( o1.charge() == base );
+        object o2(std::move(o1));
+        cybozu_assert( o1.charge() == 0 );
+        cybozu_assert( o2.charge() == base );
+        cybozu_assert( g_stats.used_memory.sum() ==
+                       before + static_cast<std::int64_t>(base) );
+    }
+    cybozu_assert( g_stats.used_memory.sum() == before );
+}
@@ -0,0 +1,114 @@
+#include "../src/reclaimer.hpp"
+
+#include <cybozu/test.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using cybozu::epoch_record;
+using cybozu::worker;
+using yrmcds::reclaimer;
+
+AUTOTEST(epoch) {
+    epoch_record r;
+    cybozu_assert( r.passed(epoch_record::current()) );
+
+    r.quiescent();
+    std::uint64_t e = epoch_record::advance();
+    cybozu_assert( e == epoch_record::current() );
+    cybozu_assert( ! r.passed(e) );
+    r.quiescent();
+    cybozu_assert( r.passed(e) );
+
+    e = epoch_record::advance();
+    cybozu_assert( ! r.passed(e) );
+    r.offline();
+    cybozu_assert( r.passed(e) );
+}
+
+AUTOTEST(defer) {
+    std::vector<std::unique_ptr<worker>> workers;
+    for( int i = 0; i < 2; ++i )
+        workers.emplace_back(new worker(1024));
+    for( auto& w: workers )
+        w->set_peers(workers, 0, workers.size());
+    for( auto& w: workers )
+        w->start();
+
+    std::atomic<bool> blocked(true);
+    std::atomic<bool> started(false);
+    worker::job block = [&](cybozu::dynbuf&) {
+        started.store(true);
+        while( blocked.load() )
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+    worker::job nop = [](cybozu::dynbuf&) {};
+
+    reclaimer rc(workers);
+    int done = 0;
+    rc.defer([&done]{ ++done; });
+    cybozu_assert( done == 1 );
+    cybozu_assert( rc.empty() );
+
+    workers[0]->post_job(block);
+    while( ! started.load() )
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    rc.defer([&done]{ ++done; });
+
+    // the other worker keeps running jobs.
+    for( int i = 0; i < 100; ++i ) {
+        workers[1]->post_job(nop);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        rc.check();
+    }
+    cybozu_assert( done == 1 );
+    cybozu_assert( ! rc.empty() );
+
+    // actions run in order once the running job finishes.
+    rc.defer([&done]{ done *= 10; });
+    blocked.store(false);
+    for( int i = 0; i < 1000 && ! rc.empty(); ++i ) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        rc.check();
+    }
+    cybozu_assert( done == 20 );
+    cybozu_assert( rc.empty() );
+
+    for( auto& w: workers )
+        w->stop();
+}
+
+AUTOTEST(busy) {
+    std::vector<std::unique_ptr<worker>> workers;
+    for( int i = 0; i < 4; ++i )
+        workers.emplace_back(new worker(1024));
+    for( auto& w: workers )
+        w->set_peers(workers, 0, workers.size());
+    for( auto& w: workers )
+        w->start();
+
+    worker::job slow = [](cybozu::dynbuf&) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    };
+
+    // deferred actions run while workers are kept busy.
+    reclaimer rc(workers);
+    int done = 0;
+    for( int i = 0; i < 200; ++i ) {
+        for( auto& w: workers ) {
+            while( w->queued_jobs() < 4 )
+                w->post_job(slow);
+        }
+        if( i % 10 == 0 )
+            rc.defer([&done]{ ++done; });
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        rc.check();
+    }
+    cybozu_assert( done > 10 );
+
+    for( auto& w: workers )
+        w->stop();
+}
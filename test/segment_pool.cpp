@@ -0,0 +1,53 @@
+#include <cybozu/segment_pool.hpp>
+#include <cybozu/test.hpp>
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using cybozu::segment_pool;
+
+AUTOTEST(limit) {
+    segment_pool::set_limit(4);
+    cybozu_assert( segment_pool::limit() == 4 );
+    cybozu_assert( segment_pool::used() == 0 );
+
+    cybozu_assert( segment_pool::reserve(3) );
+    cybozu_assert( ! segment_pool::reserve(2) );
+    cybozu_assert( segment_pool::exhausted() == 1 );
+    cybozu_assert( segment_pool::reserve(1) );
+    cybozu_assert( segment_pool::used() == 4 );
+    cybozu_assert( segment_pool::reserve(0) );
+
+    std::vector<char*> v;
+    for( int i = 0; i < 4; ++i ) {
+        char* p = segment_pool::allocate();
+        std::memset(p, i, segment_pool::SEGMENT_SIZE);
+        v.push_back(p);
+    }
+    for( char* p: v )
+        segment_pool::release(p);
+    cybozu_assert( segment_pool::used() == 0 );
+    segment_pool::set_limit(segment_pool::DEFAULT_LIMIT);
+}
+
+AUTOTEST(threads) {
+    // segments may be released by a thread other than the allocator.
+    std::vector<char*> v;
+    cybozu_assert( segment_pool::reserve(100) );
+    for( int i = 0; i < 100; ++i )
+        v.push_back(segment_pool::allocate());
+    std::thread t([&v]() {
+        for( char* p: v )
+            segment_pool::release(p);
+    });
+    t.join();
+    cybozu_assert( segment_pool::used() == 0 );
+
+    cybozu_assert( segment_pool::reserve(100) );
+    for( int i = 0; i < 100; ++i )
+        v[i] = segment_pool::allocate();
+    for( char* p: v )
+        segment_pool::release(p);
+    cybozu_assert( segment_pool::used() == 0 );
+}
@@ -0,0 +1,37 @@
+#include <cybozu/sharded_counter.hpp>
+#include <cybozu/test.hpp>
+
+#include <thread>
+
+cybozu::sharded_counter g_counter(100);
+
+void accum(int n) {
+    for(int i = 0; i < n; ++i) {
+        g_counter.add(3);
+        g_counter.sub(1);
+    }
+}
+
+AUTOTEST(sharded_counter) {
+    cybozu::sharded_counter c(10);
+    c.add(9);
+    cybozu_assert( c.load() == 0 );
+    cybozu_assert( c.sum() == 9 );
+    c.add(1);
+    cybozu_assert( c.load() == 10 );
+    cybozu_assert( c.sum() == 10 );
+    c.sub(25);
+    cybozu_assert( c.load() == -15 );
+    cybozu_assert( c.sum() == -15 );
+}
+
+AUTOTEST(threads) {
+    std::thread t1(accum, 100000);
+    std::thread t2(accum, 100000);
+    std::thread t3(accum, 100000);
+    t1.join();
+    t2.join();
+    t3.join();
+    cybozu_assert( g_counter.sum() == 600000 );
+    cybozu_assert( g_counter.load() > 600000 - 64 * 100 );
+}
@@ -4,15 +4,373 @@
 #include <cybozu/test.hpp>
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include <atomic>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <string>
 #include <thread>
+#include <vector>
+
+AUTOTEST(io_uring_receive) {
+    cybozu::reactor r(cybozu::reactor::backend::IO_URING);
+    if( r.get_backend() != cybozu::reactor::backend::IO_URING ) {
+        std::cout << "io_uring is not available; skipped.\n";
+        return;
+    }
+
+    std::string received;
+    bool closed = false;
+    struct recv_socket : public cybozu::tcp_socket {
+        recv_socket(int s, std::string& received, bool& closed):
+            cybozu::tcp_socket(s), m_received(received), m_closed(closed) {}
+        virtual io_mode preferred_mode() const override {
+            return io_mode::RECV;
+        }
+        virtual bool on_readable(int) override {
+            while( true ) {
+                auto res = receive(m_buf, 4096);
+                if( res == recv_result::AGAIN ) break;
+                if( res != recv_result::OK ) {
+                    m_closed = true;
+                    m_reactor->quit();
+                    return invalidate();
+                }
+                m_received.append(m_buf.data(), m_buf.size());
+                m_buf.reset();
+            }
+            return true;
+        }
+        cybozu::dynbuf m_buf{0};
+        std::string& m_received;
+        bool& m_closed;
+    };
+    auto on_accept = [&](int s, const cybozu::ip_address addr) {
+        return std::unique_ptr<cybozu::tcp_socket>(
+            new recv_socket(s, received, closed));
+    };
+    r.add_resource(cybozu::make_server_socket("127.0.0.1", 11217, on_accept),
+                   cybozu::reactor::EVENT_IN);
+
+    // larger than a provided buffer.
+    std::string data;
+    for( int i = 0; i < 100000; ++i )
+        data += std::to_string(i);
+    std::thread t([&data]() {
+        int s = cybozu::tcp_connect("127.0.0.1", 11217);
+        const char* p = data.data();
+        std::size_t len = data.size();
+        while( len > 0 ) {
+            ssize_t n = ::send(s, p, len, 0);
+            if( n == -1 ) {
+                if( errno == EAGAIN || errno == EINTR ) continue;
+                break;
+            }
+            p += n;
+            len -= n;
+        }
+        ::close(s);
+    });
+
+    int ticks = 0;
+    r.run([&ticks](cybozu::reactor& r) {
+        if( ++ticks == 10 ) r.quit();
+    });
+    t.join();
+    cybozu_assert(closed);
+    cybozu_assert(received == data);
+}
+
+// Connect a pair of TCP sockets.  `s` is set non-blocking.
+void connect_pair(int& c, int& s) {
+    int l = ::socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    cybozu_assert(::bind(l, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    cybozu_assert(::listen(l, 1) == 0);
+    cybozu_assert(::getsockname(l, (struct sockaddr*)&addr, &addrlen) == 0);
+    c = ::socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    cybozu_assert(::connect(c, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    s = ::accept4(l, nullptr, nullptr, SOCK_NONBLOCK|SOCK_CLOEXEC);
+    cybozu_assert(s != -1);
+    ::close(l);
+}
+
+AUTOTEST(batch_send) {
+    // use a connected pair of TCP sockets without a reactor.
+    int c, s;
+    connect_pair(c, s);
+
+    struct send_socket : public cybozu::tcp_socket {
+        explicit send_socket(int s): cybozu::tcp_socket(s) {}
+        virtual bool on_readable(int) override { return true; }
+    } sock(s);
+
+    // small data are collected, and large data are sent with them.
+    std::string large(30000, 'x');
+    std::string expected;
+    sock.begin_batch();
+    for( int i = 0; i < 10; ++i ) {
+        std::string t = std::to_string(i);
+        cybozu_assert(sock.send(t.data(), t.size(), true));
+        expected += t;
+    }
+    cybozu::tcp_socket::iovec iov[2] = {{"large", 5},
+                                        {large.data(), large.size()}};
+    cybozu_assert(sock.sendv(iov, 2, true));
+    expected += "large" + large;
+    cybozu_assert(sock.send("end", 3, true));
+    expected += "end";
+    cybozu_assert(sock.end_batch());
+
+    std::string received;
+    char buf[4096];
+    while( received.size() < expected.size() ) {
+        ssize_t n = ::recv(c, buf, sizeof(buf), 0);
+        if( n <= 0 ) break;
+        received.append(buf, n);
+    }
+    ::close(c);
+    cybozu_assert(received == expected);
+}
+
+AUTOTEST(pooled_send) {
+    int c, s;
+    connect_pair(c, s);
+
+    struct send_socket : public cybozu::tcp_socket {
+        explicit send_socket(int s): cybozu::tcp_socket(s) {}
+        virtual bool on_readable(int) override { return true; }
+        bool drain() {
+            return with_fd([this](int fd) -> bool {
+                return write_pending_data(fd);
+            });
+        }
+    } sock(s);
+
+    auto receive_all = [c, &sock](std::size_t len) -> std::string {
+        std::string received;
+        char buf[65536];
+        while( received.size() < len ) {
+            cybozu_assert(sock.drain());
+            ssize_t n = ::recv(c, buf, sizeof(buf), 0);
+            if( n <= 0 ) break;
+            received.append(buf, n);
+        }
+        return received;
+    };
+
+    // data not accepted by the kernel are kept in pooled segments.
+    std::string data;
+    for( int i = 0; i < 1000000; ++i )
+        data += std::to_string(i);
+    cybozu_assert(sock.send(data.data(), data.size()));
+    cybozu_assert(cybozu::segment_pool::used() > 0);
+    cybozu_assert(receive_all(data.size()) == data);
+    cybozu_assert(cybozu::segment_pool::used() == 0);
+
+    // fall back to a private buffer if the pool is exhausted.
+    std::uint64_t exhausted = cybozu::segment_pool::exhausted();
+    cybozu::segment_pool::set_limit(1);
+    cybozu_assert(sock.send(data.data(), data.size()));
+    cybozu_assert(cybozu::segment_pool::exhausted() > exhausted);
+    cybozu_assert(cybozu::segment_pool::used() == 0);
+    cybozu_assert(receive_all(data.size()) == data);
+    cybozu::segment_pool::set_limit(cybozu::segment_pool::DEFAULT_LIMIT);
+    ::close(c);
+}
+
+AUTOTEST(zerocopy_send) {
+    int c, s;
+    connect_pair(c, s);
+
+    struct send_socket : public cybozu::tcp_socket {
+        explicit send_socket(int s): cybozu::tcp_socket(s) {}
+        virtual bool on_readable(int) override { return true; }
+        bool reap() {
+            return with_fd([this](int fd) -> bool {
+                return on_error(fd);
+            });
+        }
+    } sock(s);
+    sock.enable_zerocopy(4096);
+
+    std::string expected;
+    std::uint64_t sends = cybozu::tcp_socket::zerocopy_sends();
+    for( int i = 0; i < 10; ++i ) {
+        cybozu::dynbuf data(0);
+        std::string t(10000, 'a' + i);
+        data.append(t.data(), t.size());
+        cybozu::tcp_socket::iovec iov[3] = {{"head", 4},
+                                            {data.data(), data.size()},
+                                            {"tail", 4}};
+        cybozu_assert(sock.sendv(iov, 3, data, true));
+        expected += "head" + t + "tail";
+        // the buffer is taken over if sent with MSG_ZEROCOPY.
+        if( cybozu::tcp_socket::zerocopy_sends() != sends )
+            cybozu_assert(data.empty());
+        sends = cybozu::tcp_socket::zerocopy_sends();
+    }
+
+    std::string received;
+    char buf[65536];
+    while( received.size() < expected.size() ) {
+        ssize_t n = ::recv(c, buf, sizeof(buf), 0);
+        if( n <= 0 ) break;
+        received.append(buf, n);
+    }
+    cybozu_assert(received == expected);
+    // completions are not errors.
+    cybozu_assert(sock.reap());
+    ::close(c);
+}
+
+AUTOTEST(queued_send) {
+    int c, s;
+    connect_pair(c, s);
+
+    struct send_socket : public cybozu::tcp_socket {
+        explicit send_socket(int s): cybozu::tcp_socket(s) {}
+        virtual bool on_readable(int) override { return true; }
+        virtual void on_buffer_full() override { ++full; }
+        bool drain() {
+            return with_fd([this](int fd) -> bool {
+                return write_pending_data(fd);
+            });
+        }
+        std::atomic<int> full{0};
+    } sock(s);
+    sock.enable_send_queue(64 << 10);
+    sock.enable_zerocopy(50000);
+
+    // messages of "<thread><sequence><length>" followed by the body.
+    const int THREADS = 4;
+    const int COUNT = 500;
+    std::atomic<int> done(0);
+    std::size_t expected = 0;
+    std::vector<std::thread> senders;
+    for( int t = 0; t < THREADS; ++t ) {
+        for( int i = 0; i < COUNT; ++i )
+            expected += 12 + ((i * 7919 + t) % 100000);
+        senders.emplace_back([t, &sock, &done]() {
+            for( int i = 0; i < COUNT; ++i ) {
+                std::uint32_t len = (i * 7919 + t) % 100000;
+                std::uint32_t head[3] = {
+                    static_cast<std::uint32_t>(t),
+                    static_cast<std::uint32_t>(i), len};
+                cybozu::dynbuf body(0);
+                std::memset(body.prepare(len), 'a' + (i % 26), len);
+                body.consume(len);
+                cybozu::tcp_socket::iovec iov[2] = {
+                    {reinterpret_cast<const char*>(head), sizeof(head)},
+                    {body.data(), body.size()}};
+                // some bodies are taken over by the socket.
+                if( i % 2 ) {
+                    cybozu_assert(sock.sendv(iov, 2, body, i % 3 == 0));
+                } else {
+                    cybozu_assert(sock.sendv(iov, 2, i % 3 == 0));
+                }
+            }
+            ++done;
+        });
+    }
+
+    std::string received;
+    char buf[65536];
+    while( received.size() < expected ) {
+        // nobody writes out the queue after senders have finished.
+        if( done.load() == THREADS )
+            cybozu_assert(sock.drain());
+        ssize_t n = ::recv(c, buf, sizeof(buf), MSG_DONTWAIT);
+        if( n == 0 ) break;
+        if( n > 0 )
+            received.append(buf, n);
+    }
+    for( auto& t: senders )
+        t.join();
+    ::close(c);
+    cybozu_assert(received.size() == expected);
+    cybozu_assert(sock.queued_bytes() == 0);
+    cybozu_assert(sock.full.load() > 0);
+
+    // messages are not interleaved, and are in order per thread.
+    std::vector<std::uint32_t> next(THREADS, 0);
+    std::size_t pos = 0;
+    while( pos < received.size() ) {
+        std::uint32_t head[3];
+        std::memcpy(head, received.data() + pos, sizeof(head));
+        pos += sizeof(head);
+        cybozu_assert(head[0] < THREADS);
+        cybozu_assert(head[1] == next[head[0]]);
+        ++next[head[0]];
+        cybozu_assert(head[2] == (head[1] * 7919 + head[0]) % 100000);
+        std::string body(head[2], 'a' + (head[1] % 26));
+        cybozu_assert(received.compare(pos, head[2], body) == 0);
+        pos += head[2];
+    }
+}
+
+AUTOTEST(spilled_send) {
+    int c, s;
+    connect_pair(c, s);
+
+    struct send_socket : public cybozu::tcp_socket {
+        explicit send_socket(int s): cybozu::tcp_socket(s) {}
+        virtual bool on_readable(int) override { return true; }
+        virtual int create_spill_file() override {
+            char tmpl[] = "/tmp/spillXXXXXX";
+            int fd = ::mkostemp(tmpl, O_CLOEXEC);
+            if( fd != -1 ) {
+                ::unlink(tmpl);
+                ++created;
+            }
+            return fd;
+        }
+        bool drain() {
+            return with_fd([this](int fd) -> bool {
+                return write_pending_data(fd);
+            });
+        }
+        int created = 0;
+    } sock(s);
+    sock.enable_send_queue(64 << 10);
+
+    // the peer does not receive until all data are sent.
+    std::string expected;
+    bool sent = true;
+    for( int i = 0; i < 10000; ++i ) {
+        std::string t = std::to_string(i);
+        t.resize(1000, ',');
+        sent = sent && sock.send(t.data(), t.size(), i % 100 == 0);
+        expected += t;
+    }
+    cybozu_assert(sent);
+    cybozu_assert(sock.created == 1);
+    cybozu_assert(sock.queued_bytes() > (64 << 10));
+
+    std::string received;
+    char buf[65536];
+    while( received.size() < expected.size() ) {
+        cybozu_assert(sock.drain());
+        ssize_t n = ::recv(c, buf, sizeof(buf), MSG_DONTWAIT);
+        if( n == 0 ) break;
+        if( n > 0 )
+            received.append(buf, n);
+    }
+    ::close(c);
+    cybozu_assert(received == expected);
+    cybozu_assert(sock.queued_bytes() == 0);
+}
 
 AUTOTEST(fd_exhausted) {
     pid_t pid = ::fork();
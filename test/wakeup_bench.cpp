@@ -0,0 +1,105 @@
+#include <cybozu/util.hpp>
+#include <cybozu/worker.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::nanoseconds ns_t;
+
+const int BUSY_LOOPS = 20000;
+const int IDLE_LOOPS = 300;
+
+// The former implementation that wakes the worker by eventfd for every job.
+class eventfd_worker {
+public:
+    eventfd_worker(): m_event(eventfd(0, EFD_CLOEXEC)), m_buffer(0) {
+        if( m_event == -1 )
+            cybozu::throw_unix_error(errno, "eventfd");
+        m_thread = std::thread([this]{ run(); });
+    }
+    ~eventfd_worker() {
+        m_exit = true;
+        post_job(nullptr);
+        m_thread.join();
+        ::close(m_event);
+    }
+
+    void post_job(const cybozu::worker::job* job) {
+        m_job = job;
+        std::uint64_t i = 1;
+        if( ::write(m_event, &i, sizeof(i)) == -1 )
+            cybozu::throw_unix_error(errno, "write(eventfd)");
+    }
+
+private:
+    const int m_event;
+    cybozu::dynbuf m_buffer;
+    const cybozu::worker::job* m_job = nullptr;
+    std::atomic<bool> m_exit{false};
+    std::thread m_thread;
+
+    void run() {
+        while( true ) {
+            std::uint64_t i;
+            if( ::read(m_event, &i, sizeof(i)) == -1 )
+                cybozu::throw_unix_error(errno, "read(eventfd)");
+            if( m_exit ) return;
+            (*m_job)(m_buffer);
+        }
+    }
+};
+
+// Measure the latency from posting a job to its completion.
+template<typename Post>
+void bench(const char* name, int loops, std::chrono::microseconds gap,
+           Post post) {
+    std::atomic<bool> done(false);
+    cybozu::worker::job job = [&done](cybozu::dynbuf&) {
+        done.store(true, std::memory_order_release);
+    };
+    std::int64_t total = 0;
+    for( int i = 0; i < loops; ++i ) {
+        if( gap.count() > 0 )
+            std::this_thread::sleep_for(gap);
+        done.store(false, std::memory_order_relaxed);
+        auto t1 = std::chrono::steady_clock::now();
+        post(job);
+        while( ! done.load(std::memory_order_acquire) );
+        auto t2 = std::chrono::steady_clock::now();
+        total += std::chrono::duration_cast<ns_t>(t2 - t1).count();
+    }
+    std::cout << name << ": " << (total / loops) << " ns/job" << std::endl;
+}
+
+int main() {
+    using std::chrono::microseconds;
+    {
+        eventfd_worker w;
+        auto post = [&w](const cybozu::worker::job& job) { w.post_job(&job); };
+        bench("eventfd busy", BUSY_LOOPS, microseconds(0), post);
+        bench("eventfd idle", IDLE_LOOPS, microseconds(1000), post);
+    }
+
+    std::vector<std::unique_ptr<cybozu::worker>> workers;
+    workers.emplace_back(new cybozu::worker(0));
+    cybozu::worker& w = *workers[0];
+    w.start();
+    auto post = [&w](const cybozu::worker::job& job) { w.post_job(job); };
+    std::uint64_t wakeups = cybozu::worker::total_wakeups();
+    bench("futex busy", BUSY_LOOPS, microseconds(0), post);
+    std::cout << "  wakeups: " << (cybozu::worker::total_wakeups() - wakeups)
+              << "/" << BUSY_LOOPS << std::endl;
+    wakeups = cybozu::worker::total_wakeups();
+    bench("futex idle", IDLE_LOOPS, microseconds(1000), post);
+    std::cout << "  wakeups: " << (cybozu::worker::total_wakeups() - wakeups)
+              << "/" << IDLE_LOOPS << std::endl;
+    w.stop();
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <cybozu/test.hpp>
+#include <cybozu/worker.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using cybozu::worker;
+
+AUTOTEST(steal) {
+    std::vector<std::unique_ptr<worker>> workers;
+    for( int i = 0; i < 4; ++i )
+        workers.emplace_back(new worker(1024));
+    for( auto& w: workers )
+        w->set_peers(workers, 0, workers.size());
+
+    std::atomic<int> count(0);
+    std::mutex lock;
+    std::set<std::thread::id> threads;
+    worker::job slow = [&](cybozu::dynbuf&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        count.fetch_add(1);
+    };
+    worker::job fast = [&](cybozu::dynbuf& buf) {
+        buf.append("abc", 3);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        {
+            std::lock_guard<std::mutex> g(lock);
+            threads.insert(std::this_thread::get_id());
+        }
+        count.fetch_add(1);
+    };
+
+    // queue all jobs to the first worker.
+    worker& w = *workers[0];
+    w.post_job(slow);
+    for( std::size_t i = 1; i < worker::QUEUE_SIZE; ++i )
+        w.post_job(fast);
+    cybozu_assert( w.queued_jobs() == worker::QUEUE_SIZE );
+    for( auto& pw: workers )
+        pw->start();
+
+    while( count.load() != static_cast<int>(worker::QUEUE_SIZE) )
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    cybozu_assert( w.posted_jobs() == worker::QUEUE_SIZE );
+    cybozu_assert( w.taken_jobs() == worker::QUEUE_SIZE );
+    cybozu_assert( threads.size() > 1 );
+
+    std::uint64_t finished = 0;
+    for( auto& pw: workers )
+        finished += pw->finished_jobs();
+    cybozu_assert( finished == worker::QUEUE_SIZE );
+
+    for( auto& pw: workers )
+        pw->stop();
+}
+
+AUTOTEST(choose_worker) {
+    std::vector<std::unique_ptr<worker>> workers;
+    for( int i = 0; i < 2; ++i )
+        workers.emplace_back(new worker(1024));
+
+    // workers are not started, so jobs stay in the queues.
+    worker::job nop = [](cybozu::dynbuf&) {};
+    std::size_t index = 0;
+    worker* w = cybozu::choose_worker(workers, 0, 2, index);
+    cybozu_assert( w == workers[0].get() );
+    w->post_job(nop);
+    w = cybozu::choose_worker(workers, 0, 2, index);
+    cybozu_assert( w == workers[1].get() );
+    w->post_job(nop);
+    w->post_job(nop);
+
+    // both are busy; choose the one with the fewest jobs.
+    w = cybozu::choose_worker(workers, 0, 2, index);
+    cybozu_assert( w == workers[0].get() );
+
+    for( std::size_t i = 1; i < worker::QUEUE_SIZE; ++i )
+        workers[0]->post_job(nop);
+    for( std::size_t i = 2; i < worker::QUEUE_SIZE; ++i )
+        workers[1]->post_job(nop);
+    cybozu_assert( cybozu::choose_worker(workers, 0, 2, index) == nullptr );
+}
@@ -0,0 +1,123 @@
+#include <cybozu/dynbuf.hpp>
+#include <cybozu/reactor.hpp>
+#include <cybozu/tcp.hpp>
+#include <cybozu/util.hpp>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Compare sends with and without MSG_ZEROCOPY by object size.
+//
+// On the loopback interface, the kernel copies data sent with
+// MSG_ZEROCOPY after all (see "copied"), so that this shows only
+// the overhead.  Run this between two hosts to see the benefit.
+
+const std::size_t TOTAL = 64 << 20;
+const std::size_t SIZES[] = {16 << 10, 64 << 10, 256 << 10, 1 << 20};
+
+// Return a connected pair of TCP sockets.  `s` is set non-blocking.
+void connect_pair(int& c, int& s) {
+    int l = ::socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    if( ::bind(l, (struct sockaddr*)&addr, sizeof(addr)) == -1 )
+        cybozu::throw_unix_error(errno, "bind");
+    if( ::listen(l, 1) == -1 )
+        cybozu::throw_unix_error(errno, "listen");
+    if( ::getsockname(l, (struct sockaddr*)&addr, &addrlen) == -1 )
+        cybozu::throw_unix_error(errno, "getsockname");
+    c = ::socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if( ::connect(c, (struct sockaddr*)&addr, sizeof(addr)) == -1 )
+        cybozu::throw_unix_error(errno, "connect");
+    s = ::accept4(l, nullptr, nullptr, SOCK_NONBLOCK|SOCK_CLOEXEC);
+    if( s == -1 )
+        cybozu::throw_unix_error(errno, "accept4");
+    ::close(l);
+}
+
+struct send_socket : public cybozu::tcp_socket {
+    explicit send_socket(int s): cybozu::tcp_socket(s) {}
+    virtual bool on_readable(int) override { return true; }
+};
+
+void bench(std::size_t size, bool zerocopy) {
+    int c, s;
+    connect_pair(c, s);
+    std::unique_ptr<send_socket> p(new send_socket(s));
+    send_socket& sock = *p;
+    if( zerocopy )
+        sock.enable_zerocopy(size);
+
+    // the reactor writes pending data and reads completions.
+    cybozu::reactor r;
+    r.add_resource(std::move(p),
+                   cybozu::reactor::EVENT_IN|cybozu::reactor::EVENT_OUT);
+    std::atomic<bool> stop(false);
+    std::thread rt([&r, &stop]() {
+        while( ! stop.load() )
+            r.run_once();
+    });
+
+    const std::size_t count = TOTAL / size;
+    const std::size_t expected = count * (size + 8);
+    std::thread receiver([c, expected]() {
+        std::vector<char> buf(1 << 20);
+        std::size_t received = 0;
+        while( received < expected ) {
+            ssize_t n = ::recv(c, buf.data(), buf.size(), 0);
+            if( n <= 0 ) break;
+            received += n;
+        }
+    });
+
+    std::uint64_t sends = cybozu::tcp_socket::zerocopy_sends();
+    std::uint64_t copied = cybozu::tcp_socket::zerocopy_copied();
+    auto t1 = std::chrono::steady_clock::now();
+    for( std::size_t i = 0; i < count; ++i ) {
+        // a new buffer for each object as if read from a file.
+        cybozu::dynbuf data(0);
+        std::memset(data.prepare(size), 'a' + (i % 26), size);
+        data.consume(size);
+        cybozu::tcp_socket::iovec iov[2] = {
+            {"HEADER\r\n", 8},
+            {data.data(), data.size()}
+        };
+        sock.sendv(iov, 2, data, true);
+    }
+    receiver.join();
+    auto t2 = std::chrono::steady_clock::now();
+    stop.store(true);
+    rt.join();
+    ::close(c);
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        t2 - t1).count();
+    std::cout << (zerocopy ? "zerocopy " : "copy     ")
+              << (size >> 10) << "K: "
+              << (expected / static_cast<std::size_t>(us)) << " MB/s";
+    if( zerocopy )
+        std::cout << " (sends="
+                  << (cybozu::tcp_socket::zerocopy_sends() - sends)
+                  << ", copied="
+                  << (cybozu::tcp_socket::zerocopy_copied() - copied) << ")";
+    std::cout << std::endl;
+}
+
+int main() {
+    for( std::size_t size: SIZES ) {
+        bench(size, false);
+        bench(size, true);
+    }
+    return 0;
+}